@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_MAX_WORKERS 16    // Hilos como máximo (FSUTILS_JOBS lo ajusta)
+
+/**
+ * Función que procesa una imagen e imprime su informe con fs_out()
+ * @param path Ruta de la imagen
+ * @return 0 si tiene éxito, distinto de 0 si falla
+ */
+typedef int (*batch_fn)(const char *path);
+
+/**
+ * Procesa varias imágenes en paralelo con un conjunto acotado de hilos. Los
+ * directorios se sustituyen por los ficheros regulares que contienen. La
+ * salida de cada imagen se guarda en memoria y se imprime entera al acabar
+ * esa imagen; al final se imprime un resumen con tiempos y fallos
+ * @param fn Función a aplicar a cada imagen
+ * @param paths Rutas de imágenes o directorios
+ * @param count Número de rutas
+ * @return Número de imágenes que fallaron
+ */
+int batch_run(batch_fn fn, char *const paths[], int count);
+
+#endif // BATCH_H
@@ -0,0 +1,18 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "../include/ext2.h"
+
+#define CHECK_MAX_WORKERS 8     // Hilos de comprobación como máximo
+
+/**
+ * Comprobación de consistencia de solo lectura de un sistema ext2: contadores
+ * del superbloque y de cada grupo frente a los bitmaps, entradas de directorio
+ * (rec_len, name_len), contadores de enlaces frente a las referencias y bloques
+ * asignados a más de un inodo. Los grupos se procesan en paralelo.
+ * @param filename Ruta de la imagen
+ * @return Número de errores encontrados, o -1 si no se pudo comprobar
+ */
+long check_ext2(const char *filename);
+
+#endif // CHECK_H
@@ -0,0 +1,17 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "../include/fs.h"
+
+#define DIFF_CHUNK_SIZE (256 * 1024)    // Bytes comparados por paso
+
+/**
+ * Compara dos imágenes del mismo volumen recorriendo los dos árboles a la vez
+ * e imprime una línea por cambio: "A" añadido, "D" borrado, "M" modificado y
+ * "T" cambio de tipo (fichero <-> directorio)
+ * @param file_a Ruta de la imagen antigua
+ * @param file_b Ruta de la imagen nueva
+ */
+void diff_images(const char *file_a, const char *file_b);
+
+#endif // DIFF_H
@@ -0,0 +1,20 @@
+#ifndef DU_H
+#define DU_H
+
+#include "../include/fs.h"
+
+#define DU_MAX_WORKERS 8        // Hilos como máximo
+#define DU_TASKS_PER_WORKER 4   // Subárboles a repartir por hilo
+
+/**
+ * Uso de disco de cada directorio bajo una ruta, como du: una línea
+ * "<KiB asignados>\t<bytes>\t<ruta>" por directorio, los hijos antes que el
+ * padre. Solo lee metadatos: i_blocks e i_size en ext2, longitud de las
+ * cadenas de clústeres (con la FAT en memoria) en FAT16. Los subárboles
+ * independientes se suman en paralelo
+ * @param filename Ruta de la imagen
+ * @param path Directorio de inicio dentro de la imagen ("" para la raíz)
+ */
+void du_image(const char *filename, const char *path);
+
+#endif // DU_H
@@ -24,10 +24,32 @@
 #define EXT2_TIND_BLOCK     14
 #define EXT2_ROOT_INO       2
 
+// Feature flags
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002   // Las entradas guardan file_type
+#define EXT4_FEATURE_INCOMPAT_EXTENTS  0x0040   // Hay ficheros mapeados por extents
+#define EXT4_FEATURE_INCOMPAT_64BIT    0x0080   // Descriptores de grupo de s_desc_size bytes
+
+// Extents (ext4)
+#define EXT4_EXTENTS_FL     0x80000     // i_block contiene un árbol de extents
+#define EXT4_EXT_MAGIC      0xF30A      // Firma de cada nodo del árbol
+#define EXT4_EXT_MAX_DEPTH  5           // Profundidad máxima del árbol
+#define EXT4_EXT_INIT_MAX   32768       // Longitud máxima de un extent inicializado
+
+#define EXT2_DIR_CACHE_SLOTS   256  // Ranuras de la caché de directorios
+#define EXT2_INODE_CACHE_SLOTS 1024 // Ranuras de la caché de inodos
+#define EXT2_BLOCK_CACHE_SLOTS 64   // Ranuras de la caché de bloques de punteros
+#define EXT2_DENTRY_CACHE_SLOTS 4096 // Ranuras de la caché de dentries
+#define EXT2_NAME_LEN       255     // Longitud máxima de un nombre
+#define EXT2_PATH_MAX       4096    // Longitud máxima del destino de un enlace
+#define EXT2_MAX_SYMLINKS   40      // Enlaces simbólicos seguidos como máximo por ruta
+#define EXT2_RECOVER_CHUNK (1024 * 1024) // Bytes de tabla de inodos por lectura en --recover
+#define EXT2_ZERO_RUN       8       // Punteros a cero que se comprueban a la vez al saltar huecos
+
 // File type constants
 #define EXT2_FT_UNKNOWN     0
 #define EXT2_FT_REG_FILE    1
 #define EXT2_FT_DIR         2
+#define EXT2_FT_SYMLINK     7
 
 /*
  * Estructura del sistema de archivos EXT2
@@ -82,7 +104,7 @@ typedef struct __attribute__((packed)) {
     uint32_t s_hash_seed[4];          // Semilla para hash (no usado)
     uint8_t  s_def_hash_version;      // Versión de hash (no usado)
     uint8_t  s_reserved_char_pad;     // Relleno (no usado)
-    uint16_t s_reserved_word_pad;     // Relleno (no usado)
+    uint16_t s_desc_size;             // Tamaño del descriptor de grupo con 64BIT
     uint32_t s_default_mount_options; // Opciones por defecto de montaje (no usado)
     uint32_t s_first_meta_bg;         // Primer grupo meta (no usado)
     uint32_t s_reserved[190];         // Relleno restante (no usado)
@@ -92,8 +114,14 @@ typedef struct __attribute__((packed)) {
  * Estructura de descriptor de grupo
  */
 typedef struct __attribute__((packed)) {
-    uint32_t unused[2];
+    uint32_t bg_block_bitmap;      // Bloque del bitmap de bloques
+    uint32_t bg_inode_bitmap;      // Bloque del bitmap de inodos
     uint32_t bg_inode_table;       // Bloque de la tabla de inodos
+    uint16_t bg_free_blocks_count; // Bloques libres del grupo
+    uint16_t bg_free_inodes_count; // Inodos libres del grupo
+    uint16_t bg_used_dirs_count;   // Directorios del grupo
+    uint16_t bg_pad;               // Relleno (no usado)
+    uint32_t bg_reserved[3];       // Reservado (no usado)
 } ext2_group_desc;
 
 /*
@@ -117,8 +145,45 @@ typedef struct __attribute__((packed)) {
         struct { uint32_t m_i_reserved1; } masix1;
     } osd1;
     uint32_t i_block[15];   // Punteros a bloques
+    uint32_t i_generation;  // Versión del fichero (NFS)
+    uint32_t i_file_acl;    // Bloque de ACL extendidas
+    uint32_t i_size_high;   // 32 bits altos del tamaño (ficheros regulares; i_dir_acl en directorios)
+    uint32_t i_faddr;       // Dirección de fragmento (no usado)
+    uint8_t  osd2[12];      // Dependiente del SO (no usado)
 } ext2_inode;
 
+/*
+ * Cabecera de cada nodo del árbol de extents. La raíz ocupa i_block (60
+ * bytes); los demás nodos ocupan un bloque entero.
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t eh_magic;      // EXT4_EXT_MAGIC
+    uint16_t eh_entries;    // Entradas válidas tras la cabecera
+    uint16_t eh_max;        // Capacidad del nodo en entradas
+    uint16_t eh_depth;      // 0 = hoja (ext4_extent), >0 = índice (ext4_extent_idx)
+    uint32_t eh_generation; // Generación del árbol (no usado)
+} ext4_extent_header;
+
+/*
+ * Entrada de una hoja: un tramo de bloques lógicos contiguos en disco
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t ee_block;      // Primer bloque lógico
+    uint16_t ee_len;        // Bloques; > EXT4_EXT_INIT_MAX si no está inicializado
+    uint16_t ee_start_hi;   // 16 bits altos del primer bloque físico
+    uint32_t ee_start_lo;   // 32 bits bajos del primer bloque físico
+} ext4_extent;
+
+/*
+ * Entrada de un nodo índice: el subárbol que cubre desde ei_block
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t ei_block;      // Primer bloque lógico del subárbol
+    uint32_t ei_leaf_lo;    // 32 bits bajos del bloque del nodo hijo
+    uint16_t ei_leaf_hi;    // 16 bits altos del bloque del nodo hijo
+    uint16_t ei_unused;     // Relleno (no usado)
+} ext4_extent_idx;
+
 /*
  * Entrada de directorio
  */
@@ -130,6 +195,55 @@ typedef struct __attribute__((packed)) {
     char name[255];           // Nombre del archivo
 } ext2_dir_entry;
 
+/*
+ * Directorio decodificado en forma de estructura de arrays. Los nombres viven
+ * en un único pool y están NUL-terminados; name_off/name_len apuntan a ellos.
+ */
+typedef struct {
+    uint32_t ino;             // Inodo del directorio
+    uint32_t count;           // Número de entradas (inodo != 0)
+    uint32_t *inodes;         // Inodo de cada entrada
+    uint8_t  *types;          // file_type de cada entrada
+    uint32_t *name_off;       // Desplazamiento del nombre en names
+    uint8_t  *name_len;       // Longitud del nombre
+    char     *names;          // Pool de nombres
+    uint32_t cap;             // Capacidad de los arrays
+    uint32_t names_len;       // Bytes usados del pool
+    uint32_t names_cap;       // Capacidad del pool
+    int      cached;          // TRUE si pertenece a la caché
+} ext2_dir_view;
+
+/*
+ * Callback por bloque de datos para ext2_for_each_block.
+ * Devuelve distinto de 0 para detener la iteración.
+ */
+typedef int (*ext2_block_cb)(FILE *fp, uint32_t block, void *ctx);
+
+/**
+ * Función que lee el superbloque de un sistema ext2
+ * @param filename: ruta del archivo
+ * @param sbo: superbloque de salida
+ * @return 1 si tiene éxito, 0 en caso contrario
+ */
+int read_ext2_superblock(const char *filename, ext2_superblock *sbo);
+
+/**
+ * Función que lee el descriptor de un grupo de bloques
+ * @param fp: fichero de la imagen
+ * @param block_group: índice del grupo
+ * @param group: descriptor de salida
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int read_group_desc_ext2(FILE *fp, uint32_t block_group, ext2_group_desc *group);
+
+/**
+ * Función que devuelve el tamaño de un inodo en bytes, incluidos los 32 bits
+ * altos de i_size_high en los ficheros regulares (ficheros de más de 4 GiB)
+ * @param inode: inodo
+ * @return tamaño en bytes
+ */
+uint64_t ext2_file_size(const ext2_inode *inode);
+
 /**
  * Función que verifica si un archivo es un sistema ext2
  * @param filename: ruta del archivo
@@ -149,11 +263,146 @@ void metadata_ext2(const char *filename);
  */
 void tree_ext2(const char *filename);
 
+/**
+ * Función que analiza el espacio libre de un sistema ext2 a partir de los
+ * bitmaps de bloques e inodos de cada grupo
+ * @param filename: ruta del archivo
+ */
+void usage_ext2(const char *filename);
+
+/**
+ * Función que recorre las tablas de inodos buscando inodos borrados cuyos
+ * bloques siguen libres, y opcionalmente los extrae
+ * @param filename: ruta del archivo
+ * @param outdir: directorio de extracción, o NULL para solo listar
+ */
+void recover_ext2(const char *filename, const char *outdir);
+
+/**
+ * Función que lista todos los inodos en uso en el orden de las tablas de
+ * inodos, con sus metadatos y su ruta, sin recorrer el árbol
+ * @param filename: ruta del archivo
+ */
+void list_inodes_ext2(const char *filename);
+
 /**
  * Funcion para buscar el inodo por nombre o ruta y volcar sus bloques.
  * @param filename Ruta a la imagen EXT2.
  * @param target   Nombre (o ruta) de fichero a imprimir.
+ * @param offset   Primer byte a imprimir.
+ * @param length   Bytes a imprimir como máximo (CAT_TO_END = hasta el final).
+ */
+void cat_ext2(const char *filename, const char *target, uint64_t offset, uint64_t length);
+
+/**
+ * Lee un inodo por su número (requiere el superbloque cargado)
+ * @param fp: imagen abierta
+ * @param inode_num: número de inodo (empieza en 1)
+ * @param inode: salida
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int read_inode_ext2(FILE *fp, uint32_t inode_num, ext2_inode *inode);
+
+/**
+ * Recorre en orden lógico los bloques de datos de un inodo (directos e indirectos, o extents)
+ * @param fp: imagen abierta
+ * @param inode: inodo a recorrer
+ * @param cb: callback por bloque
+ * @param ctx: contexto del callback
+ * @return valor devuelto por el callback que detuvo el recorrido, 0, o -1 si
+ *         el árbol de extents usa bloques de 48 bits (no soportados)
+ */
+int ext2_for_each_block(FILE *fp, const ext2_inode *inode, ext2_block_cb cb, void *ctx);
+
+/**
+ * Obtiene la vista decodificada de un directorio, usando la caché
+ * @param fp: imagen abierta
+ * @param ino: inodo del directorio
+ * @return vista (liberar con ext2_dir_view_put) o NULL si falla
+ */
+const ext2_dir_view *ext2_dir_view_get(FILE *fp, uint32_t ino);
+
+/**
+ * Libera una vista obtenida con ext2_dir_view_get
+ * @param view: vista a liberar
+ */
+void ext2_dir_view_put(const ext2_dir_view *view);
+
+/**
+ * Vacía la caché de directorios (al cambiar de imagen)
+ */
+void ext2_dir_cache_clear(void);
+
+/**
+ * Vacía todas las cachés del lector en el hilo actual (inodos, bloques de
+ * punteros, dentries y directorios) y libera su memoria
+ */
+void ext2_cache_clear(void);
+
+/**
+ * Carga el superbloque y prepara las variables globales y cachés del lector
+ * @param filename: ruta del archivo
+ * @return TRUE si tiene éxito, FALSE en caso contrario
+ */
+int load_superblock_ext2(const char *filename);
+
+/**
+ * Resuelve una ruta desde la raíz a su número de inodo (cualquier tipo),
+ * siguiendo los enlaces simbólicos intermedios
+ * @param fp: imagen abierta
+ * @param path: ruta ("dir/sub/fichero"); "" o "/" es la raíz
+ * @param follow: TRUE para seguir también el último componente si es un enlace
+ * @return número de inodo, o 0 si no existe o hay demasiados enlaces
+ */
+uint32_t lookup_path_ext2(FILE *fp, const char *path, int follow);
+
+/**
+ * Tipo de una entrada de directorio: su file_type si el sistema tiene
+ * FILETYPE (sin leer el inodo), el del modo del inodo si no
+ * @param fp: imagen abierta
+ * @param ino: inodo de la entrada
+ * @param type: file_type de la entrada
+ * @return EXT2_FT_DIR, EXT2_FT_SYMLINK, EXT2_FT_REG_FILE o EXT2_FT_UNKNOWN
+ */
+uint8_t ext2_entry_type(FILE *fp, uint32_t ino, uint8_t type);
+
+/**
+ * Traduce un bloque lógico de un fichero a su bloque físico
+ * @param fp: imagen abierta
+ * @param inode: inodo del fichero
+ * @param lblk: bloque lógico
+ * @return bloque físico, o 0 si es un hueco
+ */
+uint32_t bmap_ext2(FILE *fp, const ext2_inode *inode, uint64_t lblk);
+
+/**
+ * Lee un rango de bytes de un fichero
+ * @param fp: imagen abierta
+ * @param inode: inodo del fichero
+ * @param offset: desplazamiento inicial
+ * @param buf: buffer de salida
+ * @param len: bytes a leer como máximo
+ * @return bytes leídos, o -1 en caso de error
+ */
+int64_t read_file_ext2(FILE *fp, const ext2_inode *inode, uint64_t offset, void *buf, size_t len);
+
+/**
+ * Lee el destino de un enlace simbólico (rápido o en bloque de datos)
+ * @param fp: imagen abierta
+ * @param inode: inodo del enlace
+ * @param buf: buffer de salida, NUL-terminado
+ * @param size: tamaño del buffer
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int readlink_ext2(FILE *fp, const ext2_inode *inode, char *buf, size_t size);
+
+/**
+ * Recoge todos los ficheros regulares bajo una ruta (directorio o fichero)
+ * @param fp: imagen abierta
+ * @param path: ruta de inicio ("" o "/" para la raíz)
+ * @param out: lista de salida
+ * @return 0 si tiene éxito, -1 si la ruta no existe
  */
-void cat_ext2(const char *filename, const char *target);
+int collect_files_ext2(FILE *fp, const char *path, fs_file_list *out);
 
 #endif
\ No newline at end of file
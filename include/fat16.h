@@ -14,9 +14,25 @@
 #define ATTR_ARCHIVE   0x20
 #define ATTR_VOLUME_ID 0x08
 
+#define FAT_BAD                0x0FFFFFF7 // Clúster malo (valor normalizado a 28 bits)
+#define FAT_EOC                0x0FFFFFF8 // Valores >= indican fin de cadena (normalizado)
+#define FAT12_MAX_CLUSTERS     4084     // Más clústeres que esto es FAT16
+#define FAT16_MAX_CLUSTERS     65524    // Más clústeres que esto es FAT32
+#define FAT32_FSINFO_LEAD      0x41615252 // Firmas del sector FSInfo
+#define FAT32_FSINFO_STRUCT    0x61417272
+#define FAT32_FSINFO_TRAIL     0xAA550000
+#define FAT16_DIR_CACHE_SLOTS  64       // Ranuras de la caché de directorios
+#define FAT16_HASH_MIN_VISITS  2        // Visitas antes de indexar un directorio
+#define FAT16_USAGE_GROUP      4096     // Clústeres por tramo en --usage
+#define FAT16_CHAIN_CACHE_SLOTS 16      // Ranuras de la caché de cadenas
+#define FAT16_FAT_CACHE_SLOTS  2        // Ventanas de la FAT en memoria (una por imagen)
+#define FAT16_FAT_WINDOW_SECTORS 8      // Sectores de cada ventana de la FAT
+
 
 /**
- * Estructura del sector de arranque de FAT16
+ * Estructura del sector de arranque de FAT12, FAT16 y FAT32. El BPB común
+ * va seguido del BPB extendido de FAT12/16 o del de FAT32, que lo desplaza
+ * 28 bytes.
  */
 typedef struct __attribute__((packed)) {
     uint8_t  jmp[3];                    // Instrucción de salto al código de arranque
@@ -35,16 +51,49 @@ typedef struct __attribute__((packed)) {
     uint32_t hidden_sectors;            // Sectores ocultos (no usado)
     uint32_t total_sectors_long;        // Sectores totales si total_sectors_small = 0
 
-    uint8_t  drive_number;              // Número de unidad (no usado)
-    uint8_t  current_head;              // Cabeza actual (no usado)
-    uint8_t  boot_signature;            // Firma de arranque (no usado)
-    uint32_t volume_id;                 // ID del volumen (no usado)
-    char     volume_label[11];          // Etiqueta del volumen
-    char     fs_type[8];                // Tipo de sistema de archivos (no usado)
+    union {
+        struct __attribute__((packed)) {        // FAT12 y FAT16
+            uint8_t  drive_number;              // Número de unidad (no usado)
+            uint8_t  current_head;              // Cabeza actual (no usado)
+            uint8_t  boot_signature;            // Firma de arranque (no usado)
+            uint32_t volume_id;                 // ID del volumen (no usado)
+            char     volume_label[11];          // Etiqueta del volumen
+            char     fs_type[8];                // Tipo de sistema de archivos (no usado)
+        };
+        struct __attribute__((packed)) {        // FAT32
+            uint32_t sectors_per_fat_32;        // Sectores ocupados por cada FAT
+            uint16_t ext_flags;                 // Bit 7: solo una FAT activa (bits 0-3)
+            uint16_t fs_version;                // Versión (no usado)
+            uint32_t root_cluster;              // Primer clúster del directorio raíz
+            uint16_t fs_info;                   // Sector del FSInfo
+            uint16_t backup_boot;               // Sector de la copia del boot sector (no usado)
+            uint8_t  reserved_32[12];           // Reservado (no usado)
+            uint8_t  drive_number_32;           // Número de unidad (no usado)
+            uint8_t  current_head_32;           // Cabeza actual (no usado)
+            uint8_t  boot_signature_32;         // Firma de arranque (no usado)
+            uint32_t volume_id_32;              // ID del volumen (no usado)
+            char     volume_label_32[11];       // Etiqueta del volumen
+            char     fs_type_32[8];             // Tipo de sistema de archivos (no usado)
+        };
+    };
 } fat16_boot_sector;
 
 /**
- * Entrada de directorio en FAT16
+ * Sector FSInfo de FAT32: contadores de espacio libre mantenidos por el
+ * sistema que montó el volumen
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t lead_sig;                  // FAT32_FSINFO_LEAD
+    uint8_t  reserved1[480];            // Reservado (no usado)
+    uint32_t struct_sig;                // FAT32_FSINFO_STRUCT
+    uint32_t free_count;                // Clústeres libres (0xFFFFFFFF = desconocido)
+    uint32_t next_free;                 // Pista del siguiente clúster libre (no usado)
+    uint8_t  reserved2[12];             // Reservado (no usado)
+    uint32_t trail_sig;                 // FAT32_FSINFO_TRAIL
+} fat32_fsinfo;
+
+/**
+ * Entrada de directorio en FAT
  */
 typedef struct __attribute__((packed)) {
     uint8_t filename[11];               // Nombre y extensión (8.3)
@@ -54,7 +103,7 @@ typedef struct __attribute__((packed)) {
     uint16_t creation_time;             // Hora de creación
     uint16_t creation_date;             // Fecha de creación
     uint16_t last_access_date;          // Fecha de último acceso
-    uint16_t first_cluster_high;        // Parte alta del número de clúster (no usado en FAT16)
+    uint16_t first_cluster_high;        // Parte alta del número de clúster (0 en FAT12/16)
     uint16_t last_write_time;           // Hora de última escritura
     uint16_t last_write_date;           // Fecha de última escritura
     uint16_t first_cluster_low;         // Parte baja del número de clúster inicial
@@ -62,14 +111,27 @@ typedef struct __attribute__((packed)) {
 } fat16_dir_entry;
 
 /**
- * Verifica si un archivo es un sistema de archivos FAT16
+ * Callback por entrada para list_dir_fat16. Devuelve distinto de 0 para parar.
+ */
+typedef int (*fat16_dir_cb)(const fat16_dir_entry *entry, const char *name, void *ctx);
+
+/**
+ * Lee el sector de arranque de una imagen FAT
+ * @param filename Ruta de la imagen o dispositivo
+ * @param bs Salida con el sector de arranque
+ * @return TRUE si tiene éxito, FALSE en caso contrario
+ */
+int read_fat16_boot_sector(const char *filename, fat16_boot_sector *bs);
+
+/**
+ * Verifica si un archivo es un sistema de archivos FAT12, FAT16 o FAT32
  * @param filename Ruta de la imagen o dispositivo
- * @return TRUE si es FAT16, FALSE en caso contrario
+ * @return TRUE si es FAT, FALSE en caso contrario
  */
 int is_fat16(const char *filename);
 
 /**
- * Muestra metadatos de un sistema FAT16
+ * Muestra metadatos de un sistema FAT; en FAT32 el espacio libre sale del FSInfo
  * @param filename Ruta de la imagen o dispositivo
  */
 void metadata_fat16(const char *filename);
@@ -86,8 +148,106 @@ void tree_fat16(const char *file_system, int find_file, const char *file_name);
 /**
  * Muestra el contenido de un archivo en un sistema FAT16
  * @param file_system Ruta de la imagen o dispositivo
- * @param file_name Nombre del archivo a mostrar
+ * @param file_name Nombre o ruta del archivo a mostrar
+ * @param offset Primer byte a mostrar
+ * @param length Bytes a mostrar como máximo (CAT_TO_END = hasta el final)
+ */
+void cat_fat16(const char *file_system, const char *file_name, uint64_t offset, uint64_t length);
+
+/**
+ * Muestra el espacio libre y la fragmentación de un sistema FAT16 a partir de la FAT
+ * @param filename Ruta de la imagen o dispositivo
+ */
+void usage_fat16(const char *filename);
+
+/**
+ * Lista las entradas borradas cuyos clústeres siguen libres y, opcionalmente, las extrae
+ * @param filename Ruta de la imagen o dispositivo
+ * @param outdir   Directorio de extracción, o NULL para solo listar
+ */
+void recover_fat16(const char *filename, const char *outdir);
+
+/**
+ * Resuelve una ruta ("dir/sub/fichero.txt") descendiendo un componente cada vez.
+ * La comparación se hace sobre el nombre 8.3 de disco, sin distinguir mayúsculas.
+ * @param fp   FILE* abierto de la imagen FAT16
+ * @param bs   Boot sector ya leído
+ * @param path Ruta a resolver, relativa a la raíz
+ * @param out  Entrada de directorio encontrada
+ * @return TRUE si la ruta existe, FALSE en caso contrario
+ */
+int find_path_fat16(FILE *fp, const fat16_boot_sector *bs, const char *path, fat16_dir_entry *out);
+
+/**
+ * Libera las cachés del hilo actual (directorios, cadenas de clústeres y FAT
+ * en memoria). Debe llamarse antes de trabajar con otra imagen.
+ */
+void fat16_cache_clear(void);
+
+/**
+ * Normaliza el nombre 8.3 de una entrada ("PRACTICA C  " -> "practica.c")
+ * @param e Entrada de directorio
+ * @param name Salida de al menos 13 bytes
+ */
+void format_name_fat16(const fat16_dir_entry *e, char name[13]);
+
+/**
+ * Recorre las entradas vivas de un directorio (sin "." ni "..")
+ * @param fp FILE* abierto de la imagen
+ * @param bs Boot sector ya leído
+ * @param cluster Primer clúster del directorio (0 = raíz)
+ * @param cb Callback por entrada
+ * @param ctx Contexto del callback
+ * @return 0 si tiene éxito, -1 si no se pudo leer el directorio
+ */
+int list_dir_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, fat16_dir_cb cb, void *ctx);
+
+/**
+ * Cuenta los clústeres de una cadena usando la FAT en memoria
+ * @param fp Imagen abierta
+ * @param bs Boot sector
+ * @param first Primer clúster (0 = fichero vacío)
+ * @return Número de clústeres
+ */
+uint32_t chain_length_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t first);
+
+/**
+ * Primer clúster de una entrada (la parte alta solo se usa en FAT32)
+ * @param e Entrada de directorio
+ * @return Número de clúster
+ */
+uint32_t first_cluster_fat16(const fat16_dir_entry *e);
+
+/**
+ * Lee un directorio completo tal como está en disco, incluidas las entradas libres y borradas
+ * @param fp FILE* abierto de la imagen
+ * @param bs Boot sector ya leído
+ * @param cluster Primer clúster del directorio (0 = raíz)
+ * @param n_entries Salida: número de entradas de 32 bytes
+ * @return Entradas leídas (liberar con free), o NULL si falla
+ */
+fat16_dir_entry *read_dir_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, uint32_t *n_entries);
+
+/**
+ * Lee un rango de bytes de un fichero siguiendo su cadena de clústeres
+ * @param fp FILE* abierto de la imagen
+ * @param bs Boot sector ya leído
+ * @param e Entrada de directorio del fichero
+ * @param offset Desplazamiento inicial
+ * @param buf Buffer de salida
+ * @param len Bytes a leer como máximo
+ * @return Bytes leídos, o -1 en caso de error
+ */
+int64_t read_file_fat16(FILE *fp, const fat16_boot_sector *bs, const fat16_dir_entry *e, uint64_t offset, void *buf, size_t len);
+
+/**
+ * Recoge todos los ficheros bajo una ruta (directorio o fichero)
+ * @param fp FILE* abierto de la imagen
+ * @param bs Boot sector ya leído
+ * @param path Ruta de inicio ("" o "/" para la raíz)
+ * @param out Lista de salida
+ * @return 0 si tiene éxito, -1 si la ruta no existe
  */
-void cat_fat16(const char *file_system, const char *file_name);
+int collect_files_fat16(FILE *fp, const fat16_boot_sector *bs, const char *path, fs_file_list *out);
 
 #endif // FAT16_H
\ No newline at end of file
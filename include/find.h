@@ -0,0 +1,23 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include "../include/fs.h"
+
+#define FIND_MAX_PREDS 32       // Predicados como máximo en una búsqueda
+
+/**
+ * Busca en el árbol de una imagen las entradas que cumplen todos los
+ * predicados (-name, -type, -size, -mtime, con "!" para negarlos) e imprime
+ * su ruta. -maxdepth y -prune limitan el recorrido: esos directorios no se
+ * llegan a leer. Los predicados se evalúan de más barato a más caro y el
+ * inodo solo se lee si alguno lo necesita
+ * @param filename Ruta de la imagen
+ * @param path Directorio de inicio dentro de la imagen ("" para la raíz)
+ * @param argc Número de argumentos de la búsqueda
+ * @param argv Argumentos de la búsqueda
+ * @return 0 si tiene éxito, 1 si no se pudo leer la imagen o la ruta, -1 si
+ *         los argumentos no son válidos
+ */
+int find_image(const char *filename, const char *path, int argc, char *const argv[]);
+
+#endif // FIND_H
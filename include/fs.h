@@ -0,0 +1,55 @@
+#ifndef FS_H
+#define FS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../include/ext2.h"
+#include "../include/fat16.h"
+#include "../include/util.h"
+
+/**
+ * Imagen abierta, sea ext2 o FAT16. Permite a los modos que recorren ficheros
+ * (hash, grep, diff...) trabajar igual sobre los dos sistemas.
+ */
+typedef struct {
+    int is_ext2;                // TRUE para ext2, FALSE para FAT16
+    FILE *fp;                   // Imagen abierta
+    fat16_boot_sector bs;       // Boot sector (solo FAT)
+} fs_image;
+
+/**
+ * Abre una imagen ext2 o FAT16 y prepara el lector correspondiente
+ * @param img Imagen a rellenar
+ * @param filename Ruta de la imagen
+ * @return 0 si tiene éxito, -1 si no se reconoce o no se puede abrir
+ */
+int fs_open(fs_image *img, const char *filename);
+
+/**
+ * Cierra una imagen abierta con fs_open
+ * @param img Imagen a cerrar
+ */
+void fs_close(fs_image *img);
+
+/**
+ * Recoge todos los ficheros regulares bajo una ruta de la imagen
+ * @param img Imagen abierta
+ * @param path Ruta de inicio ("" o "/" para la raíz)
+ * @param out Lista de salida
+ * @return 0 si tiene éxito, -1 si la ruta no existe
+ */
+int fs_collect(fs_image *img, const char *path, fs_file_list *out);
+
+/**
+ * Lee un rango de bytes de un fichero recogido con fs_collect
+ * @param img Imagen abierta
+ * @param file Fichero
+ * @param offset Desplazamiento inicial
+ * @param buf Buffer de salida
+ * @param len Bytes a leer como máximo
+ * @return Bytes leídos, o -1 en caso de error
+ */
+int64_t fs_read(fs_image *img, const fs_file *file, uint64_t offset, void *buf, size_t len);
+
+#endif // FS_H
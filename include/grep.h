@@ -0,0 +1,30 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/fs.h"
+
+#define GREP_CHUNK_SIZE (256 * 1024)    // Bytes leídos por paso
+
+/**
+ * Busca la primera aparición de un patrón en un buffer
+ * @param hay Buffer donde buscar
+ * @param n Longitud del buffer
+ * @param pat Patrón
+ * @param m Longitud del patrón (> 0)
+ * @return Puntero a la primera aparición, o NULL si no hay ninguna
+ */
+const uint8_t *grep_find(const uint8_t *hay, size_t n, const uint8_t *pat, size_t m);
+
+/**
+ * Busca un patrón literal en el contenido de todos los ficheros regulares
+ * bajo una ruta e imprime una línea "<ruta>:<offset>" por coincidencia
+ * @param filename Ruta de la imagen
+ * @param pattern Patrón a buscar
+ * @param path Ruta de inicio dentro de la imagen ("" para la raíz)
+ */
+void grep_image(const char *filename, const char *pattern, const char *path);
+
+#endif // GREP_H
@@ -0,0 +1,19 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "../include/fs.h"
+#include "../include/sha256.h"
+
+#define HASH_CHUNK_SIZE   (256 * 1024)  // Bytes leídos por paso
+#define HASH_QUEUE_DEPTH  8             // Trozos en cola por hilo de hash
+#define HASH_MAX_WORKERS  8             // Hilos de hash como máximo
+
+/**
+ * Calcula el SHA-256 de todos los ficheros regulares bajo una ruta e imprime
+ * una línea "<hash>  <ruta>" por fichero, como sha256sum
+ * @param filename Ruta de la imagen
+ * @param path Ruta de inicio dentro de la imagen ("" para la raíz)
+ */
+void hash_image(const char *filename, const char *path);
+
+#endif // HASH_H
@@ -0,0 +1,70 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define IMAGE_CACHE_BYTES (32 * 1024 * 1024)  // Caché de trozos descomprimidos por imagen
+#define IMAGE_CACHE_MIN_SLOTS 8               // Trozos en caché como mínimo
+#define IMAGE_MAX_CHUNK (64 * 1024 * 1024)    // Tamaño máximo de un trozo (frame zstd, clúster qcow2)
+#define IMAGE_DIRECT_ALIGN 4096               // Alineación de buffers, desplazamientos y longitudes con O_DIRECT
+#define IMAGE_DIRECT_CHUNK_BITS 16            // Trozos de 64 KiB en las imágenes raw en modo directo
+#define IMAGE_DIRECT_CACHE_BYTES (4 * 1024 * 1024) // Caché de metadatos por imagen raw en modo directo
+#define IMAGE_DIRECT_BULK (1024 * 1024)       // Buffer alineado para lecturas grandes en modo directo
+
+/*
+ * Origen de bloques bajo los lectores: un fichero raw (también disperso), una
+ * imagen qcow2 o una imagen zstd con tabla de saltos (formato "seekable").
+ * Las imágenes que no son raw se leen por trozos (un clúster qcow2, un frame
+ * zstd) que se descomprimen bajo demanda y se guardan en una caché LRU.
+ */
+typedef struct image_source image_source;
+
+/**
+ * Abre el origen de bloques de una imagen. Los orígenes se comparten entre
+ * todas las aperturas del mismo fichero mientras alguna siga abierta
+ * @param filename Ruta de la imagen
+ * @return El origen, o NULL si no se puede abrir o el formato no está soportado
+ */
+image_source *image_source_get(const char *filename);
+
+/**
+ * Libera una referencia obtenida con image_source_get
+ * @param src Origen a liberar
+ */
+void image_source_put(image_source *src);
+
+/**
+ * Lee un rango de la imagen descomprimida. Se puede llamar desde varios hilos
+ * @param src Origen
+ * @param buf Buffer de salida
+ * @param len Bytes a leer
+ * @param offset Desplazamiento en la imagen descomprimida
+ * @return Bytes leídos (menos de len al final de la imagen), o -1 si hay error
+ */
+int64_t image_pread(image_source *src, void *buf, size_t len, uint64_t offset);
+
+/**
+ * Tamaño de la imagen descomprimida
+ * @param src Origen
+ * @return Tamaño en bytes
+ */
+uint64_t image_size(const image_source *src);
+
+/**
+ * Abre una imagen para leerla con stdio. Las imágenes raw se abren
+ * directamente; las demás pasan por su origen de bloques
+ * @param filename Ruta de la imagen
+ * @return FILE de solo lectura, o NULL si hay error
+ */
+FILE *image_open(const char *filename);
+
+/**
+ * Lee del entorno el modo de E/S. Con FSUTILS_DIRECT=1 las imágenes raw se
+ * abren con O_DIRECT y se leen con buffers alineados y una caché propia, sin
+ * llenar la caché de páginas del sistema. Debe llamarse antes de abrir imágenes
+ */
+void image_options_from_env(void);
+
+#endif // IMAGE_H
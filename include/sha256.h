@@ -0,0 +1,47 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/**
+* Incremental SHA-256 state (FIPS 180-4).
+*/
+typedef struct {
+    uint32_t state[8];      // Intermediate hash value
+    uint64_t bytes;         // Bytes hashed so far
+    uint8_t  block[64];     // Pending partial block
+    size_t   fill;          // Bytes used in block
+} sha256_ctx;
+
+/**
+* Initialise a SHA-256 context.
+* @param ctx The context.
+*/
+void sha256_init(sha256_ctx *ctx);
+
+/**
+* Hash more data.
+* @param ctx The context.
+* @param data Data to hash.
+* @param len Length of data in bytes.
+*/
+void sha256_update(sha256_ctx *ctx, const void *data, size_t len);
+
+/**
+* Finish the hash and write the digest.
+* @param ctx The context.
+* @param digest Output of SHA256_DIGEST_SIZE bytes.
+*/
+void sha256_final(sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+* Format a digest as lowercase hex.
+* @param digest The digest.
+* @param hex Output of 2 * SHA256_DIGEST_SIZE + 1 bytes.
+*/
+void sha256_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[2 * SHA256_DIGEST_SIZE + 1]);
+
+#endif // SHA256_H
@@ -0,0 +1,84 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stdint.h>
+
+#define SORT_NAME_MAX 255       // Longitud máxima de un nombre
+#define SORT_MAX_FANIN 64       // Tramos en disco que se mezclan a la vez
+#define SORT_MIN_RUN (64 * 1024) // Bytes mínimos de un tramo en disco
+
+/*
+ * Orden de --tree: el de disco (por defecto), por nombre, por tamaño (de
+ * mayor a menor) o por fecha de modificación (de más reciente a más
+ * antigua). Los empates se deshacen por nombre, así la salida es estable.
+ */
+typedef enum { TREE_SORT_NONE, TREE_SORT_NAME, TREE_SORT_SIZE, TREE_SORT_MTIME } tree_sort_order;
+
+extern tree_sort_order tree_sort;
+
+/*
+ * Entrada de un directorio a ordenar.
+ */
+typedef struct {
+    uint64_t key;               // Tamaño o fecha, según el orden
+    uint32_t id;                // Inodo (ext2) o primer clúster (FAT16)
+    uint8_t is_dir;
+    uint8_t name_len;
+    char name[SORT_NAME_MAX + 1];
+} sort_entry;
+
+/*
+ * Ordenación de las entradas de un directorio. Mientras caben en la memoria
+ * permitida (fs_limit.sort_mem, compartida por todos los directorios abiertos
+ * del hilo) se ordenan en memoria; si no, se vuelcan a ficheros temporales
+ * en tramos ordenados que luego se mezclan.
+ */
+typedef struct dir_sorter dir_sorter;
+
+/**
+ * Elige el orden de --tree a partir de "name", "size" o "mtime"
+ * @param name Nombre del orden
+ * @return TRUE si el nombre es válido, FALSE si no
+ */
+int tree_sort_parse(const char *name);
+
+/**
+ * Crea una ordenación vacía con el orden de tree_sort
+ * @return La ordenación, o NULL si no hay memoria
+ */
+dir_sorter *dir_sorter_new(void);
+
+/**
+ * Añade una entrada
+ * @param s Ordenación
+ * @param name Nombre (se copia; se recorta a SORT_NAME_MAX bytes)
+ * @param key Tamaño o fecha
+ * @param id Inodo o primer clúster
+ * @param is_dir TRUE si es un directorio
+ * @return 0 si tiene éxito, -1 si hay error
+ */
+int dir_sorter_add(dir_sorter *s, const char *name, uint64_t key, uint32_t id, int is_dir);
+
+/**
+ * Termina de añadir y deja la ordenación lista para leerla
+ * @param s Ordenación
+ * @return 0 si tiene éxito, -1 si hay error
+ */
+int dir_sorter_finish(dir_sorter *s);
+
+/**
+ * Siguiente entrada en orden
+ * @param s Ordenación
+ * @param out Entrada de salida
+ * @param is_last Salida: TRUE si es la última
+ * @return TRUE si hay entrada, FALSE al final
+ */
+int dir_sorter_next(dir_sorter *s, sort_entry *out, int *is_last);
+
+/**
+ * Libera una ordenación y sus ficheros temporales
+ * @param s Ordenación
+ */
+void dir_sorter_free(dir_sorter *s);
+
+#endif // SORT_H
@@ -1,11 +1,224 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
 #define TRUE 1
 #define FALSE 0
 
+#define CAT_TO_END      UINT64_MAX      // --cat without --length
+#define CAT_CHUNK_SIZE  (64 * 1024)     // Bytes read per step by --cat
+
 /**
 * This function formats a time_t value into a human-readable string.
 * @param t The time_t value to format.
-* @return A pointer to a static buffer containing the formatted time string.
+* @return A pointer to a per-thread buffer containing the formatted time string.
 */
 char *format_time(time_t t);
+
+/**
+* Stream the readers print their reports to: stdout, unless the calling
+* thread redirected it with fs_set_out.
+* @return The stream of the calling thread.
+*/
+FILE *fs_out(void);
+
+/**
+* Redirect the reports printed by the calling thread, e.g. to a memory
+* buffer so that the output of several images does not interleave.
+* @param fp The stream to print to, or NULL to go back to stdout.
+*/
+void fs_set_out(FILE *fp);
+
+#define USAGE_HIST_BUCKETS 32
+
+/**
+* Accumulated free-space statistics for a bitmap or allocation table.
+* Runs are fed in increasing order; free extents spanning several
+* calls (e.g. consecutive block groups) are merged.
+*/
+typedef struct {
+    uint64_t total;                     // Units seen (blocks, clusters...)
+    uint64_t free;                      // Free units
+    uint64_t extents;                   // Number of free extents
+    uint64_t largest;                   // Largest free extent
+    uint64_t largest_start;             // First unit of the largest extent
+    uint64_t hist[USAGE_HIST_BUCKETS];  // Free extents by floor(log2(length))
+    uint64_t run;                       // Length of the open free extent
+    uint64_t run_start;                 // Start of the open free extent
+} usage_stats;
+
+/**
+* Count the set bits of a bitmap, one 64-bit word at a time.
+* Uses the hardware popcount instruction when the CPU has it.
+* @param bm The bitmap.
+* @param nbits Number of bits to count.
+* @return Number of bits set to 1.
+*/
+uint64_t bitmap_popcount(const uint8_t *bm, uint64_t nbits);
+
+/**
+* Feed a run of units with the same state into the statistics.
+* @param st The statistics to update.
+* @param start First unit of the run.
+* @param len Length of the run.
+* @param is_free TRUE if the run is free space.
+*/
+void usage_feed(usage_stats *st, uint64_t start, uint64_t len, int is_free);
+
+/**
+* Feed a bitmap (bit set = allocated) into the statistics, skipping
+* whole 64-bit words that are completely free or completely used.
+* @param st The statistics to update.
+* @param bm The bitmap.
+* @param nbits Number of valid bits.
+* @param base Unit number of bit 0.
+*/
+void usage_feed_bitmap(usage_stats *st, const uint8_t *bm, uint64_t nbits, uint64_t base);
+
+/**
+* Close the open free extent, if any. Call once after the last feed.
+* @param st The statistics to update.
+*/
+void usage_finish(usage_stats *st);
+
+/**
+* Print the free extent summary and histogram.
+* @param st The statistics to print.
+* @param unit_size Size in bytes of one unit.
+* @param unit_name Name of the unit ("block", "cluster").
+*/
+void usage_print(const usage_stats *st, uint32_t unit_size, const char *unit_name);
+
+/**
+* A regular file found while walking an image.
+*/
+typedef struct {
+    char *path;             // Full path from the root, without leading '/'
+    uint64_t size;          // Size in bytes
+    uint64_t first_block;   // First physical block or cluster, to sort reads
+    uint32_t id;            // ext2 inode number or FAT16 first cluster
+} fs_file;
+
+/**
+* Growable list of files.
+*/
+typedef struct {
+    fs_file *files;
+    size_t count;
+    size_t cap;
+} fs_file_list;
+
+/**
+* Append a file to a list. The path is copied.
+* @param list The list.
+* @param path Full path of the file.
+* @param size Size in bytes.
+* @param first_block First physical block or cluster.
+* @param id File identifier (inode or first cluster).
+* @return 0 on success, -1 if out of memory.
+*/
+int fs_file_list_add(fs_file_list *list, const char *path, uint64_t size, uint64_t first_block, uint32_t id);
+
+/**
+* Free a list and all its paths.
+* @param list The list.
+*/
+void fs_file_list_free(fs_file_list *list);
+
+/**
+* Join a directory path and a name with '/'. An empty directory is the root.
+* @param dir The directory path.
+* @param name The entry name.
+* @return A newly allocated string, or NULL if out of memory.
+*/
+char *path_join(const char *dir, const char *name);
+
+/**
+* Prefix for the children of a --tree entry: the entry's prefix followed by
+* a vertical bar, or by blanks when it is the last of its directory.
+* @param prefix The prefix of the entry.
+* @param is_last Whether the entry is the last of its directory.
+* @return A newly allocated string, or NULL if out of memory.
+*/
+char *tree_child_prefix(const char *prefix, int is_last);
+
+#define FS_DEFAULT_MAX_DEPTH     256                 // Directory levels
+#define FS_DEFAULT_MAX_DIR_BYTES (64ull << 20)       // Bytes read per directory
+#define FS_DEFAULT_SORT_MEM      (16ull << 20)       // Bytes of entries sorted in memory
+
+/**
+* Limits that keep a corrupt image from making the readers loop or read
+* without end. Defaults can be overridden with the environment variables
+* FSUTILS_MAX_DEPTH and FSUTILS_MAX_DIR_BYTES.
+*/
+typedef struct {
+    uint32_t max_depth;     // Deepest directory level walked
+    uint64_t max_dir_bytes; // Largest directory read, larger ones are truncated
+    uint64_t sort_mem;      // Memory for sorting listings, beyond it they spill to disk
+} fs_limits;
+
+extern fs_limits fs_limit;
+
+/**
+* Load the limits from the environment, keeping the defaults for the
+* variables that are unset or not a positive number.
+*/
+void fs_limits_from_env(void);
+
+/**
+* Directories already entered during one walk, keyed by inode or first
+* cluster, so that a directory linked from several parents is read once.
+* The walkers of --du share it between threads, hence the lock.
+*/
+typedef struct {
+    uint64_t *slots;                // Open addressing, id + 1 (0 = empty)
+    size_t count;
+    size_t cap;                     // Power of 2
+    pthread_mutex_t lock;
+} fs_visited;
+
+/**
+* A directory being walked, linked to its parent on the caller's stack so
+* that a directory pointing back at one of its ancestors can be detected.
+* The chain starts at a top node (fs_walk_begin) that is not a directory
+* and holds the visited set of the whole walk.
+*/
+typedef struct fs_walk {
+    uint32_t id;                    // Inode or first cluster of the directory
+    uint32_t depth;                 // 0 for the root
+    const struct fs_walk *parent;   // NULL in the top node
+    fs_visited *visited;            // Shared by every node of the walk
+    int top;                        // TRUE in the top node
+} fs_walk;
+
+/**
+* Start a walk: fill in its top node, to be passed as the parent of the
+* start directory, with an empty visited set.
+* @param top Top node, on the caller's stack.
+*/
+void fs_walk_begin(fs_walk *top);
+
+/**
+* Finish a walk started with fs_walk_begin and free its visited set.
+* @param top Top node of the walk.
+*/
+void fs_walk_end(fs_walk *top);
+
+/**
+* Enter a directory during a recursive walk.
+* @param node Node to fill in for the directory, on the caller's stack.
+* @param parent Node of the parent directory, or the top node of the walk
+* for the start directory.
+* @param id Inode or first cluster of the directory.
+* @return TRUE if it can be walked, FALSE if it is an ancestor (a cycle),
+* it was already walked through another path or it is deeper than
+* fs_limit.max_depth.
+*/
+int fs_walk_enter(fs_walk *node, const fs_walk *parent, uint32_t id);
+
+#endif // UTIL_H
@@ -0,0 +1,193 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/batch.h"
+#include "../include/ext2.h"
+#include "../include/fat16.h"
+#include "../include/util.h"
+
+/*
+ * Una imagen a procesar y su resultado.
+ */
+typedef struct {
+    char *path;
+    int status;
+    double seconds;
+} batch_job;
+
+typedef struct {
+    batch_job *jobs;
+    size_t count;
+    size_t cap;
+    batch_fn fn;
+    pthread_mutex_t lock;       // Protege next y la salida
+    size_t next;                // Siguiente imagen a repartir
+} batch_ctx;
+
+static int add_job(batch_ctx *b, const char *path) {
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 64;
+        batch_job *tmp = realloc(b->jobs, cap * sizeof(batch_job));
+        if (!tmp) return -1;
+        b->jobs = tmp;
+        b->cap = cap;
+    }
+    batch_job *j = &b->jobs[b->count];
+    memset(j, 0, sizeof(*j));
+    if (!(j->path = strdup(path))) return -1;
+    b->count++;
+    return 0;
+}
+
+static int cmp_name(const void *x, const void *y) {
+    return strcmp(*(char *const *)x, *(char *const *)y);
+}
+
+/**
+ * Queue the regular files of a directory (not its subdirectories), sorted
+ * by name.
+ */
+static void add_dir(batch_ctx *b, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) { perror(dir); return; }
+
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        char *path = path_join(dir, de->d_name);
+        struct stat st;
+        if (path && stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (n == cap) {
+                cap = cap ? cap * 2 : 64;
+                char **tmp = realloc(names, cap * sizeof(char *));
+                if (!tmp) { free(path); break; }
+                names = tmp;
+            }
+            names[n++] = path;
+        } else {
+            free(path);
+        }
+    }
+    closedir(d);
+
+    qsort(names, n, sizeof(char *), cmp_name);
+    for (size_t i = 0; i < n; i++) {
+        add_job(b, names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Worker: take images until none are left. Each report is rendered into a
+ * memory buffer and printed in one go under the lock.
+ */
+static void *batch_worker(void *arg) {
+    batch_ctx *b = arg;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        size_t i = b->next++;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->count) break;
+
+        batch_job *j = &b->jobs[i];
+        char *report = NULL;
+        size_t report_len = 0;
+        FILE *out = open_memstream(&report, &report_len);
+        double start = now();
+        fs_set_out(out);
+        j->status = b->fn(j->path);
+        fs_set_out(NULL);
+        j->seconds = now() - start;
+        if (out) fclose(out);
+
+        // Cada hilo reutiliza sus cachés con la imagen siguiente
+        ext2_cache_clear();
+        fat16_cache_clear();
+
+        pthread_mutex_lock(&b->lock);
+        printf("==> %s <==\n", j->path);
+        if (report) fwrite(report, 1, report_len, stdout);
+        printf("\n");
+        fflush(stdout);
+        pthread_mutex_unlock(&b->lock);
+        free(report);
+    }
+    return NULL;
+}
+
+/**
+ * Run one command over many images ("--info"/"--tree" with several images
+ * or a directory) on a bounded pool of threads. Every thread reads one image
+ * at a time with its own reader state, and the output of each image is
+ * printed as a whole once it is done, followed by a summary.
+ *
+ * @param fn    Function that handles one image.
+ * @param paths Image files or directories of images.
+ * @param count Number of paths.
+ * @return Number of images that failed.
+ */
+int batch_run(batch_fn fn, char *const paths[], int count) {
+    batch_ctx b;
+    memset(&b, 0, sizeof(b));
+    b.fn = fn;
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) add_dir(&b, paths[i]);
+        else add_job(&b, paths[i]);
+    }
+
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *env = getenv("FSUTILS_JOBS");
+    if (env && atol(env) > 0) workers = atol(env);
+    if (workers < 1) workers = 1;
+    if (workers > BATCH_MAX_WORKERS) workers = BATCH_MAX_WORKERS;
+    if ((size_t)workers > b.count) workers = b.count ? b.count : 1;
+
+    double start = now();
+    pthread_t threads[BATCH_MAX_WORKERS];
+    pthread_mutex_init(&b.lock, NULL);
+    long started = 0;
+    while (started < workers && pthread_create(&threads[started], NULL, batch_worker, &b) == 0) started++;
+    if (started == 0) batch_worker(&b);
+    for (long i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&b.lock);
+    double wall = now() - start;
+
+    int failed = 0;
+    double busy = 0;
+    size_t slowest = 0;
+    for (size_t i = 0; i < b.count; i++) {
+        if (b.jobs[i].status != 0) failed++;
+        busy += b.jobs[i].seconds;
+        if (b.jobs[i].seconds > b.jobs[slowest].seconds) slowest = i;
+    }
+
+    printf("------ Summary ------\n\n");
+    printf("  Images...........: %zu\n", b.count);
+    printf("  Failed...........: %d\n", failed);
+    printf("  Threads..........: %ld\n", started ? started : 1);
+    printf("  Wall time........: %.3f s\n", wall);
+    printf("  Image time.......: %.3f s\n", busy);
+    if (b.count) printf("  Slowest..........: %s (%.3f s)\n", b.jobs[slowest].path, b.jobs[slowest].seconds);
+    for (size_t i = 0; i < b.count; i++) {
+        if (b.jobs[i].status != 0) printf("  FAILED: %s\n", b.jobs[i].path);
+    }
+
+    for (size_t i = 0; i < b.count; i++) free(b.jobs[i].path);
+    free(b.jobs);
+    return failed;
+}
@@ -0,0 +1,356 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/check.h"
+#include "../include/image.h"
+
+/*
+ * Estado compartido por todos los hilos. Los arrays por bloque y por inodo
+ * que tocan varios grupos (claimed, refs) se actualizan con operaciones
+ * atómicas; el resto solo lo escribe el hilo dueño del grupo.
+ */
+typedef struct {
+    image_source *src;
+    ext2_superblock sb;
+    uint32_t block_size;
+    uint32_t inode_size;
+    uint32_t groups;
+    ext2_group_desc *gds;
+    uint8_t *bitmap;            // Bitmap de bloques de todo el volumen
+    uint8_t *claimed;           // Bloques vistos en algún inodo
+    uint32_t *refs;             // Entradas de directorio que apuntan a cada inodo
+    uint16_t *links;            // i_links_count de cada inodo en uso
+    uint8_t *in_use;            // TRUE si el bitmap de inodos lo marca en uso
+    pthread_mutex_t lock;
+    uint32_t next_group;        // Siguiente grupo a repartir
+} check_ctx;
+
+/*
+ * Resultado de un grupo: su informe se imprime en orden al terminar.
+ */
+typedef struct {
+    char *report;
+    size_t report_len;
+    FILE *out;
+    long errors;
+    uint64_t free_blocks;
+    uint64_t free_inodes;
+} check_group;
+
+static void check_error(check_group *g, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Append an error line to the report of a group.
+ */
+static void check_error(check_group *g, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("  ", g->out);
+    vfprintf(g->out, fmt, ap);
+    fputc('\n', g->out);
+    va_end(ap);
+    g->errors++;
+}
+
+static int test_bit(const uint8_t *bm, uint64_t bit) {
+    return (bm[bit / 8] >> (bit % 8)) & 1;
+}
+
+/**
+ * Mark a block as used by an inode, reporting blocks out of range and
+ * blocks already claimed by another inode.
+ *
+ * @return TRUE if the block is valid and can be followed.
+ */
+static int claim_block(check_ctx *c, check_group *g, uint32_t ino, uint32_t block) {
+    if (block < c->sb.s_first_data_block || block >= c->sb.s_blocks_count) {
+        check_error(g, "Inode %u: block %u out of range", ino, block);
+        return FALSE;
+    }
+    uint64_t bit = block - c->sb.s_first_data_block;
+    uint8_t mask = 1u << (bit % 8);
+    if (__atomic_fetch_or(&c->claimed[bit / 8], mask, __ATOMIC_RELAXED) & mask) {
+        check_error(g, "Inode %u: block %u is also used by another inode", ino, block);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Check the entries of one directory block and count the references they
+ * make to each inode.
+ */
+static void check_dir_block(check_ctx *c, check_group *g, uint32_t ino, uint32_t block, uint8_t *buf) {
+    if (image_pread(c->src, buf, c->block_size, (uint64_t)block * c->block_size) != c->block_size) {
+        check_error(g, "Directory %u: cannot read block %u", ino, block);
+        return;
+    }
+
+    for (uint32_t off = 0; off < c->block_size; ) {
+        const ext2_dir_entry *e = (const ext2_dir_entry *)(buf + off);
+        if (e->rec_len < 8 || e->rec_len % 4 != 0 || off + e->rec_len > c->block_size) {
+            check_error(g, "Directory %u: bad rec_len %u at block %u offset %u", ino, e->rec_len, block, off);
+            return;
+        }
+        if ((uint32_t)e->name_len + 8 > e->rec_len) {
+            check_error(g, "Directory %u: name_len %u does not fit in rec_len %u at block %u offset %u",
+                        ino, e->name_len, e->rec_len, block, off);
+        } else if (e->inode > c->sb.s_inodes_count) {
+            check_error(g, "Directory %u: entry points to inode %u out of range", ino, e->inode);
+        } else if (e->inode) {
+            __atomic_fetch_add(&c->refs[e->inode], 1, __ATOMIC_RELAXED);
+        }
+        off += e->rec_len;
+    }
+}
+
+/**
+ * Claim the blocks under an indirect block, `level` levels deep. Each level
+ * uses its own slice of the scratch buffer.
+ */
+static void walk_indirect(check_ctx *c, check_group *g, uint32_t ino, int is_dir, uint32_t block, int level, uint8_t *scratch) {
+    if (!claim_block(c, g, ino, block)) return;
+
+    uint32_t *ptrs = (uint32_t *)(scratch + (size_t)level * c->block_size);
+    if (image_pread(c->src, ptrs, c->block_size, (uint64_t)block * c->block_size) != c->block_size) {
+        check_error(g, "Inode %u: cannot read indirect block %u", ino, block);
+        return;
+    }
+    for (uint32_t i = 0; i < c->block_size / 4; i++) {
+        if (!ptrs[i]) continue;
+        if (level > 1) {
+            walk_indirect(c, g, ino, is_dir, ptrs[i], level - 1, scratch);
+        } else if (claim_block(c, g, ino, ptrs[i]) && is_dir) {
+            check_dir_block(c, g, ino, ptrs[i], scratch);
+        }
+    }
+}
+
+/**
+ * Check one block group: read its bitmaps and inode table, compare the free
+ * counters of the descriptor and walk every inode in use.
+ */
+static void check_one_group(check_ctx *c, check_group *g, uint32_t gi, uint8_t *scratch) {
+    const ext2_group_desc *gd = &c->gds[gi];
+    uint64_t first = c->sb.s_first_data_block + (uint64_t)gi * c->sb.s_blocks_per_group;
+    uint64_t nblocks = c->sb.s_blocks_count - first;
+    if (nblocks > c->sb.s_blocks_per_group) nblocks = c->sb.s_blocks_per_group;
+    uint32_t ipg = c->sb.s_inodes_per_group;
+    size_t table_bytes = (size_t)ipg * c->inode_size;
+
+    // Bitmaps y tabla de inodos: una sola lectura si están seguidos en disco
+    size_t bs = c->block_size;
+    uint8_t *area = malloc(2 * bs + table_bytes);
+    uint8_t *block_bm = area, *inode_bm = area + bs, *table = area + 2 * bs;
+    int ok = area != NULL;
+    if (ok && gd->bg_inode_bitmap == gd->bg_block_bitmap + 1 && gd->bg_inode_table == gd->bg_inode_bitmap + 1) {
+        ok = image_pread(c->src, area, 2 * bs + table_bytes, (uint64_t)gd->bg_block_bitmap * bs) == (int64_t)(2 * bs + table_bytes);
+    } else if (ok) {
+        ok = image_pread(c->src, block_bm, bs, (uint64_t)gd->bg_block_bitmap * bs) == (int64_t)bs &&
+             image_pread(c->src, inode_bm, bs, (uint64_t)gd->bg_inode_bitmap * bs) == (int64_t)bs &&
+             image_pread(c->src, table, table_bytes, (uint64_t)gd->bg_inode_table * bs) == (int64_t)table_bytes;
+    }
+    if (!ok) {
+        free(area);
+        check_error(g, "Group %u: cannot read bitmaps or inode table", gi);
+        return;
+    }
+
+    // Contadores del descriptor frente a los bitmaps
+    memcpy(c->bitmap + (first - c->sb.s_first_data_block) / 8, block_bm, (nblocks + 7) / 8);
+    g->free_blocks = nblocks - bitmap_popcount(block_bm, nblocks);
+    g->free_inodes = ipg - bitmap_popcount(inode_bm, ipg);
+    if (g->free_blocks != gd->bg_free_blocks_count) {
+        check_error(g, "Group %u: free blocks count is %u, bitmap says %llu", gi,
+                    gd->bg_free_blocks_count, (unsigned long long)g->free_blocks);
+    }
+    if (g->free_inodes != gd->bg_free_inodes_count) {
+        check_error(g, "Group %u: free inodes count is %u, bitmap says %llu", gi,
+                    gd->bg_free_inodes_count, (unsigned long long)g->free_inodes);
+    }
+
+    uint32_t dirs = 0;
+    for (uint32_t i = 0; i < ipg; i++) {
+        uint32_t ino = gi * ipg + i + 1;
+        if (!test_bit(inode_bm, i) || ino > c->sb.s_inodes_count) continue;
+        c->in_use[ino] = TRUE;
+
+        ext2_inode inode;
+        memcpy(&inode, table + (size_t)i * c->inode_size, sizeof(inode));
+        if (S_ISDIR(inode.i_mode)) dirs++;
+        if (ino != EXT2_ROOT_INO && ino < c->sb.s_first_ino) continue;     // Reservados
+        c->links[ino] = inode.i_links_count;
+        if (inode.i_mode == 0) {
+            check_error(g, "Inode %u: in use but has no mode", ino);
+            continue;
+        }
+
+        int is_dir = S_ISDIR(inode.i_mode);
+        if (!is_dir && !S_ISREG(inode.i_mode) && !S_ISLNK(inode.i_mode)) continue;
+        if (S_ISLNK(inode.i_mode) && inode.i_blocks == 0) continue;        // Enlace rápido
+
+        for (int b = 0; b < EXT2_NDIR_BLOCKS; b++) {
+            if (inode.i_block[b] && claim_block(c, g, ino, inode.i_block[b]) && is_dir) {
+                check_dir_block(c, g, ino, inode.i_block[b], scratch);
+            }
+        }
+        for (int level = 1; level <= 3; level++) {
+            uint32_t ind = inode.i_block[EXT2_IND_BLOCK + level - 1];
+            if (ind) walk_indirect(c, g, ino, is_dir, ind, level, scratch);
+        }
+    }
+    if (dirs != gd->bg_used_dirs_count) {
+        check_error(g, "Group %u: directory count is %u, inode table has %u", gi, gd->bg_used_dirs_count, dirs);
+    }
+    free(area);
+}
+
+typedef struct {
+    check_ctx *ctx;
+    check_group *results;
+} check_worker;
+
+/**
+ * Worker thread: take groups until there are none left.
+ */
+static void *check_worker_main(void *arg) {
+    check_worker *w = arg;
+    check_ctx *c = w->ctx;
+    uint8_t *scratch = malloc(4 * (size_t)c->block_size);
+    if (!scratch) return NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        uint32_t gi = c->next_group++;
+        pthread_mutex_unlock(&c->lock);
+        if (gi >= c->groups) break;
+
+        check_group *g = &w->results[gi];
+        g->out = open_memstream(&g->report, &g->report_len);
+        if (!g->out) continue;
+        check_one_group(c, g, gi, scratch);
+        fclose(g->out);
+    }
+    free(scratch);
+    return NULL;
+}
+
+/**
+ * Read-only consistency check ("--check"). Every block group is handled by a
+ * worker that reads its bitmaps and inode table in one sweep and walks the
+ * blocks of its inodes; the cross-group checks (superblock totals, blocks
+ * in use but free in the bitmap, link counts) run once all groups are done.
+ *
+ * @param filename Ruta al archivo de imagen EXT2.
+ * @return Number of errors, or -1 if the image could not be checked.
+ */
+long check_ext2(const char *filename) {
+    check_ctx c;
+    memset(&c, 0, sizeof(c));
+    if (!read_ext2_superblock(filename, &c.sb) || c.sb.s_magic != EXT2_SUPER_MAGIC) return -1;
+    if (!load_superblock_ext2(filename)) return -1;
+    if (c.sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_EXTENTS) {
+        printf("--check does not support ext4 extent-mapped images\n");
+        return -1;
+    }
+
+    c.block_size = 1024 << c.sb.s_log_block_size;
+    c.inode_size = c.sb.s_rev_level == 0 ? 128 : c.sb.s_inode_size;
+    // Cada grupo copia su bitmap de bloques a c.bitmap en bytes enteros y los
+    // dos bitmaps ocupan un bloque: la geometría tiene que caber en ellos
+    if (c.inode_size < sizeof(ext2_inode) || c.sb.s_blocks_per_group == 0 || c.sb.s_inodes_per_group == 0 ||
+        c.sb.s_blocks_per_group > 8 * c.block_size || c.sb.s_blocks_per_group % 8 != 0 ||
+        c.sb.s_inodes_per_group > 8 * c.block_size) return -1;
+    c.groups = (c.sb.s_blocks_count - c.sb.s_first_data_block + c.sb.s_blocks_per_group - 1) / c.sb.s_blocks_per_group;
+
+    FILE *fp = image_open(filename);
+    if (!fp) { perror("fopen"); return -1; }
+    c.gds = malloc((size_t)c.groups * sizeof(ext2_group_desc));
+    for (uint32_t g = 0; c.gds && g < c.groups; g++) {
+        if (read_group_desc_ext2(fp, g, &c.gds[g]) != 0) c.groups = g;
+    }
+    fclose(fp);
+
+    size_t bm_bytes = ((uint64_t)c.groups * c.sb.s_blocks_per_group + 7) / 8;
+    c.src = image_source_get(filename);
+    c.bitmap = calloc(bm_bytes, 1);
+    c.claimed = calloc(bm_bytes, 1);
+    c.refs = calloc((size_t)c.sb.s_inodes_count + 1, sizeof(uint32_t));
+    c.links = calloc((size_t)c.sb.s_inodes_count + 1, sizeof(uint16_t));
+    c.in_use = calloc((size_t)c.sb.s_inodes_count + 1, 1);
+    check_group *results = calloc(c.groups ? c.groups : 1, sizeof(check_group));
+    long errors = -1;
+    if (!c.src || !c.gds || !c.bitmap || !c.claimed || !c.refs || !c.links || !c.in_use || !results) goto out;
+
+    pthread_mutex_init(&c.lock, NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nworkers = cpus < 1 ? 1 : cpus > CHECK_MAX_WORKERS ? CHECK_MAX_WORKERS : (size_t)cpus;
+    if (nworkers > c.groups) nworkers = c.groups ? c.groups : 1;
+    pthread_t threads[CHECK_MAX_WORKERS];
+    check_worker worker = { &c, results };
+    size_t started = 0;
+    while (nworkers > 1 && started < nworkers &&
+           pthread_create(&threads[started], NULL, check_worker_main, &worker) == 0) started++;
+    for (size_t i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    // Sin hilos (o si no se pudo crear ninguno) este mismo revisa los grupos que queden
+    check_worker_main(&worker);
+    pthread_mutex_destroy(&c.lock);
+
+    printf("\n------ Filesystem Check ------\n\n");
+    errors = 0;
+    uint64_t free_blocks = 0, free_inodes = 0;
+    for (uint32_t g = 0; g < c.groups; g++) {
+        if (results[g].report) fwrite(results[g].report, 1, results[g].report_len, stdout);
+        errors += results[g].errors;
+        free_blocks += results[g].free_blocks;
+        free_inodes += results[g].free_inodes;
+    }
+
+    // Comprobaciones globales: las hace un solo hilo sobre los resultados
+    check_group global;
+    memset(&global, 0, sizeof(global));
+    global.out = stdout;
+    if (free_blocks != c.sb.s_free_blocks_count) {
+        check_error(&global, "Superblock: free blocks count is %u, bitmaps say %llu",
+                    c.sb.s_free_blocks_count, (unsigned long long)free_blocks);
+    }
+    if (free_inodes != c.sb.s_free_inodes_count) {
+        check_error(&global, "Superblock: free inodes count is %u, bitmaps say %llu",
+                    c.sb.s_free_inodes_count, (unsigned long long)free_inodes);
+    }
+    uint64_t nbits = c.sb.s_blocks_count - c.sb.s_first_data_block;
+    for (uint64_t byte = 0; byte < (nbits + 7) / 8; byte++) {
+        for (unsigned bad = c.claimed[byte] & ~c.bitmap[byte]; bad; bad &= bad - 1) {
+            check_error(&global, "Block %llu: in use but free in the bitmap",
+                        (unsigned long long)(byte * 8 + __builtin_ctz(bad) + c.sb.s_first_data_block));
+        }
+    }
+    for (uint32_t ino = 1; ino <= c.sb.s_inodes_count; ino++) {
+        if (!c.in_use[ino]) {
+            if (c.refs[ino]) check_error(&global, "Inode %u: referenced %u times but free in the bitmap", ino, c.refs[ino]);
+        } else if ((ino == EXT2_ROOT_INO || ino >= c.sb.s_first_ino) && c.links[ino] != c.refs[ino]) {
+            check_error(&global, "Inode %u: link count is %u, found %u references", ino, c.links[ino], c.refs[ino]);
+        }
+    }
+    errors += global.errors;
+
+    printf("\n  Groups checked...: %u\n", c.groups);
+    printf("  Errors...........: %ld\n", errors);
+    printf("  Result...........: %s\n", errors ? "NOT CLEAN" : "clean");
+
+out:
+    for (uint32_t g = 0; results && g < c.groups; g++) free(results[g].report);
+    free(results);
+    free(c.in_use);
+    free(c.links);
+    free(c.refs);
+    free(c.claimed);
+    free(c.bitmap);
+    free(c.gds);
+    image_source_put(c.src);
+    return errors;
+}
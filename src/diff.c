@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/diff.h"
+
+/*
+ * Entrada de directorio de cualquiera de los dos sistemas, con los
+ * metadatos que se comparan antes de tocar los datos.
+ */
+typedef struct {
+    char *name;
+    int is_dir;
+    uint32_t id;                // Inodo (ext2) o primer clúster (FAT16)
+    uint64_t size;
+    uint32_t mtime;             // i_mtime, o fecha y hora de escritura en FAT16
+    uint32_t block[15];         // Punteros a bloques (solo ext2)
+} diff_entry;
+
+typedef struct {
+    diff_entry *items;
+    uint32_t count;
+    uint32_t cap;
+} diff_list;
+
+typedef struct {
+    fs_image a, b;
+    uint8_t *buf_a, *buf_b;
+    uint64_t added, deleted, modified, compared;
+} diff_ctx;
+
+static void diff_dir(diff_ctx *c, const char *path, const diff_entry *da, const diff_entry *db, const fs_walk *parent);
+
+/**
+ * Append an entry to a list; the name is copied.
+ */
+static diff_entry *list_add(diff_list *l, const char *name) {
+    if (l->count == l->cap) {
+        uint32_t cap = l->cap ? l->cap * 2 : 32;
+        diff_entry *tmp = realloc(l->items, cap * sizeof(diff_entry));
+        if (!tmp) return NULL;
+        l->items = tmp;
+        l->cap = cap;
+    }
+    diff_entry *e = &l->items[l->count];
+    memset(e, 0, sizeof(*e));
+    e->name = strdup(name);
+    if (!e->name) return NULL;
+    l->count++;
+    return e;
+}
+
+static void list_free(diff_list *l) {
+    for (uint32_t i = 0; i < l->count; i++) free(l->items[i].name);
+    free(l->items);
+    memset(l, 0, sizeof(*l));
+}
+
+static int cmp_entry(const void *x, const void *y) {
+    return strcmp(((const diff_entry *)x)->name, ((const diff_entry *)y)->name);
+}
+
+/**
+ * Fill the metadata of an ext2 entry from its inode.
+ */
+static int fill_ext2(FILE *fp, uint32_t ino, diff_entry *e) {
+    ext2_inode inode;
+    if (read_inode_ext2(fp, ino, &inode) != 0) return -1;
+    e->is_dir = S_ISDIR(inode.i_mode);
+    e->id = ino;
+    e->size = ext2_file_size(&inode);
+    e->mtime = inode.i_mtime;
+    memcpy(e->block, inode.i_block, sizeof(e->block));
+    return 0;
+}
+
+static void fill_fat16(const fat16_dir_entry *fe, diff_entry *e) {
+    e->is_dir = (fe->attributes & ATTR_DIRECTORY) != 0;
+    e->id = first_cluster_fat16(fe);
+    e->size = fe->file_size;
+    e->mtime = (uint32_t)fe->last_write_date << 16 | fe->last_write_time;
+}
+
+/**
+ * list_dir_fat16 callback: append the entry to a diff_list.
+ */
+static int add_fat16_entry(const fat16_dir_entry *fe, const char *name, void *ctx) {
+    diff_entry *e = list_add(ctx, name);
+    if (!e) return 1;
+    fill_fat16(fe, e);
+    return 0;
+}
+
+/**
+ * List the entries of a directory (without "." and "..") in on-disk order.
+ */
+static void list_dir(fs_image *img, const diff_entry *dir, diff_list *out) {
+    if (!img->is_ext2) {
+        list_dir_fat16(img->fp, &img->bs, dir->id, add_fat16_entry, out);
+        return;
+    }
+
+    const ext2_dir_view *v = ext2_dir_view_get(img->fp, dir->id);
+    if (!v) return;
+    for (uint32_t i = 0; i < v->count; i++) {
+        const char *name = v->names + v->name_off[i];
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        diff_entry *e = list_add(out, name);
+        if (!e) break;
+        if (fill_ext2(img->fp, v->inodes[i], e) != 0) e->id = 0;
+    }
+    ext2_dir_view_put(v);
+}
+
+/**
+ * Compare the contents of two files of the same size, stopping at the
+ * first difference.
+ *
+ * @return TRUE if they are identical.
+ */
+static int same_content(diff_ctx *c, const diff_entry *fa, const diff_entry *fb) {
+    fs_file a = { NULL, fa->size, 0, fa->id };
+    fs_file b = { NULL, fb->size, 0, fb->id };
+    c->compared++;
+
+    for (uint64_t pos = 0; pos < fa->size; ) {
+        size_t want = fa->size - pos < DIFF_CHUNK_SIZE ? fa->size - pos : DIFF_CHUNK_SIZE;
+        int64_t na = fs_read(&c->a, &a, pos, c->buf_a, want);
+        int64_t nb = fs_read(&c->b, &b, pos, c->buf_b, want);
+        if (na <= 0 || na != nb || memcmp(c->buf_a, c->buf_b, na) != 0) return FALSE;
+        pos += na;
+    }
+    return TRUE;
+}
+
+/**
+ * Compare two files: metadata first, contents only when the size matches but
+ * the rest of the metadata does not.
+ */
+static void diff_file(diff_ctx *c, const char *path, const diff_entry *fa, const diff_entry *fb) {
+    int same_meta = fa->size == fb->size && fa->mtime == fb->mtime && fa->id == fb->id &&
+                    memcmp(fa->block, fb->block, sizeof(fa->block)) == 0;
+    if (same_meta) return;
+    if (fa->size == fb->size && same_content(c, fa, fb)) return;
+    printf("M  %s\n", path);
+    c->modified++;
+}
+
+/**
+ * Compare an entry present in both images.
+ */
+static void diff_pair(diff_ctx *c, const char *dir, const diff_entry *ea, const diff_entry *eb, const fs_walk *walk) {
+    char *path = path_join(dir, ea->name);
+    if (!path) return;
+
+    if (ea->is_dir != eb->is_dir) {
+        printf("T  %s\n", path);
+        c->modified++;
+    } else if (ea->is_dir) {
+        diff_dir(c, path, ea, eb, walk);
+    } else {
+        diff_file(c, path, ea, eb);
+    }
+    free(path);
+}
+
+/**
+ * Report an entry present in only one of the images.
+ */
+static void diff_single(const char *dir, const diff_entry *e, char tag, uint64_t *counter) {
+    char *path = path_join(dir, e->name);
+    printf("%c  %s%s\n", tag, path ? path : e->name, e->is_dir ? "/" : "");
+    free(path);
+    (*counter)++;
+}
+
+/**
+ * Walk two versions of a directory in lockstep: both listings are sorted by
+ * name and merged with two cursors. The walk is keyed by the directory of
+ * the first image.
+ */
+static void diff_dir(diff_ctx *c, const char *path, const diff_entry *da, const diff_entry *db, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, da->id)) return;
+
+    diff_list la, lb;
+    memset(&la, 0, sizeof(la));
+    memset(&lb, 0, sizeof(lb));
+    list_dir(&c->a, da, &la);
+    list_dir(&c->b, db, &lb);
+    if (la.count > 1) qsort(la.items, la.count, sizeof(diff_entry), cmp_entry);
+    if (lb.count > 1) qsort(lb.items, lb.count, sizeof(diff_entry), cmp_entry);
+
+    uint32_t i = 0, j = 0;
+    while (i < la.count || j < lb.count) {
+        int cmp = i == la.count ? 1 : j == lb.count ? -1 : strcmp(la.items[i].name, lb.items[j].name);
+        if (cmp < 0) diff_single(path, &la.items[i++], 'D', &c->deleted);
+        else if (cmp > 0) diff_single(path, &lb.items[j++], 'A', &c->added);
+        else diff_pair(c, path, &la.items[i++], &lb.items[j++], &node);
+    }
+
+    list_free(&la);
+    list_free(&lb);
+}
+
+/**
+ * Diff two images of the same volume ("--diff"). Both trees are walked in
+ * lockstep by path; files are compared by size, mtime and block pointers
+ * and their contents are only read when those disagree but the size does
+ * not.
+ *
+ * @param file_a Path to the older image.
+ * @param file_b Path to the newer image.
+ */
+void diff_images(const char *file_a, const char *file_b) {
+    diff_ctx c;
+    memset(&c, 0, sizeof(c));
+
+    if (fs_open(&c.a, file_a) != 0 || fs_open(&c.b, file_b) != 0) {
+        printf("Error opening the file\n");
+        fs_close(&c.a);
+        fs_close(&c.b);
+        return;
+    }
+
+    // Ambas imágenes comparten los globales del lector ext2: deben tener la misma geometría
+    int same_volume = c.a.is_ext2 == c.b.is_ext2;
+    if (same_volume && c.a.is_ext2) {
+        ext2_superblock sa, sbb;
+        same_volume = read_ext2_superblock(file_a, &sa) && read_ext2_superblock(file_b, &sbb) &&
+                      sa.s_log_block_size == sbb.s_log_block_size && sa.s_blocks_count == sbb.s_blocks_count &&
+                      sa.s_inodes_per_group == sbb.s_inodes_per_group && sa.s_inode_size == sbb.s_inode_size &&
+                      sa.s_first_data_block == sbb.s_first_data_block;
+    } else if (same_volume) {
+        same_volume = memcmp(&c.a.bs, &c.b.bs, sizeof(c.a.bs)) == 0;
+    }
+    if (!same_volume) {
+        printf("The images are not of the same volume\n");
+        fs_close(&c.a);
+        fs_close(&c.b);
+        return;
+    }
+
+    c.buf_a = malloc(DIFF_CHUNK_SIZE);
+    c.buf_b = malloc(DIFF_CHUNK_SIZE);
+    if (c.buf_a && c.buf_b) {
+        diff_entry root;
+        memset(&root, 0, sizeof(root));
+        root.is_dir = TRUE;
+        root.id = c.a.is_ext2 ? EXT2_ROOT_INO : 0;
+        fs_walk top;
+        fs_walk_begin(&top);
+        diff_dir(&c, "", &root, &root, &top);
+        fs_walk_end(&top);
+
+        printf("\n%llu added, %llu deleted, %llu modified (%llu files compared by content)\n",
+               (unsigned long long)c.added, (unsigned long long)c.deleted,
+               (unsigned long long)c.modified, (unsigned long long)c.compared);
+    }
+
+    free(c.buf_a);
+    free(c.buf_b);
+    fs_close(&c.a);
+    fs_close(&c.b);
+}
@@ -0,0 +1,287 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/du.h"
+#include "../include/image.h"
+
+/*
+ * Directorio del árbol de uso. Los ficheros solo suman a su directorio; los
+ * totales del subárbol se calculan de abajo arriba al final.
+ */
+typedef struct du_node {
+    char *path;
+    uint32_t id;                    // Inodo (ext2) o primer clúster (FAT16)
+    struct du_node *parent;
+    fs_walk walk;
+    uint64_t own_alloc, own_size;   // El directorio y sus ficheros
+    uint64_t alloc, size;           // Todo el subárbol
+    struct du_node *children;       // Subdirectorios
+    uint32_t nchildren, cap;
+} du_node;
+
+typedef struct {
+    const char *filename;
+    int is_ext2;
+    fat16_boot_sector bs;
+    uint8_t *seen;                  // Inodos con varios enlaces ya contados (ext2)
+    fs_walk top;                    // Recorrido compartido por todos los hilos
+    du_node **tasks;                // Subárboles que reparten los hilos
+    size_t ntasks;
+    size_t next;
+    pthread_mutex_t lock;
+} du_ctx;
+
+/*
+ * Directorio que se está leyendo y lector del hilo que lo lee.
+ */
+typedef struct {
+    du_ctx *ctx;
+    FILE *fp;
+    du_node *node;
+} du_scan;
+
+static du_node *add_child(du_node *n, const char *name, uint32_t id) {
+    if (n->nchildren == n->cap) {
+        uint32_t cap = n->cap ? n->cap * 2 : 8;
+        du_node *tmp = realloc(n->children, cap * sizeof(du_node));
+        if (!tmp) return NULL;
+        n->children = tmp;
+        n->cap = cap;
+    }
+    du_node *c = &n->children[n->nchildren];
+    memset(c, 0, sizeof(*c));
+    if (!(c->path = path_join(n->path, name))) return NULL;
+    c->id = id;
+    c->parent = n;
+    n->nchildren++;
+    return c;
+}
+
+/**
+ * Queue a subtree for the workers.
+ */
+static int push_task(du_ctx *c, size_t *cap, du_node *n) {
+    if (c->ntasks == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 64;
+        du_node **tmp = realloc(c->tasks, ncap * sizeof(du_node *));
+        if (!tmp) return -1;
+        c->tasks = tmp;
+        *cap = ncap;
+    }
+    c->tasks[c->ntasks++] = n;
+    return 0;
+}
+
+/**
+ * Add the entries of one ext2 directory to its node: files by i_blocks and
+ * i_size, subdirectories as new nodes. Files with several links are only
+ * counted the first time one of them is seen.
+ */
+static void scan_ext2(du_scan *s) {
+    du_node *n = s->node;
+    ext2_inode inode;
+    if (read_inode_ext2(s->fp, n->id, &inode) == 0) {
+        n->own_alloc += (uint64_t)inode.i_blocks * 512;
+        n->own_size += inode.i_size;
+    }
+
+    const ext2_dir_view *v = ext2_dir_view_get(s->fp, n->id);
+    if (!v) return;
+    for (uint32_t i = 0; i < v->count; i++) {
+        const char *name = v->names + v->name_off[i];
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        uint32_t ino = v->inodes[i];
+        if (read_inode_ext2(s->fp, ino, &inode) != 0) continue;
+
+        if (S_ISDIR(inode.i_mode)) {
+            if (!add_child(n, name, ino)) break;
+            continue;
+        }
+        if (inode.i_links_count > 1) {
+            uint8_t bit = 1u << (ino % 8);
+            if (__atomic_fetch_or(&s->ctx->seen[ino / 8], bit, __ATOMIC_RELAXED) & bit) continue;
+        }
+        n->own_alloc += (uint64_t)inode.i_blocks * 512;
+        n->own_size += ext2_file_size(&inode);
+    }
+    ext2_dir_view_put(v);
+}
+
+/**
+ * list_dir_fat16 callback: files by the length of their cluster chain,
+ * subdirectories as new nodes.
+ */
+static int du_fat16_entry(const fat16_dir_entry *e, const char *name, void *arg) {
+    du_scan *s = arg;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+    if (e->attributes & ATTR_DIRECTORY) return add_child(s->node, name, first_cluster_fat16(e)) ? 0 : 1;
+
+    uint32_t cluster_bytes = (uint32_t)s->ctx->bs.sectors_per_cluster * s->ctx->bs.bytes_per_sector;
+    s->node->own_alloc += (uint64_t)chain_length_fat16(s->fp, &s->ctx->bs, first_cluster_fat16(e)) * cluster_bytes;
+    s->node->own_size += e->file_size;
+    return 0;
+}
+
+static void scan_fat16(du_scan *s) {
+    du_node *n = s->node;
+    const fat16_boot_sector *bs = &s->ctx->bs;
+    // La raíz de FAT12/16 es una región fija; la de FAT32 es una cadena más
+    uint32_t first = n->id ? n->id : bs->root_dir_entries ? 0 : bs->root_cluster;
+    uint64_t dir_bytes = first ? (uint64_t)chain_length_fat16(s->fp, bs, first) * bs->sectors_per_cluster * bs->bytes_per_sector
+                               : (uint64_t)bs->root_dir_entries * sizeof(fat16_dir_entry);
+    n->own_alloc += dir_bytes;
+    n->own_size += dir_bytes;
+    list_dir_fat16(s->fp, bs, n->id, du_fat16_entry, s);
+}
+
+/**
+ * Read one directory (not its subdirectories) into its node.
+ */
+static void scan_dir(du_ctx *c, FILE *fp, du_node *n) {
+    if (!fs_walk_enter(&n->walk, n->parent ? &n->parent->walk : &c->top, n->id)) return;
+    du_scan s = { c, fp, n };
+    if (c->is_ext2) scan_ext2(&s);
+    else scan_fat16(&s);
+}
+
+static void scan_tree(du_ctx *c, FILE *fp, du_node *n) {
+    scan_dir(c, fp, n);
+    for (uint32_t i = 0; i < n->nchildren; i++) scan_tree(c, fp, &n->children[i]);
+}
+
+/**
+ * Worker: take subtrees until none are left. Each thread has its own reader
+ * state and its own FILE on the image.
+ */
+static void *du_worker(void *arg) {
+    du_ctx *c = arg;
+    if (c->is_ext2 && !load_superblock_ext2(c->filename)) return NULL;
+    FILE *fp = image_open(c->filename);
+    if (!fp) return NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        size_t i = c->next++;
+        pthread_mutex_unlock(&c->lock);
+        if (i >= c->ntasks) break;
+        scan_tree(c, fp, c->tasks[i]);
+    }
+
+    fclose(fp);
+    if (c->is_ext2) ext2_cache_clear();
+    else fat16_cache_clear();
+    return NULL;
+}
+
+/**
+ * Add up the subtree totals bottom-up and print one line per directory,
+ * children first.
+ */
+static void du_print(du_node *n) {
+    n->alloc = n->own_alloc;
+    n->size = n->own_size;
+    for (uint32_t i = 0; i < n->nchildren; i++) {
+        du_print(&n->children[i]);
+        n->alloc += n->children[i].alloc;
+        n->size += n->children[i].size;
+    }
+    printf("%llu\t%llu\t%s\n", (unsigned long long)(n->alloc + 1023) / 1024,
+           (unsigned long long)n->size, n->path[0] ? n->path : ".");
+}
+
+static void du_free(du_node *n) {
+    for (uint32_t i = 0; i < n->nchildren; i++) du_free(&n->children[i]);
+    free(n->children);
+    free(n->path);
+}
+
+/**
+ * Disk usage of every directory under a path ("--du"). The first levels of
+ * the tree are read until there are enough independent subtrees, which are
+ * then read in parallel; the totals are added up bottom-up at the end.
+ *
+ * @param filename Path to the image file.
+ * @param path     Directory to start from ("" for the root).
+ */
+void du_image(const char *filename, const char *path) {
+    fs_image img;
+    if (fs_open(&img, filename) != 0) {
+        printf("Error opening the file\n");
+        return;
+    }
+
+    du_ctx c;
+    memset(&c, 0, sizeof(c));
+    c.filename = filename;
+    c.is_ext2 = img.is_ext2;
+    c.bs = img.bs;
+
+    du_node root;
+    memset(&root, 0, sizeof(root));
+    while (*path == '/') path++;
+    root.path = strdup(path);
+    for (size_t n = root.path ? strlen(root.path) : 0; n > 0 && root.path[n - 1] == '/'; n--) root.path[n - 1] = '\0';
+
+    int found;
+    if (img.is_ext2) {
+        ext2_inode inode;
+        ext2_superblock s;
+        root.id = lookup_path_ext2(img.fp, path, TRUE);
+        found = root.id && read_inode_ext2(img.fp, root.id, &inode) == 0 && S_ISDIR(inode.i_mode) &&
+                read_ext2_superblock(filename, &s);
+        c.seen = found ? calloc(s.s_inodes_count / 8 + 1, 1) : NULL;
+    } else {
+        fat16_dir_entry e;
+        memset(&e, 0, sizeof(e));
+        found = !*path || (find_path_fat16(img.fp, &img.bs, path, &e) && (e.attributes & ATTR_DIRECTORY));
+        root.id = *path ? first_cluster_fat16(&e) : 0;
+    }
+    if (!found || !root.path || (img.is_ext2 && !c.seen)) {
+        printf("Directory '%s' not found\n", path);
+        free(root.path);
+        free(c.seen);
+        fs_close(&img);
+        return;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    fs_walk_begin(&c.top);
+    size_t nworkers = cpus < 1 ? 1 : cpus > DU_MAX_WORKERS ? DU_MAX_WORKERS : (size_t)cpus;
+
+    // Bajamos niveles hasta tener subárboles suficientes para repartir
+    scan_dir(&c, img.fp, &root);
+    size_t cap = 0;
+    for (uint32_t i = 0; i < root.nchildren; i++) push_task(&c, &cap, &root.children[i]);
+    while (nworkers > 1 && c.ntasks > 0 && c.ntasks < nworkers * DU_TASKS_PER_WORKER) {
+        du_node **level = c.tasks;
+        size_t nlevel = c.ntasks;
+        c.tasks = NULL;
+        c.ntasks = cap = 0;
+        for (size_t i = 0; i < nlevel; i++) {
+            scan_dir(&c, img.fp, level[i]);
+            for (uint32_t j = 0; j < level[i]->nchildren; j++) push_task(&c, &cap, &level[i]->children[j]);
+        }
+        free(level);
+    }
+
+    if (nworkers > c.ntasks) nworkers = c.ntasks;
+    pthread_t threads[DU_MAX_WORKERS];
+    size_t started = 0;
+    pthread_mutex_init(&c.lock, NULL);
+    while (nworkers > 1 && started < nworkers && pthread_create(&threads[started], NULL, du_worker, &c) == 0) started++;
+    for (size_t i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&c.lock);
+    // Sin hilos (o si no se pudo crear ninguno) lo hace este mismo
+    for (; c.next < c.ntasks; c.next++) scan_tree(&c, img.fp, c.tasks[c.next]);
+
+    du_print(&root);
+
+    du_free(&root);
+    fs_walk_end(&c.top);
+    free(c.tasks);
+    free(c.seen);
+    fs_close(&img);
+}
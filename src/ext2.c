@@ -1,27 +1,84 @@
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include "ext2.h"
+#include "../include/image.h"
+#include "../include/sort.h"
 
-// Global variables for superblock and block size
-ext2_superblock sb;
-uint32_t block_size;
+// Superblock and block size of the image being read, one per thread
+_Thread_local ext2_superblock sb;
+_Thread_local uint32_t block_size;
 
-static int file_found_flag   = FALSE;
-static uint32_t file_found_inode  = 0;
+/*
+ * Cachés persistentes, de correspondencia directa: inodos por número y
+ * bloques de punteros (indirectos) por número de bloque. Cada ranura recuerda
+ * de qué imagen viene, para poder tener dos abiertas a la vez (--diff). Como
+ * el superbloque, son de cada hilo: varios hilos pueden leer imágenes
+ * distintas a la vez (--info/--tree con varias imágenes).
+ */
+typedef struct {
+    FILE *fp;
+    uint32_t ino;
+    ext2_inode inode;
+} ext2_inode_cache_slot;
+
+typedef struct {
+    FILE *fp;
+    uint32_t block;
+    uint32_t *data;
+} ext2_block_cache_slot;
+
+static _Thread_local ext2_inode_cache_slot inode_cache[EXT2_INODE_CACHE_SLOTS];
+static _Thread_local ext2_block_cache_slot block_cache[EXT2_BLOCK_CACHE_SLOTS];
+
+/*
+ * Caché de dentries: (directorio padre, nombre) -> inodo, compartida por todas
+ * las búsquedas de rutas del hilo. También guarda los nombres que no
+ * existen (ino = 0), para no volver a recorrer el directorio por ellos.
+ */
+typedef struct {
+    FILE *fp;
+    uint32_t parent;
+    uint32_t ino;                   // 0 = el nombre no existe
+    uint8_t type;                   // file_type de la entrada
+    uint8_t name_len;
+    char name[EXT2_NAME_LEN];
+} ext2_dentry_cache_slot;
+
+static _Thread_local ext2_dentry_cache_slot dentry_cache[EXT2_DENTRY_CACHE_SLOTS];
+
+// TRUE si el superbloque anuncia FILETYPE y podemos fiarnos de file_type
+static _Thread_local int trust_file_type = FALSE;
+
+/*
+ * Parsers de bloques de punteros y de directorio. Hay una versión compilada
+ * para cada tamaño de bloque habitual (1, 2 y 4 KiB) y una genérica; se
+ * elige una al cargar el superbloque.
+ */
+typedef int (*ext2_indirect_fn)(FILE *fp, uint32_t block, int level, uint64_t *left, ext2_block_cb cb, void *ctx);
+typedef int (*ext2_dir_block_fn)(ext2_dir_view *v, const uint8_t *buf);
+
+typedef struct {
+    ext2_indirect_fn iterate_indirect;
+    ext2_dir_block_fn decode_dir_block;
+} ext2_block_parsers;
+
+static _Thread_local ext2_block_parsers parsers;
+
+static _Thread_local int file_found_flag   = FALSE;
+static _Thread_local uint32_t file_found_inode  = 0;
+static _Thread_local uint32_t file_found_dir    = 0;
 
 // Forward declarations
-static uint32_t scan_dir_block(FILE *fp, uint32_t block, const char *name);
-static uint32_t scan_indirect_blocks(FILE *fp, uint32_t block, int level, const char *name);
-static uint32_t find_inode_in_dir(FILE *fp, ext2_inode *inode, const char *name);
+static void select_block_parsers(void);
 static uint32_t find_inode_by_path(FILE *fp, const char *path);
-static void search_dir(FILE *fp, ext2_inode *inode, const char *target);
-static void search_dir_block(FILE *fp, uint32_t block, const char *target);
-static void search_indirect(FILE *fp, uint32_t block, int level, const char *target);
-static void read_dir(FILE *fp, ext2_inode *inode, int depth);
-static void tree_ext2_subdir(FILE *fp, ext2_inode *inode, const char *prefix);
+static uint32_t lookup_at_ext2(FILE *fp, uint32_t dir, const char *path, int follow);
+static void search_dir(FILE *fp, uint32_t ino, const char *target, const fs_walk *parent);
+static void tree_ext2_subdir(FILE *fp, uint32_t ino, const char *prefix, const fs_walk *parent);
+static void tree_ext2_sorted(FILE *fp, const char *prefix, const fs_walk *node);
 
 /**
  * Read the EXT2 superblock from the filesystem image.
@@ -31,11 +88,11 @@ static void tree_ext2_subdir(FILE *fp, ext2_inode *inode, const char *prefix);
  * @return TRUE (1) if the superblock was read successfully, FALSE (0) on error.
  */
 int read_ext2_superblock(const char *filename, ext2_superblock *sbo) {
-    FILE *fp = fopen(filename, "rb");
+    FILE *fp = image_open(filename);
     if (!fp) return FALSE;
-    if (fseek(fp, BASE_OFFSET, SEEK_SET) != 0) { fclose(fp); return FALSE; }
+    if (fseeko(fp, BASE_OFFSET, SEEK_SET) != 0) { fclose(fp); return FALSE; }
     if (fread(sbo, sizeof(ext2_superblock), 1, fp) != 1) {
-        printf(ERR_READ_SUPERBLOCK);
+        fprintf(fs_out(), ERR_READ_SUPERBLOCK);
         fclose(fp);
         return FALSE;
     }
@@ -43,6 +100,62 @@ int read_ext2_superblock(const char *filename, ext2_superblock *sbo) {
     return TRUE;
 }
 
+/**
+ * Drop the inode, pointer-block, dentry and directory caches of the calling
+ * thread.
+ */
+void ext2_cache_clear(void) {
+    for (int i = 0; i < EXT2_BLOCK_CACHE_SLOTS; i++) free(block_cache[i].data);
+    memset(block_cache, 0, sizeof(block_cache));
+    memset(inode_cache, 0, sizeof(inode_cache));
+    memset(dentry_cache, 0, sizeof(dentry_cache));
+    ext2_dir_cache_clear();
+}
+
+/**
+ * Sanity-check the geometry of a superblock before anything divides by it
+ * or multiplies with it. Each group's bitmaps are one block long, so a group
+ * cannot have more blocks or inodes than bits in a block.
+ */
+static int valid_superblock(const ext2_superblock *s) {
+    uint32_t inode_size = s->s_rev_level == 0 ? 128 : s->s_inode_size;
+    uint64_t bitmap_bits = (uint64_t)8192 << (s->s_log_block_size <= 6 ? s->s_log_block_size : 0);
+    return s->s_magic == EXT2_SUPER_MAGIC && s->s_log_block_size <= 6 &&
+           s->s_blocks_per_group > 0 && s->s_inodes_per_group > 0 &&
+           s->s_blocks_per_group <= bitmap_bits && s->s_blocks_per_group % 8 == 0 &&
+           s->s_inodes_per_group <= bitmap_bits &&
+           s->s_first_data_block < s->s_blocks_count &&
+           inode_size >= sizeof(ext2_inode) && (inode_size & (inode_size - 1)) == 0 &&
+           inode_size <= (1024u << s->s_log_block_size);
+}
+
+/**
+ * Whether a block number lies inside the volume.
+ */
+static int valid_block(uint32_t block) {
+    return block >= sb.s_first_data_block && block < sb.s_blocks_count;
+}
+
+/**
+ * Load the superblock of an image into the globals used by the walkers:
+ * block size, FILETYPE mode and empty caches.
+ *
+ * @param filename Path to the image file containing the EXT2 filesystem.
+ * @return TRUE (1) on success, FALSE (0) on error.
+ */
+int load_superblock_ext2(const char *filename) {
+    if (!read_ext2_superblock(filename, &sb)) return FALSE;
+    if (!valid_superblock(&sb)) {
+        fprintf(stderr, "EXT2: corrupt superblock\n");
+        return FALSE;
+    }
+    block_size = 1024 << sb.s_log_block_size;
+    trust_file_type = (sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) != 0;
+    select_block_parsers();
+    ext2_cache_clear();
+    return TRUE;
+}
+
 /**
 * Function that checks if the file is an ext2 filesystem
 * @param filename: the name of the file
@@ -62,31 +175,38 @@ void metadata_ext2(const char *filename) {
     ext2_superblock sb;
 
     if (!read_ext2_superblock(filename, &sb)) return;
+    if (!valid_superblock(&sb)) {
+        fprintf(stderr, "EXT2: corrupt superblock\n");
+        return;
+    }
 
-    printf("\n------ Filesystem Information ------\n");
-    printf("\nFilesystem: EXT2\n");
+    fprintf(fs_out(), "\n------ Filesystem Information ------\n");
+    fprintf(fs_out(), "\nFilesystem: EXT2\n");
 
-    printf("\nINODE INFO\n");
-    printf("  Size.............: %d\n", sb.s_inode_size);
-    printf("  Num Inodes.......: %d\n", sb.s_inodes_count);
-    printf("  First Inode......: %d\n", sb.s_first_ino);
-    printf("  Inodes per Group.: %d\n", sb.s_inodes_per_group);
-    printf("  Free Inodes......: %d\n", sb.s_free_inodes_count);
+    fprintf(fs_out(), "\nINODE INFO\n");
+    fprintf(fs_out(), "  Size.............: %d\n", sb.s_inode_size);
+    fprintf(fs_out(), "  Num Inodes.......: %d\n", sb.s_inodes_count);
+    fprintf(fs_out(), "  First Inode......: %d\n", sb.s_first_ino);
+    fprintf(fs_out(), "  Inodes per Group.: %d\n", sb.s_inodes_per_group);
+    fprintf(fs_out(), "  Free Inodes......: %d\n", sb.s_free_inodes_count);
 
-    printf("\nBLOCK INFO\n");
-    printf("  Block Size.......: %d\n", 1024 << sb.s_log_block_size);
-    printf("  Reserved Blocks..: %d\n", sb.s_r_blocks_count);
-    printf("  Free Blocks......: %d\n", sb.s_free_blocks_count);
-    printf("  Total Blocks.....: %d\n", sb.s_blocks_count);
-    printf("  First Block......: %d\n", sb.s_first_data_block);
-    printf("  Blocks per Group.: %d\n", sb.s_blocks_per_group);
-    printf("  Group Flags......: %d\n", sb.s_feature_compat);
+    fprintf(fs_out(), "\nBLOCK INFO\n");
+    fprintf(fs_out(), "  Block Size.......: %d\n", 1024 << sb.s_log_block_size);
+    fprintf(fs_out(), "  Reserved Blocks..: %d\n", sb.s_r_blocks_count);
+    fprintf(fs_out(), "  Free Blocks......: %d\n", sb.s_free_blocks_count);
+    fprintf(fs_out(), "  Total Blocks.....: %d\n", sb.s_blocks_count);
+    fprintf(fs_out(), "  First Block......: %d\n", sb.s_first_data_block);
+    fprintf(fs_out(), "  Blocks per Group.: %d\n", sb.s_blocks_per_group);
+    fprintf(fs_out(), "  Group Flags......: %d\n", sb.s_feature_compat);
+    fprintf(fs_out(), "  Entry Types......: %s\n",
+                      (sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE)
+               ? "yes (file_type trusted)" : "no (inode read per entry)");
 
-    printf("\nVOLUME INFO\n");
-    printf("  Volume Name......: %s\n", sb.s_volume_name);
-    printf("  Last Checked.....: %s\n", format_time(sb.s_lastcheck));
-    printf("  Last Mounted.....: %s\n", format_time(sb.s_mtime));
-    printf("  Last Written.....: %s\n\n", format_time(sb.s_wtime));
+    fprintf(fs_out(), "\nVOLUME INFO\n");
+    fprintf(fs_out(), "  Volume Name......: %s\n", sb.s_volume_name);
+    fprintf(fs_out(), "  Last Checked.....: %s\n", format_time(sb.s_lastcheck));
+    fprintf(fs_out(), "  Last Mounted.....: %s\n", format_time(sb.s_mtime));
+    fprintf(fs_out(), "  Last Written.....: %s\n\n", format_time(sb.s_wtime));
 }
 
 /**
@@ -97,16 +217,31 @@ void metadata_ext2(const char *filename) {
  * @param group       Salida donde se almacenará el descriptor leído.
  * @return 0 si tiene éxito, -1 en caso de error.
  */
-int read_group_desc_ext2(FILE *fp, uint16_t block_group, ext2_group_desc *group) {
+int read_group_desc_ext2(FILE *fp, uint32_t block_group, ext2_group_desc *group) {
     if (!fp || !group) return -1;
     uint32_t table_block = sb.s_first_data_block + 1;
+    // Con 64BIT los descriptores miden s_desc_size; los primeros 32 bytes son los de ext2
+    uint32_t desc_size = sizeof(ext2_group_desc);
+    if ((sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && sb.s_desc_size > desc_size) desc_size = sb.s_desc_size;
     uint64_t offset = (uint64_t)table_block * block_size
-                        + (uint64_t)block_group * sizeof(ext2_group_desc);
-    if (fseek(fp, offset, SEEK_SET) != 0) return -1;
+                        + (uint64_t)block_group * desc_size;
+    if (fseeko(fp, offset, SEEK_SET) != 0) return -1;
     if (fread(group, sizeof(*group), 1, fp) != 1) return -1;
     return 0;
 }
 
+/**
+ * Size of an inode in bytes. Regular files keep the upper 32 bits in
+ * i_size_high (i_dir_acl in directories, where it is not part of the size).
+ *
+ * @param inode Inodo.
+ * @return Tamaño en bytes.
+ */
+uint64_t ext2_file_size(const ext2_inode *inode) {
+    if (S_ISREG(inode->i_mode)) return (uint64_t)inode->i_size_high << 32 | inode->i_size;
+    return inode->i_size;
+}
+
 /**
  * Read an inode by its number.
  *
@@ -116,7 +251,13 @@ int read_group_desc_ext2(FILE *fp, uint16_t block_group, ext2_group_desc *group)
  * @return 0 si tiene éxito, -1 en caso de error.
  */
 int read_inode_ext2(FILE *fp, uint32_t inode_num, ext2_inode *inode) {
-    if (!fp || inode_num < 1 || !inode) return -1;
+    if (!fp || inode_num < 1 || inode_num > sb.s_inodes_count || !inode) return -1;
+    ext2_inode_cache_slot *slot = &inode_cache[inode_num % EXT2_INODE_CACHE_SLOTS];
+    if (slot->fp == fp && slot->ino == inode_num) {
+        *inode = slot->inode;
+        return 0;
+    }
+
     uint32_t ing = sb.s_inodes_per_group;
     uint32_t gi = (inode_num - 1) / ing;
     uint32_t li = (inode_num - 1) % ing;
@@ -124,109 +265,606 @@ int read_inode_ext2(FILE *fp, uint32_t inode_num, ext2_inode *inode) {
     if (read_group_desc_ext2(fp, gi, &gd) != 0) return -1;
     uint64_t off = (uint64_t)gd.bg_inode_table * block_size
                     + (uint64_t)li * sb.s_inode_size;
-    if (fseek(fp, off, SEEK_SET) != 0) return -1;
+    if (fseeko(fp, off, SEEK_SET) != 0) return -1;
     if (fread(inode, sizeof(*inode), 1, fp) != 1) return -1;
+
+    slot->fp = fp;
+    slot->ino = inode_num;
+    slot->inode = *inode;
     return 0;
 }
 
 /**
- * Traverse and print entries in a single directory block (skipping “.” and “..”).
+ * Free-space analysis for "--usage". Streams the block and inode bitmaps of
+ * every group and reports free extents and per-group utilisation.
  *
- * @param fp        Puntero al fichero de imagen EXT2.
- * @param block_num Número de bloque de datos que contiene entradas de directorio.
- * @param depth     Nivel de anidamiento para dibujar el prefijo ASCII.
+ * @param filename Ruta al archivo de imagen EXT2.
  */
-static void traverse_dir_block(FILE *fp, uint32_t block_num, int depth) {
-    if (block_num == 0) return;
+void usage_ext2(const char *filename) {
+    if (!load_superblock_ext2(filename)) return;
 
-    /* Sitúate al principio del bloque de datos */
-    if (fseek(fp, (uint64_t)block_num * block_size, SEEK_SET) != 0)
-        return;
+    FILE *fp = image_open(filename);
+    if (!fp) { perror("fopen"); return; }
 
-    uint8_t *buf = malloc(block_size);
-    if (!buf) return;
-    if (fread(buf, block_size, 1, fp) != 1) {
+    uint32_t groups = (sb.s_blocks_count - sb.s_first_data_block + sb.s_blocks_per_group - 1)
+                      / sb.s_blocks_per_group;
+    uint8_t *bitmap = malloc(block_size);
+    if (!bitmap) { fclose(fp); return; }
+
+    usage_stats st;
+    memset(&st, 0, sizeof(st));
+    uint64_t used_inodes = 0;
+
+    fprintf(fs_out(), "\n------ Filesystem Usage ------\n");
+    fprintf(fs_out(), "\nGROUP UTILISATION\n");
+    fprintf(fs_out(), "  Group    Blocks used          Inodes used\n");
+    for (uint32_t g = 0; g < groups; g++) {
+        ext2_group_desc gd;
+        if (read_group_desc_ext2(fp, g, &gd) != 0) break;
+
+        uint64_t first = sb.s_first_data_block + (uint64_t)g * sb.s_blocks_per_group;
+        uint64_t nblocks = sb.s_blocks_count - first;
+        if (nblocks > sb.s_blocks_per_group) nblocks = sb.s_blocks_per_group;
+        // El bitmap es un bloque: nunca contamos más bits de los que tiene
+        if (nblocks > (uint64_t)block_size * 8) nblocks = (uint64_t)block_size * 8;
+        uint32_t ninodes = sb.s_inodes_per_group < block_size * 8 ? sb.s_inodes_per_group : block_size * 8;
+
+        uint64_t bused = 0, iused = 0;
+        if (fseeko(fp, (uint64_t)gd.bg_block_bitmap * block_size, SEEK_SET) == 0 &&
+            fread(bitmap, block_size, 1, fp) == 1) {
+            bused = bitmap_popcount(bitmap, nblocks);
+            usage_feed_bitmap(&st, bitmap, nblocks, first);
+        }
+        if (fseeko(fp, (uint64_t)gd.bg_inode_bitmap * block_size, SEEK_SET) == 0 &&
+            fread(bitmap, block_size, 1, fp) == 1) {
+            iused = bitmap_popcount(bitmap, ninodes);
+        }
+        used_inodes += iused;
+
+        fprintf(fs_out(), "  %5u  %7llu/%-7llu %5.1f%%  %6llu/%-6u %5.1f%%\n", g,
+                          (unsigned long long)bused, (unsigned long long)nblocks, 100.0 * bused / nblocks,
+                          (unsigned long long)iused, sb.s_inodes_per_group,
+                          100.0 * iused / sb.s_inodes_per_group);
+    }
+    usage_finish(&st);
+
+    fprintf(fs_out(), "\nINODES\n");
+    fprintf(fs_out(), "  Used Inodes......: %llu of %u\n", (unsigned long long)used_inodes, sb.s_inodes_count);
+    usage_print(&st, block_size, "block");
+
+    free(bitmap);
+    fclose(fp);
+}
+
+/*
+ * Contexto de recover_ext2 para comprobar los bloques de un inodo borrado.
+ */
+typedef struct {
+    const uint8_t *bitmap;      // Bitmap de bloques de todo el volumen
+    uint64_t blocks;            // Bloques de datos vistos
+    uint64_t reused;            // Bloques ya reasignados a otro fichero
+} ext2_recover_ctx;
+
+/**
+ * ext2_for_each_block callback: count the blocks that are allocated again.
+ */
+static int recover_check_block(FILE *fp, uint32_t block, void *ctx) {
+    (void)fp;
+    ext2_recover_ctx *c = ctx;
+    uint64_t bit = (uint64_t)block - sb.s_first_data_block;
+    c->blocks++;
+    if (block < sb.s_first_data_block || block >= sb.s_blocks_count ||
+        (c->bitmap[bit / 8] >> (bit % 8)) & 1) {
+        c->reused++;
+    }
+    return 0;
+}
+
+/**
+ * Copy the contents of a deleted inode to "<outdir>/inode_<n>".
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int recover_extract(FILE *fp, uint32_t ino, const ext2_inode *inode, const char *outdir) {
+    char name[32];
+    snprintf(name, sizeof(name), "inode_%u", ino);
+    char *path = path_join(outdir, name);
+    // Nunca sobrescribimos un fichero que ya esté en el directorio de salida
+    FILE *out = path ? fopen(path, "wbx") : NULL;
+    if (!out && path && errno == EEXIST) fprintf(stderr, "Not overwriting '%s'\n", path);
+    free(path);
+    uint8_t *buf = malloc(CAT_CHUNK_SIZE);
+    if (!out || !buf) {
+        if (out) fclose(out);
         free(buf);
+        return -1;
+    }
+
+    int64_t n;
+    uint64_t pos = 0;
+    while ((n = read_file_ext2(fp, inode, pos, buf, CAT_CHUNK_SIZE)) > 0 && fwrite(buf, n, 1, out) == 1) {
+        pos += n;
+    }
+    free(buf);
+    fclose(out);
+    return n < 0 ? -1 : 0;
+}
+
+/**
+ * Deleted-file recovery scan ("--recover"). Loads the block bitmaps of every
+ * group, then sweeps each inode table in large sequential reads looking for
+ * inodes with a nonzero i_dtime whose data blocks are all still free.
+ * Candidates are printed as they are found and optionally copied out.
+ *
+ * @param filename Ruta al archivo de imagen EXT2.
+ * @param outdir   Directorio donde extraer los ficheros, o NULL para listar.
+ */
+void recover_ext2(const char *filename, const char *outdir) {
+    if (!load_superblock_ext2(filename)) return;
+
+    FILE *fp = image_open(filename);
+    if (!fp) { perror("fopen"); return; }
+
+    uint32_t groups = (sb.s_blocks_count - sb.s_first_data_block + sb.s_blocks_per_group - 1)
+                      / sb.s_blocks_per_group;
+    uint32_t inode_size = sb.s_rev_level == 0 ? 128 : sb.s_inode_size;
+    uint64_t table_bytes = (uint64_t)sb.s_inodes_per_group * inode_size;
+    size_t chunk = table_bytes < EXT2_RECOVER_CHUNK ? table_bytes : EXT2_RECOVER_CHUNK;
+    chunk -= chunk % inode_size;
+
+    // Un bit por bloque de todo el volumen; cada grupo aporta blocks_per_group bits
+    size_t bitmap_bytes = ((uint64_t)groups * sb.s_blocks_per_group + 7) / 8;
+    uint8_t *bitmap = calloc(bitmap_bytes + block_size, 1);
+    uint8_t *table = malloc(chunk);
+    if (!bitmap || !table || inode_size < sizeof(ext2_inode)) {
+        free(bitmap);
+        free(table);
+        fclose(fp);
         return;
     }
 
-    uint32_t off = 0;
-    while (off < block_size) {
-        ext2_dir_entry *e = (ext2_dir_entry *)(buf + off);
-        if (e->rec_len == 0 || off + e->rec_len > block_size) break;
-
-        /* Copiamos nombre y lo NUL-terminamos */
-        char name[256] = {0};
-        int len = e->name_len < 255 ? e->name_len : 255;
-        memcpy(name, e->name, len);
-        name[len] = '\0';
-
-        /* Saltamos entradas inválidas o "." / ".." */
-        if (e->inode != 0 && strcmp(name, ".") && strcmp(name, "..")) {
-            /* Prefijo de árbol */
-            for (int i = 0; i < depth - 1; i++)
-                printf("│   ");
-
-            int is_last = (off + e->rec_len >= block_size);
-            printf(is_last ? "└── %s\n" : "├── %s\n", name);
-
-            /* Detectar si es directorio */
-            int is_dir = (e->file_type == EXT2_FT_DIR);
-            if (!is_dir) {
-                /* Fallback: leer inode y comprobar modo */
-                ext2_inode tmp;
-                if (read_inode_ext2(fp, e->inode, &tmp) == 0) {
-                    if (S_ISDIR(tmp.i_mode))
-                        is_dir = 1;
-                }
-            }
+    ext2_group_desc *gds = malloc((size_t)groups * sizeof(ext2_group_desc));
+    for (uint32_t g = 0; gds && g < groups; g++) {
+        if (read_group_desc_ext2(fp, g, &gds[g]) != 0) groups = g;
+    }
+    for (uint32_t g = 0; gds && g < groups; g++) {
+        // Solo los bytes de bitmap que corresponden al grupo, no el bloque entero
+        uint8_t *dst = bitmap + (uint64_t)g * sb.s_blocks_per_group / 8;
+        if (fseeko(fp, (uint64_t)gds[g].bg_block_bitmap * block_size, SEEK_SET) != 0 ||
+            fread(dst, sb.s_blocks_per_group / 8, 1, fp) != 1) {
+            memset(dst, 0xFF, sb.s_blocks_per_group / 8);
+        }
+    }
 
-            if (is_dir) {
-                ext2_inode sub;
-                if (read_inode_ext2(fp, e->inode, &sub) == 0) {
-                    read_dir(fp, &sub, depth + 1);
-                }
+    uint64_t deleted = 0, found = 0, extracted = 0;
+    fprintf(fs_out(), "\n------ Deleted Inodes ------\n\n");
+    fprintf(fs_out(), "  Inode      Size        Deleted                   Blocks\n");
+    for (uint32_t g = 0; gds && g < groups; g++) {
+        uint64_t base = (uint64_t)gds[g].bg_inode_table * block_size;
+        for (uint64_t off = 0; off < table_bytes; off += chunk) {
+            size_t len = table_bytes - off < chunk ? table_bytes - off : chunk;
+            if (fseeko(fp, base + off, SEEK_SET) != 0 || fread(table, len, 1, fp) != 1) break;
+
+            for (size_t i = 0; i < len; i += inode_size) {
+                ext2_inode inode;
+                memcpy(&inode, table + i, sizeof(inode));
+                if (inode.i_dtime == 0 || inode.i_mode == 0 || inode.i_links_count != 0) continue;
+                deleted++;
+                if (inode.i_size == 0 || inode.i_blocks == 0) continue;
+
+                ext2_recover_ctx ctx = { bitmap, 0, 0 };
+                if (ext2_for_each_block(fp, &inode, recover_check_block, &ctx) < 0 || ctx.reused) continue;
+
+                uint32_t ino = g * sb.s_inodes_per_group + (off + i) / inode_size + 1;
+                fprintf(fs_out(), "  %-10u %-11llu %-25s %llu\n", ino, (unsigned long long)ext2_file_size(&inode),
+                                  format_time(inode.i_dtime), (unsigned long long)ctx.blocks);
+                found++;
+                if (outdir && recover_extract(fp, ino, &inode, outdir) == 0) extracted++;
             }
         }
+    }
 
-        off += e->rec_len;
+    fprintf(fs_out(), "\n  Deleted inodes...: %llu\n", (unsigned long long)deleted);
+    fprintf(fs_out(), "  Recoverable......: %llu\n", (unsigned long long)found);
+    if (outdir) fprintf(fs_out(), "  Extracted........: %llu\n", (unsigned long long)extracted);
+
+    free(gds);
+    free(table);
+    free(bitmap);
+    fclose(fp);
+}
+
+/*
+ * Caché de directorios decodificados, indexada por número de inodo. Cada
+ * ranura guarda una vista; si la ranura está ocupada por una vista en uso se
+ * devuelve una vista suelta que se libera en ext2_dir_view_put.
+ */
+typedef struct {
+    FILE *fp;
+    ext2_dir_view *view;
+    uint32_t refs;
+} ext2_dir_cache_slot;
+
+static _Thread_local ext2_dir_cache_slot dir_cache[EXT2_DIR_CACHE_SLOTS];
+
+/**
+ * Validate an extent tree node: magic, entry count within both its own
+ * capacity and the space it lives in, and the depth expected by the parent.
+ *
+ * @param node  Nodo (cabecera seguida de las entradas).
+ * @param size  Bytes disponibles para el nodo.
+ * @param depth Profundidad esperada, o -1 para la raíz.
+ * @return Cabecera del nodo, o NULL si está corrupto.
+ */
+static const ext4_extent_header *extent_node(const void *node, size_t size, int depth) {
+    const ext4_extent_header *h = node;
+    size_t room = (size - sizeof(*h)) / sizeof(ext4_extent);
+    if (h->eh_magic != EXT4_EXT_MAGIC || h->eh_entries > h->eh_max || h->eh_entries > room ||
+        h->eh_depth > EXT4_EXT_MAX_DEPTH || (depth >= 0 && h->eh_depth != depth)) {
+        return NULL;
     }
+    return h;
+}
 
-    free(buf);
+/**
+ * Report an extent or index entry whose block number needs more than the
+ * 32 bits the reader handles (ee_start_hi / ei_leaf_hi set).
+ *
+ * @return Siempre -1, para devolverlo directamente.
+ */
+static int extent_unsupported(void) {
+    fprintf(stderr, "EXT2: unsupported 48-bit extent\n");
+    return -1;
 }
 
 /**
- * Read and print all directory entries for the given inode.
- * Recorre bloques directos e indirectos y llama a traverse_dir_block.
+ * Iterate the data blocks of an extent tree node in logical order, recursing
+ * into index nodes. Uninitialized extents read as zeros and, like holes,
+ * are skipped; a 48-bit block number stops the walk with an error.
  *
- * @param fp    Puntero al fichero de imagen EXT2.
- * @param inode Inodo de directorio cuyas entradas se listarán.
- * @param depth Nivel de anidamiento para los prefijos ASCII.
- */
-static void read_dir(FILE *fp, ext2_inode *inode, int depth) {
-    uint32_t ptrs = block_size / sizeof(uint32_t);
-    uint32_t *ib = NULL;
-
-    // Direct blocks
-    for (int i = 0; i < EXT2_NDIR_BLOCKS; i++) {
-        if (!inode->i_block[i]) break;
-        traverse_dir_block(fp, inode->i_block[i], depth);
-    }
-
-    // Single, double, triple indirect blocks
-    for (int lvl = 1; lvl <= 3; lvl++) {
-        int idx = (lvl == 1 ? EXT2_IND_BLOCK : lvl == 2 ? EXT2_DIND_BLOCK : EXT2_TIND_BLOCK);
-        if (!inode->i_block[idx]) continue;
-        ib = malloc(block_size);
-        if (!ib) continue;
-        if (fseek(fp, (uint64_t)inode->i_block[idx] * block_size, SEEK_SET) == 0
-            && fread(ib, block_size, 1, fp) == 1) {
-            for (uint32_t j = 0; j < ptrs; j++) {
-                if (ib[j]) traverse_dir_block(fp, ib[j], depth);
+ * @param fp     Puntero al fichero de imagen EXT2.
+ * @param h      Nodo a recorrer (ya validado).
+ * @param nblocks Bloques lógicos del fichero; los extents se recortan a ellos.
+ * @param cb     Callback por bloque de datos; si devuelve distinto de 0 se para.
+ * @param ctx    Contexto para el callback.
+ * @return Valor devuelto por el callback que paró la iteración, 0, o -1 si
+ *         el árbol usa bloques de 48 bits.
+ */
+static int iterate_extents(FILE *fp, const ext4_extent_header *h, uint64_t nblocks, ext2_block_cb cb, void *ctx) {
+    int r = 0;
+    if (h->eh_depth == 0) {
+        const ext4_extent *ex = (const ext4_extent *)(h + 1);
+        for (uint32_t i = 0; i < h->eh_entries && !r; i++) {
+            if (ex[i].ee_len > EXT4_EXT_INIT_MAX || ex[i].ee_block >= nblocks) continue;
+            if (ex[i].ee_start_hi) return extent_unsupported();
+            uint64_t len = ex[i].ee_len;
+            if (len > nblocks - ex[i].ee_block) len = nblocks - ex[i].ee_block;
+            for (uint64_t b = 0; b < len && !r; b++) {
+                uint64_t pblk = (uint64_t)ex[i].ee_start_lo + b;
+                if (pblk <= UINT32_MAX && valid_block(pblk)) r = cb(fp, pblk, ctx);
             }
         }
+        return r;
+    }
+
+    // El callback puede leer otros bloques: cada nivel trabaja sobre su copia
+    uint8_t *node = malloc(block_size);
+    if (!node) return 0;
+    const ext4_extent_idx *ix = (const ext4_extent_idx *)(h + 1);
+    for (uint32_t i = 0; i < h->eh_entries && !r && ix[i].ei_block < nblocks; i++) {
+        if (ix[i].ei_leaf_hi) {
+            r = extent_unsupported();
+            break;
+        }
+        uint32_t child = ix[i].ei_leaf_lo;
+        if (!valid_block(child) || fseeko(fp, (uint64_t)child * block_size, SEEK_SET) != 0 ||
+            fread(node, block_size, 1, fp) != 1) {
+            continue;
+        }
+        const ext4_extent_header *ch = extent_node(node, block_size, h->eh_depth - 1);
+        if (ch) r = iterate_extents(fp, ch, nblocks, cb, ctx);
+    }
+    free(node);
+    return r;
+}
+
+/**
+ * Iterate, in logical order, every data block of an inode: direct blocks and
+ * then single, double and triple indirect blocks, or the leaves of its
+ * extent tree on ext4. Holes are skipped.
+ *
+ * @param fp    Puntero al fichero de imagen EXT2.
+ * @param inode Inodo cuyos bloques se recorren.
+ * @param cb    Callback por bloque de datos; si devuelve distinto de 0 se para.
+ * @param ctx   Contexto para el callback.
+ * @return Valor devuelto por el callback que paró la iteración, 0, o -1 si
+ *         el árbol de extents usa bloques de 48 bits.
+ */
+int ext2_for_each_block(FILE *fp, const ext2_inode *inode, ext2_block_cb cb, void *ctx) {
+    uint64_t left = (ext2_file_size(inode) + block_size - 1) / block_size;
+    int r = 0;
+
+    if (inode->i_flags & EXT4_EXTENTS_FL) {
+        const ext4_extent_header *h = extent_node(inode->i_block, sizeof(inode->i_block), -1);
+        return h ? iterate_extents(fp, h, left, cb, ctx) : 0;
+    }
+
+    for (int i = 0; i < EXT2_NDIR_BLOCKS && left > 0 && !r; i++, left--) {
+        if (valid_block(inode->i_block[i])) r = cb(fp, inode->i_block[i], ctx);
+    }
+
+    int idxs[3] = { EXT2_IND_BLOCK, EXT2_DIND_BLOCK, EXT2_TIND_BLOCK };
+    for (int lvl = 0; lvl < 3 && left > 0 && !r; lvl++) {
+        uint32_t ib = inode->i_block[idxs[lvl]];
+        if (ib) r = parsers.iterate_indirect(fp, ib, lvl + 1, &left, cb, ctx);
+    }
+    return r;
+}
+
+/**
+ * Append one entry to a directory view, growing its arrays as needed.
+ *
+ * @param v    Vista de directorio.
+ * @param e    Entrada de disco a copiar.
+ * @return 0 si tiene éxito, -1 si no hay memoria.
+ */
+static int dir_view_append(ext2_dir_view *v, const ext2_dir_entry *e) {
+    if (v->count == v->cap) {
+        uint32_t cap = v->cap ? v->cap * 2 : 32;
+        uint32_t *inodes = realloc(v->inodes, cap * sizeof(uint32_t));
+        if (inodes) v->inodes = inodes;
+        uint32_t *name_off = realloc(v->name_off, cap * sizeof(uint32_t));
+        if (name_off) v->name_off = name_off;
+        uint8_t *types = realloc(v->types, cap);
+        if (types) v->types = types;
+        uint8_t *name_len = realloc(v->name_len, cap);
+        if (name_len) v->name_len = name_len;
+        if (!inodes || !name_off || !types || !name_len) return -1;
+        v->cap = cap;
+    }
+    if (v->names_len + e->name_len + 1 > v->names_cap) {
+        uint32_t cap = v->names_cap ? v->names_cap * 2 : 1024;
+        while (cap < v->names_len + e->name_len + 1) cap *= 2;
+        char *names = realloc(v->names, cap);
+        if (!names) return -1;
+        v->names = names;
+        v->names_cap = cap;
+    }
+
+    uint32_t i = v->count++;
+    v->inodes[i] = e->inode;
+    v->types[i] = e->file_type;
+    v->name_len[i] = e->name_len;
+    v->name_off[i] = v->names_len;
+    memcpy(v->names + v->names_len, e->name, e->name_len);
+    v->names[v->names_len + e->name_len] = '\0';
+    v->names_len += e->name_len + 1;
+    return 0;
+}
+
+/**
+ * Iterate the data blocks of an indirect block, recursing down `level` levels.
+ * Template for the parsers below: `bs` is a constant in every specialisation,
+ * so the pointer count is known at compile time. Runs of zero pointers
+ * (holes) are skipped EXT2_ZERO_RUN pointers at a time.
+ *
+ * @param fp     Puntero al fichero de imagen EXT2.
+ * @param block  Bloque indirecto a procesar.
+ * @param level  1=single, 2=double, 3=triple indirect.
+ * @param left   Bloques de datos que quedan por visitar (se decrementa).
+ * @param cb     Callback por bloque de datos; si devuelve distinto de 0 se para.
+ * @param ctx    Contexto para el callback.
+ * @param bs     Tamaño de bloque.
+ * @param self   Especialización que se llama para el nivel inferior.
+ * @return Valor devuelto por el callback que paró la iteración, o 0.
+ */
+static inline __attribute__((always_inline))
+int iterate_indirect_bs(FILE *fp, uint32_t block, int level, uint64_t *left, ext2_block_cb cb, void *ctx,
+                        const uint32_t bs, ext2_indirect_fn self) {
+    if (!valid_block(block)) return 0;
+    const uint32_t ptrs = bs / sizeof(uint32_t);
+    uint32_t *ib = malloc(bs);
+    if (!ib) return 0;
+    if (fseeko(fp, (uint64_t)block * bs, SEEK_SET) != 0 || fread(ib, bs, 1, fp) != 1) {
         free(ib);
-    } 
+        return 0;
+    }
+
+    // Bloques de datos que cubre cada puntero de este nivel
+    uint64_t span = 1;
+    for (int l = 1; l < level; l++) span *= ptrs;
+
+    int r = 0;
+    uint32_t i = 0;
+    while (i < ptrs && *left > 0 && !r) {
+        if (!ib[i]) {
+            // Hueco: buscamos el final de la racha de ceros y la descontamos entera
+            uint32_t j = i + 1;
+            while (j + EXT2_ZERO_RUN <= ptrs) {
+                uint32_t any = 0;
+                for (int k = 0; k < EXT2_ZERO_RUN; k++) any |= ib[j + k];
+                if (any) break;
+                j += EXT2_ZERO_RUN;
+            }
+            while (j < ptrs && !ib[j]) j++;
+            uint64_t skip = (uint64_t)(j - i) * span;
+            *left = *left > skip ? *left - skip : 0;
+            i = j;
+            continue;
+        }
+        if (level == 1) {
+            (*left)--;
+            if (valid_block(ib[i])) r = cb(fp, ib[i], ctx);
+        } else {
+            r = self(fp, ib[i], level - 1, left, cb, ctx);
+        }
+        i++;
+    }
+    free(ib);
+    return r;
+}
+
+/**
+ * Decode the entries of one directory block into a view. Template for the
+ * parsers below, like iterate_indirect_bs.
+ *
+ * @param v   Vista de directorio.
+ * @param buf Contenido del bloque.
+ * @param bs  Tamaño de bloque.
+ * @return 0 si tiene éxito, -1 si no hay memoria.
+ */
+static inline __attribute__((always_inline))
+int decode_dir_block_bs(ext2_dir_view *v, const uint8_t *buf, const uint32_t bs) {
+    uint32_t off = 0;
+    while (off + 8 <= bs) {
+        const ext2_dir_entry *e = (const ext2_dir_entry *)(buf + off);
+        if (e->rec_len < 8 || off + e->rec_len > bs) break;
+        if (e->inode != 0 && e->name_len <= e->rec_len - 8) {
+            if (dir_view_append(v, e) != 0) return -1;
+        }
+        off += e->rec_len;
+    }
+    return 0;
+}
+
+/*
+ * Una especialización de los dos parsers para un tamaño de bloque. Con
+ * block_size como tamaño se obtiene la versión genérica.
+ */
+#define EXT2_BLOCK_PARSERS(NAME, BS)                                                                        \
+    static int iterate_indirect_##NAME(FILE *fp, uint32_t block, int level, uint64_t *left,                \
+                                       ext2_block_cb cb, void *ctx) {                                      \
+        return iterate_indirect_bs(fp, block, level, left, cb, ctx, BS, iterate_indirect_##NAME);          \
+    }                                                                                                      \
+    static int decode_dir_block_##NAME(ext2_dir_view *v, const uint8_t *buf) {                             \
+        return decode_dir_block_bs(v, buf, BS);                                                            \
+    }
+
+EXT2_BLOCK_PARSERS(1k, 1024)
+EXT2_BLOCK_PARSERS(2k, 2048)
+EXT2_BLOCK_PARSERS(4k, 4096)
+EXT2_BLOCK_PARSERS(any, block_size)
+
+/**
+ * Pick the parsers for the block size of the loaded superblock.
+ */
+static void select_block_parsers(void) {
+    switch (block_size) {
+        case 1024: parsers = (ext2_block_parsers){ iterate_indirect_1k, decode_dir_block_1k }; break;
+        case 2048: parsers = (ext2_block_parsers){ iterate_indirect_2k, decode_dir_block_2k }; break;
+        case 4096: parsers = (ext2_block_parsers){ iterate_indirect_4k, decode_dir_block_4k }; break;
+        default: parsers = (ext2_block_parsers){ iterate_indirect_any, decode_dir_block_any }; break;
+    }
+}
+
+/**
+ * Block callback that decodes one directory block into the view in ctx.
+ */
+static int dir_view_decode_block(FILE *fp, uint32_t block, void *ctx) {
+    ext2_dir_view *v = ctx;
+    uint8_t *buf = malloc(block_size);
+    if (!buf) return 0;
+    if (fseeko(fp, (uint64_t)block * block_size, SEEK_SET) == 0 &&
+        fread(buf, block_size, 1, fp) == 1) {
+        parsers.decode_dir_block(v, buf);
+    }
+    free(buf);
+    return 0;
+}
+
+/**
+ * Free a directory view and all its arrays.
+ */
+static void dir_view_free(ext2_dir_view *v) {
+    if (!v) return;
+    free(v->inodes);
+    free(v->types);
+    free(v->name_off);
+    free(v->name_len);
+    free(v->names);
+    free(v);
+}
+
+/**
+ * Get the decoded view of a directory, reading and parsing its blocks only
+ * the first time. Must be released with ext2_dir_view_put.
+ *
+ * @param fp  Puntero al fichero de imagen EXT2.
+ * @param ino Número de inodo del directorio.
+ * @return Vista del directorio, o NULL en caso de error.
+ */
+const ext2_dir_view *ext2_dir_view_get(FILE *fp, uint32_t ino) {
+    ext2_dir_cache_slot *slot = &dir_cache[ino % EXT2_DIR_CACHE_SLOTS];
+    if (slot->view && slot->fp == fp && slot->view->ino == ino) {
+        slot->refs++;
+        return slot->view;
+    }
+
+    ext2_inode inode;
+    if (read_inode_ext2(fp, ino, &inode) != 0) return NULL;
+
+    ext2_dir_view *v = calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    v->ino = ino;
+    // Un i_size corrupto no puede hacernos leer más que el límite
+    if (inode.i_size > fs_limit.max_dir_bytes) inode.i_size = fs_limit.max_dir_bytes;
+    ext2_for_each_block(fp, &inode, dir_view_decode_block, v);
+
+    if (slot->refs == 0) {
+        dir_view_free(slot->view);
+        slot->fp = fp;
+        slot->view = v;
+        slot->refs = 1;
+        v->cached = TRUE;
+    }
+    return v;
+}
+
+/**
+ * Release a view obtained with ext2_dir_view_get.
+ *
+ * @param view Vista a liberar.
+ */
+void ext2_dir_view_put(const ext2_dir_view *view) {
+    if (!view) return;
+    if (!view->cached) {
+        dir_view_free((ext2_dir_view *)view);
+        return;
+    }
+    ext2_dir_cache_slot *slot = &dir_cache[view->ino % EXT2_DIR_CACHE_SLOTS];
+    if (slot->refs > 0) slot->refs--;
+}
+
+/**
+ * Drop every cached directory view. Must be called before working on
+ * another image.
+ */
+void ext2_dir_cache_clear(void) {
+    for (int i = 0; i < EXT2_DIR_CACHE_SLOTS; i++) {
+        dir_view_free(dir_cache[i].view);
+    }
+    memset(dir_cache, 0, sizeof(dir_cache));
+}
+
+/**
+ * Whether entry i of a view is "." or "..".
+ */
+static int is_dot_entry(const ext2_dir_view *v, uint32_t i) {
+    const char *n = v->names + v->name_off[i];
+    return (v->name_len[i] == 1 && n[0] == '.') ||
+           (v->name_len[i] == 2 && n[0] == '.' && n[1] == '.');
+}
+
+/**
+ * Whether entry i of a view is a directory. With the FILETYPE feature the
+ * entry's file_type is authoritative and no inode is read; on older images
+ * the byte is unused, so we fall back to reading the inode and S_ISDIR.
+ */
+static int is_dir_entry(FILE *fp, const ext2_dir_view *v, uint32_t i) {
+    if (trust_file_type) return v->types[i] == EXT2_FT_DIR;
+    if (v->types[i] == EXT2_FT_DIR) return TRUE;
+    ext2_inode tmp;
+    return read_inode_ext2(fp, v->inodes[i], &tmp) == 0 && S_ISDIR(tmp.i_mode);
 }
 
 /**
@@ -236,21 +874,97 @@ static void read_dir(FILE *fp, ext2_inode *inode, int depth) {
  * @param filename Ruta al archivo de imagen EXT2.
  */
 void tree_ext2(const char *filename) {
-    if (!read_ext2_superblock(filename, &sb)) return;
-    block_size = 1024 << sb.s_log_block_size;
+    if (!load_superblock_ext2(filename)) return;
 
-    FILE *fp = fopen(filename, "rb");
+    FILE *fp = image_open(filename);
     if (!fp) { perror("fopen"); return; }
 
-    ext2_inode root;
-    if (read_inode_ext2(fp, EXT2_ROOT_INO, &root) != 0) {
-        fclose(fp);
+    fprintf(fs_out(), ".\n");
+    fs_walk top;
+    fs_walk_begin(&top);
+    tree_ext2_subdir(fp, EXT2_ROOT_INO, "", &top);
+    fs_walk_end(&top);
+    fclose(fp);
+}
+
+/*
+ * Contexto de tree_ext2_sorted: la ordenación que recibe las entradas y el
+ * buffer del bloque de directorio que se está leyendo.
+ */
+typedef struct {
+    dir_sorter *s;
+    uint8_t *buf;
+    int ok;
+} tree_sort_ctx;
+
+/**
+ * Block callback that hands the entries of one directory block to the
+ * sorter of ctx, skipping "." and "..".
+ */
+static int tree_sort_block(FILE *fp, uint32_t block, void *ctx) {
+    tree_sort_ctx *t = ctx;
+    if (fseeko(fp, (uint64_t)block * block_size, SEEK_SET) != 0 || fread(t->buf, block_size, 1, fp) != 1) return 0;
+
+    for (uint32_t off = 0; off + 8 <= block_size && t->ok; ) {
+        const ext2_dir_entry *e = (const ext2_dir_entry *)(t->buf + off);
+        if (e->rec_len < 8 || off + e->rec_len > block_size) break;
+        off += e->rec_len;
+        if (e->inode == 0 || e->name_len > e->rec_len - 8) continue;
+        if (e->name[0] == '.' && (e->name_len == 1 || (e->name_len == 2 && e->name[1] == '.'))) continue;
+
+        char name[EXT2_NAME_LEN + 1];
+        memcpy(name, e->name, e->name_len);
+        name[e->name_len] = '\0';
+        uint64_t key = 0;
+        ext2_inode inode;
+        if (tree_sort != TREE_SORT_NAME && read_inode_ext2(fp, e->inode, &inode) == 0) {
+            key = tree_sort == TREE_SORT_SIZE ? ext2_file_size(&inode) : inode.i_mtime;
+        }
+        int is_dir = ext2_entry_type(fp, e->inode, e->file_type) == EXT2_FT_DIR;
+        t->ok = dir_sorter_add(t->s, name, key, e->inode, is_dir) == 0;
+    }
+    return !t->ok;
+}
+
+/**
+ * Print one level of the tree in the order of --sort. The directory is read
+ * one block at a time straight into a dir_sorter, so it is never held in
+ * memory as a whole; only the sorter (in memory or on disk) stays alive
+ * during the recursion.
+ *
+ * @param fp     Puntero al fichero de imagen EXT2.
+ * @param prefix Prefijo ASCII-art para este nivel.
+ * @param node   Directorio actual en el recorrido.
+ */
+static void tree_ext2_sorted(FILE *fp, const char *prefix, const fs_walk *node) {
+    ext2_inode dir;
+    tree_sort_ctx t = { dir_sorter_new(), malloc(block_size), TRUE };
+    t.ok = t.s && t.buf && read_inode_ext2(fp, node->id, &dir) == 0;
+    if (t.ok) {
+        // Un i_size corrupto no puede hacernos leer más que el límite
+        if (dir.i_size > fs_limit.max_dir_bytes) dir.i_size = fs_limit.max_dir_bytes;
+        ext2_for_each_block(fp, &dir, tree_sort_block, &t);
+    }
+    free(t.buf);
+    dir_sorter *s = t.s;
+    if (!t.ok || dir_sorter_finish(s) != 0) {
+        fprintf(stderr, "Error sorting directory %u\n", node->id);
+        dir_sorter_free(s);
         return;
     }
 
-    printf(".\n");
-    tree_ext2_subdir(fp, &root, "");
-    fclose(fp);
+    sort_entry e;
+    int is_last;
+    while (dir_sorter_next(s, &e, &is_last)) {
+        fprintf(fs_out(), "%s%s%s\n", prefix, is_last ? "└── " : "├── ", e.name);
+        if (e.is_dir) {
+            char *p2 = tree_child_prefix(prefix, is_last);
+            if (!p2) break;
+            tree_ext2_subdir(fp, e.id, p2, node);
+            free(p2);
+        }
+    }
+    dir_sorter_free(s);
 }
 
 /**
@@ -258,373 +972,755 @@ void tree_ext2(const char *filename) {
  * Recorre un inodo de directorio y sus subdirectorios imprimiendo con el prefijo dado.
  *
  * @param fp     Puntero al fichero de imagen EXT2.
- * @param inode  Inodo de directorio actual.
+ * @param ino    Inodo de directorio actual.
  * @param prefix Prefijo ASCII-art para este nivel (p.ej. "│   " o "    ").
+ * @param parent Directorio padre en el recorrido (NULL para la raíz).
  */
-static void tree_ext2_subdir(FILE *fp, ext2_inode *inode, const char *prefix) {
-    // Direct blocks
-    for (int i = 0; i < EXT2_NDIR_BLOCKS; i++) {
-        uint32_t blk = inode->i_block[i];
-        if (!blk) continue;
-
-        uint8_t *buf = malloc(block_size);
-        if (!buf) return;
-        if (fseek(fp, (uint64_t)blk * block_size, SEEK_SET) != 0 ||
-            fread(buf, block_size, 1, fp) != 1) {
-            free(buf);
-            return;
-        }
+static void tree_ext2_subdir(FILE *fp, uint32_t ino, const char *prefix, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, ino)) return;
+    if (tree_sort != TREE_SORT_NONE) {
+        tree_ext2_sorted(fp, prefix, &node);
+        return;
+    }
+    const ext2_dir_view *v = ext2_dir_view_get(fp, ino);
+    if (!v) return;
 
-        uint32_t off = 0;
-        while (off < block_size) {
-            ext2_dir_entry *e = (ext2_dir_entry *)(buf + off);
-            if (e->rec_len == 0 || off + e->rec_len > block_size) break;
-
-            // Nombre NUL-terminado
-            char name[256] = {0};
-            int len = e->name_len < 255 ? e->name_len : 255;
-            memcpy(name, e->name, len);
-            name[len] = '\0';
-
-            // Saltar ".", ".." y entradas inválidas
-            if (e->inode != 0 &&
-                strcmp(name, ".")   != 0 &&
-                strcmp(name, "..")  != 0)
-            {
-                int is_last = (off + e->rec_len >= block_size);
-                printf("%s%s%s\n",
-                       prefix,
-                       is_last ? "└── " : "├── ",
-                       name);
-
-                // Detectar directorio (vía file_type o fallback S_ISDIR)
-                int is_dir = (e->file_type == EXT2_FT_DIR);
-                if (!is_dir) {
-                    ext2_inode tmp;
-                    if (read_inode_ext2(fp, e->inode, &tmp) == 0 &&
-                        S_ISDIR(tmp.i_mode))
-                    {
-                        is_dir = 1;
-                    }
-                }
+    // Última entrada visible del directorio (en todos sus bloques)
+    uint32_t last = v->count;
+    for (uint32_t i = v->count; i-- > 0;) {
+        if (!is_dot_entry(v, i)) { last = i; break; }
+    }
 
-                if (is_dir) {
-                    // Nuevo prefix para nivel inferior
-                    size_t L = strlen(prefix) + 4 + 1;
-                    char *p2 = malloc(L);
-                    strcpy(p2, prefix);
-                    strcat(p2, is_last ? "    " : "│   ");
+    for (uint32_t i = 0; i < v->count; i++) {
+        if (is_dot_entry(v, i)) continue;
 
-                    ext2_inode sub;
-                    if (read_inode_ext2(fp, e->inode, &sub) == 0) {
-                        tree_ext2_subdir(fp, &sub, p2);
-                    }
-                    free(p2);
-                }
-            }
+        int is_last = (i == last);
+        fprintf(fs_out(), "%s%s%s\n",
+                          prefix,
+                          is_last ? "└── " : "├── ",
+                          v->names + v->name_off[i]);
 
-            off += e->rec_len;
+        if (is_dir_entry(fp, v, i)) {
+            // Nuevo prefix para nivel inferior
+            char *p2 = tree_child_prefix(prefix, is_last);
+            if (!p2) break;
+            tree_ext2_subdir(fp, v->inodes[i], p2, &node);
+            free(p2);
         }
+    }
 
-        free(buf);
+    ext2_dir_view_put(v);
+}
+
+/*
+ * Inodo en uso visto en el barrido de --list-inodes, con los metadatos que se
+ * imprimen. Los directorios guardan además su inodo completo para leerlos.
+ */
+typedef struct {
+    uint32_t ino;
+    uint16_t mode;
+    uint16_t links;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t mtime;
+    uint64_t size;
+} ext2_list_item;
+
+typedef struct {
+    uint32_t ino;
+    uint32_t first;             // Primer bloque de datos, para ordenar las lecturas
+    ext2_inode inode;
+} ext2_list_dir;
+
+/*
+ * Mapa padre/nombre de --list-inodes, indexado por número de inodo: el
+ * directorio donde aparece por primera vez y el desplazamiento de ese nombre
+ * en el pool.
+ */
+typedef struct {
+    uint32_t *parent;           // 0 = sin nombre conocido
+    uint32_t *name_off;
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+} ext2_name_map;
+
+static int cmp_list_dir(const void *a, const void *b) {
+    uint32_t x = ((const ext2_list_dir *)a)->first;
+    uint32_t y = ((const ext2_list_dir *)b)->first;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Whether bit i of a bitmap is set.
+ */
+static int bitmap_test(const uint8_t *bm, uint32_t i) {
+    return (bm[i / 8] >> (i % 8)) & 1;
+}
+
+/**
+ * Record the name of an inode the first time a directory entry points at it.
+ *
+ * @return 0 on success, -1 if there is no memory.
+ */
+static int name_map_add(ext2_name_map *m, uint32_t parent, uint32_t ino, const char *name, size_t len) {
+    if (ino < 1 || ino > sb.s_inodes_count || m->parent[ino]) return 0;
+    if (m->names_len + len + 1 > m->names_cap) {
+        size_t cap = m->names_cap ? m->names_cap * 2 : 4096;
+        while (cap < m->names_len + len + 1) cap *= 2;
+        char *names = realloc(m->names, cap);
+        if (!names) return -1;
+        m->names = names;
+        m->names_cap = cap;
+    }
+    m->parent[ino] = parent;
+    m->name_off[ino] = m->names_len;
+    memcpy(m->names + m->names_len, name, len);
+    m->names[m->names_len + len] = '\0';
+    m->names_len += len + 1;
+    return 0;
+}
+
+/**
+ * Rebuild the path of an inode from the parent/name map, right to left.
+ *
+ * @return Pointer into buf, or NULL if the inode is not reachable from the root.
+ */
+static const char *name_map_path(const ext2_name_map *m, uint32_t ino, char *buf, size_t size) {
+    if (ino == EXT2_ROOT_INO) return ".";
+    char *p = buf + size - 1;
+    *p = '\0';
+    for (uint32_t depth = 0; ino != EXT2_ROOT_INO; depth++) {
+        if (depth > fs_limit.max_depth || !m->parent[ino]) return NULL;
+        const char *name = m->names + m->name_off[ino];
+        size_t len = strlen(name);
+        if ((size_t)(p - buf) < len + 1) return NULL;
+        if (*p) *--p = '/';
+        p -= len;
+        memcpy(p, name, len);
+        ino = m->parent[ino];
     }
+    return p;
+}
+
+static char mode_type(uint16_t mode) {
+    if (S_ISDIR(mode)) return 'd';
+    if (S_ISLNK(mode)) return 'l';
+    if (S_ISCHR(mode)) return 'c';
+    if (S_ISBLK(mode)) return 'b';
+    if (S_ISFIFO(mode)) return 'p';
+    if (S_ISSOCK(mode)) return 's';
+    return '-';
+}
 
-    // Single / double / triple indirect blocks
-    uint32_t ptrs = block_size / sizeof(uint32_t);
-    for (int lvl = 1; lvl <= 3; lvl++) {
-        int idx = (lvl == 1 ? EXT2_IND_BLOCK :
-                   lvl == 2 ? EXT2_DIND_BLOCK : EXT2_TIND_BLOCK);
-        uint32_t iblk = inode->i_block[idx];
-        if (!iblk) continue;
-
-        uint32_t *ind = malloc(block_size);
-        if (!ind) return;
-        if (fseek(fp, (uint64_t)iblk * block_size, SEEK_SET) == 0 &&
-            fread(ind, block_size, 1, fp) == 1)
-        {
-            for (uint32_t j = 0; j < ptrs; j++) {
-                if (!ind[j]) continue;
-
-                uint8_t *buf = malloc(block_size);
-                if (!buf) continue;
-                if (fseek(fp, (uint64_t)ind[j] * block_size, SEEK_SET)==0 &&
-                    fread(buf, block_size, 1, fp)==1)
-                {
-                    uint32_t off = 0;
-                    while (off < block_size) {
-                        ext2_dir_entry *e = (ext2_dir_entry*)(buf + off);
-                        if (e->rec_len == 0 || off + e->rec_len > block_size) break;
-
-                        char name[256] = {0};
-                        int len = e->name_len < 255 ? e->name_len : 255;
-                        memcpy(name, e->name, len);
-                        name[len] = '\0';
-
-                        if (e->inode!=0 &&
-                            strcmp(name,".") &&
-                            strcmp(name,".."))
-                        {
-                            int is_last = (off + e->rec_len >= block_size);
-                            printf("%s%s%s\n",
-                                   prefix,
-                                   is_last ? "└── " : "├── ",
-                                   name);
-
-                            int is_dir = (e->file_type == EXT2_FT_DIR);
-                            if (!is_dir) {
-                                ext2_inode tmp;
-                                if (read_inode_ext2(fp, e->inode, &tmp)==0 &&
-                                    S_ISDIR(tmp.i_mode))
-                                    is_dir = 1;
-                            }
-                            if (is_dir) {
-                                size_t L = strlen(prefix)+4+1;
-                                char *p2 = malloc(L);
-                                strcpy(p2,prefix);
-                                strcat(p2, is_last ? "    " : "│   ");
-                                ext2_inode sub;
-                                if (read_inode_ext2(fp,e->inode,&sub)==0)
-                                    tree_ext2_subdir(fp,&sub,p2);
-                                free(p2);
-                            }
-                        }
-                        off += e->rec_len;
+/**
+ * Inventory of every inode in use ("--list-inodes"), in inode-table order.
+ * Each group's inode table is streamed in large sequential reads, skipping
+ * the ranges its inode bitmap marks as free. Directories are read once
+ * afterwards, in on-disk order, to build a parent/name map from which the
+ * full path of every inode is rebuilt without walking the tree.
+ *
+ * @param filename Ruta al archivo de imagen EXT2.
+ */
+void list_inodes_ext2(const char *filename) {
+    if (!load_superblock_ext2(filename)) return;
+
+    FILE *fp = image_open(filename);
+    if (!fp) { perror("fopen"); return; }
+
+    uint32_t groups = (sb.s_blocks_count - sb.s_first_data_block + sb.s_blocks_per_group - 1)
+                      / sb.s_blocks_per_group;
+    uint32_t inode_size = sb.s_rev_level == 0 ? 128 : sb.s_inode_size;
+    uint32_t first_ino = sb.s_rev_level == 0 ? 11 : sb.s_first_ino;
+    uint32_t per_chunk = EXT2_RECOVER_CHUNK / inode_size;
+    if (per_chunk > sb.s_inodes_per_group) per_chunk = sb.s_inodes_per_group;
+
+    uint8_t *bitmap = malloc(block_size);
+    uint8_t *table = malloc((size_t)per_chunk * inode_size);
+    ext2_list_item *items = NULL;
+    ext2_list_dir *dirs = NULL;
+    uint32_t nitems = 0, items_cap = 0, ndirs = 0, dirs_cap = 0;
+    if (!bitmap || !table || inode_size < sizeof(ext2_inode) || sb.s_inodes_per_group > block_size * 8) {
+        free(bitmap);
+        free(table);
+        fclose(fp);
+        return;
+    }
+
+    // 1. Tablas de inodos en orden, leyendo solo los tramos con inodos en uso
+    for (uint32_t g = 0; g < groups; g++) {
+        ext2_group_desc gd;
+        if (read_group_desc_ext2(fp, g, &gd) != 0) break;
+        if (fseeko(fp, (uint64_t)gd.bg_inode_bitmap * block_size, SEEK_SET) != 0 ||
+            fread(bitmap, block_size, 1, fp) != 1) continue;
+
+        for (uint32_t start = 0; start < sb.s_inodes_per_group; start += per_chunk) {
+            uint32_t end = start + per_chunk < sb.s_inodes_per_group ? start + per_chunk : sb.s_inodes_per_group;
+            uint32_t lo = start, hi = end;
+            while (lo < hi && !bitmap_test(bitmap, lo)) lo++;
+            while (hi > lo && !bitmap_test(bitmap, hi - 1)) hi--;
+            if (lo == hi) continue;
+
+            uint64_t off = (uint64_t)gd.bg_inode_table * block_size + (uint64_t)lo * inode_size;
+            if (fseeko(fp, off, SEEK_SET) != 0 || fread(table, (size_t)(hi - lo) * inode_size, 1, fp) != 1) continue;
+
+            for (uint32_t i = lo; i < hi; i++) {
+                uint32_t ino = g * sb.s_inodes_per_group + i + 1;
+                if (!bitmap_test(bitmap, i) || (ino < first_ino && ino != EXT2_ROOT_INO)) continue;
+                ext2_inode inode;
+                memcpy(&inode, table + (size_t)(i - lo) * inode_size, sizeof(inode));
+                if (inode.i_mode == 0) continue;
+
+                if (nitems == items_cap) {
+                    items_cap = items_cap ? items_cap * 2 : 1024;
+                    ext2_list_item *tmp = realloc(items, items_cap * sizeof(ext2_list_item));
+                    if (!tmp) goto out;
+                    items = tmp;
+                }
+                ext2_list_item *it = &items[nitems++];
+                it->ino = ino;
+                it->mode = inode.i_mode;
+                it->links = inode.i_links_count;
+                it->uid = (uint32_t)(inode.osd2[4] | inode.osd2[5] << 8) << 16 | inode.i_uid;
+                it->gid = (uint32_t)(inode.osd2[6] | inode.osd2[7] << 8) << 16 | inode.i_gid;
+                it->mtime = inode.i_mtime;
+                it->size = ext2_file_size(&inode);
+
+                if (S_ISDIR(inode.i_mode)) {
+                    if (ndirs == dirs_cap) {
+                        dirs_cap = dirs_cap ? dirs_cap * 2 : 256;
+                        ext2_list_dir *tmp = realloc(dirs, dirs_cap * sizeof(ext2_list_dir));
+                        if (!tmp) goto out;
+                        dirs = tmp;
                     }
+                    // Un i_size corrupto no puede hacernos leer más que el límite
+                    if (inode.i_size > fs_limit.max_dir_bytes) inode.i_size = fs_limit.max_dir_bytes;
+                    dirs[ndirs].ino = ino;
+                    dirs[ndirs].first = bmap_ext2(fp, &inode, 0);
+                    dirs[ndirs++].inode = inode;
                 }
-                free(buf);
             }
         }
-        free(ind);
     }
+
+    // 2. Directorios por su primer bloque, para leerlos casi en secuencia
+    ext2_name_map map;
+    memset(&map, 0, sizeof(map));
+    map.parent = calloc((size_t)sb.s_inodes_count + 1, sizeof(uint32_t));
+    map.name_off = calloc((size_t)sb.s_inodes_count + 1, sizeof(uint32_t));
+    if (map.parent && map.name_off) {
+        if (ndirs > 1) qsort(dirs, ndirs, sizeof(ext2_list_dir), cmp_list_dir);
+        for (uint32_t d = 0; d < ndirs; d++) {
+            ext2_dir_view *v = calloc(1, sizeof(ext2_dir_view));
+            if (!v) break;
+            ext2_for_each_block(fp, &dirs[d].inode, dir_view_decode_block, v);
+            for (uint32_t i = 0; i < v->count; i++) {
+                if (is_dot_entry(v, i)) continue;
+                if (name_map_add(&map, dirs[d].ino, v->inodes[i], v->names + v->name_off[i], v->name_len[i]) != 0) break;
+            }
+            dir_view_free(v);
+        }
+
+        // 3. Todos los inodos en orden de tabla, con su ruta
+        char *buf = malloc(EXT2_PATH_MAX);
+        fprintf(fs_out(), "\n------ Inode List ------\n\n");
+        fprintf(fs_out(), "  Inode      Type Mode  Links UID    GID    Size         Modified                  Path\n");
+        for (uint32_t i = 0; buf && i < nitems; i++) {
+            const ext2_list_item *it = &items[i];
+            const char *path = name_map_path(&map, it->ino, buf, EXT2_PATH_MAX);
+            fprintf(fs_out(), "  %-10u %c    %04o  %-5u %-6u %-6u %-12llu %-25s %s\n", it->ino, mode_type(it->mode),
+                              it->mode & 07777, it->links, it->uid, it->gid, (unsigned long long)it->size,
+                              format_time(it->mtime), path ? path : "?");
+        }
+        free(buf);
+
+        fprintf(fs_out(), "\n  Inodes in use....: %u\n", nitems);
+        fprintf(fs_out(), "  Directories......: %u\n", ndirs);
+    }
+    free(map.parent);
+    free(map.name_off);
+    free(map.names);
+
+out:
+    free(items);
+    free(dirs);
+    free(bitmap);
+    free(table);
+    fclose(fp);
 }
 
 /**
- * Escanea un bloque de directorio buscando una entrada con nombre dado.
- * @param fp       Puntero al fichero de imagen EXT2.
- * @param block    Número de bloque a leer.
- * @param name     Nombre de la entrada a buscar.
- * @return Número de inodo si se encuentra, 0 en caso contrario.
+ * Hash of a (parent directory, name) pair for the dentry cache (FNV-1a).
  */
-static uint32_t scan_dir_block(FILE *fp, uint32_t block, const char *name) {
-    uint8_t *buf = malloc(block_size);
-    if (!buf) return 0;
-    if (fseek(fp, block * block_size, SEEK_SET) ||
-        fread(buf, block_size, 1, fp)!=1) {
-        free(buf);
-        return 0;
-    }
-    uint32_t off = 0;
-    while (off < block_size) {
-        ext2_dir_entry *e = (ext2_dir_entry*)(buf + off);
-        if (e->rec_len==0) break;
-        char en[256]={0};
-        int len = e->name_len<255?e->name_len:255;
-        memcpy(en, e->name, len);
-        en[len]='\0';
-        if (e->inode && strcmp(en,name)==0) {
-            uint32_t in = e->inode;
-            free(buf);
-            return in;
-        }
-        off += e->rec_len;
-    }
-    free(buf);
-    return 0;
+static uint32_t dentry_hash(uint32_t dir, const char *name, size_t len) {
+    uint32_t h = 2166136261u ^ dir;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)name[i]) * 16777619u;
+    return h;
 }
 
 /**
- * Escanea recursivamente bloques indirectos de un inodo como si fuesen bloques de directorio.
- * @param fp       Puntero al fichero de imagen EXT2.
- * @param block    Bloque indirecto a procesar.
- * @param level    1=single, 2=double, 3=triple indirect.
- * @param name     Nombre de la entrada buscada.
- * @return Número de inodo si se encuentra, 0 en caso contrario.
+ * Busca en un único directorio la entrada con nombre dado. El resultado, sea
+ * cual sea, se guarda en la caché de dentries, así que cada (directorio,
+ * nombre) se busca en el directorio una sola vez.
+ * @param fp     Puntero al fichero de imagen EXT2.
+ * @param dir    Número de inodo del directorio.
+ * @param name   Nombre de la entrada (no tiene por qué acabar en NUL).
+ * @param len    Longitud del nombre.
+ * @param type   Salida: file_type de la entrada.
+ * @return Número de inodo encontrado, o 0 si no existe.
  */
-static uint32_t scan_indirect_blocks(FILE *fp, uint32_t block, int level, const char *name)
-{
-    if (!block||level<1) return 0;
-    uint32_t ptrs = block_size/sizeof(uint32_t);
-    uint32_t *ib=malloc(block_size);
-    if (!ib) return 0;
-    if (fseek(fp, block*block_size, SEEK_SET)||
-        fread(ib, block_size,1,fp)!=1){
-        free(ib);
-        return 0;
+static uint32_t find_inode_in_dir(FILE *fp, uint32_t dir, const char *name, size_t len, uint8_t *type) {
+    *type = EXT2_FT_UNKNOWN;
+    if (len == 0 || len > EXT2_NAME_LEN) return 0;
+
+    ext2_dentry_cache_slot *slot = &dentry_cache[dentry_hash(dir, name, len) % EXT2_DENTRY_CACHE_SLOTS];
+    if (slot->fp == fp && slot->parent == dir && slot->name_len == len && memcmp(slot->name, name, len) == 0) {
+        *type = slot->type;
+        return slot->ino;
     }
-    for(uint32_t i=0;i<ptrs;i++){
-        if (!ib[i]) continue;
-        if (level==1){
-            uint32_t found = scan_dir_block(fp, ib[i], name);
-            if (found){ free(ib); return found; }
-        } else {
-            uint32_t found = scan_indirect_blocks(fp, ib[i], level-1, name);
-            if (found){ free(ib); return found; }
+
+    const ext2_dir_view *v = ext2_dir_view_get(fp, dir);
+    if (!v) return 0;
+
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < v->count && !found; i++) {
+        if (v->name_len[i] == len && memcmp(v->names + v->name_off[i], name, len) == 0) {
+            found = v->inodes[i];
+            *type = v->types[i];
         }
     }
-    free(ib);
-    return 0;
+    ext2_dir_view_put(v);
+
+    slot->fp = fp;
+    slot->parent = dir;
+    slot->ino = found;
+    slot->type = *type;
+    slot->name_len = len;
+    memcpy(slot->name, name, len);
+    return found;
 }
 
 /**
- * Busca en un único inodo de directorio (directos + indirectos) la entrada con nombre dado.
+ * Type of a directory entry: its file_type with the FILETYPE feature, the
+ * type derived from the inode mode otherwise.
+ *
+ * @param fp   Puntero al fichero de imagen EXT2.
+ * @param ino  Inodo de la entrada.
+ * @param type file_type guardado en la entrada.
+ * @return EXT2_FT_DIR, EXT2_FT_SYMLINK, EXT2_FT_REG_FILE o EXT2_FT_UNKNOWN.
+ */
+uint8_t ext2_entry_type(FILE *fp, uint32_t ino, uint8_t type) {
+    if (trust_file_type) return type;
+    ext2_inode tmp;
+    if (read_inode_ext2(fp, ino, &tmp) != 0) return EXT2_FT_UNKNOWN;
+    if (S_ISDIR(tmp.i_mode)) return EXT2_FT_DIR;
+    if (S_ISLNK(tmp.i_mode)) return EXT2_FT_SYMLINK;
+    return S_ISREG(tmp.i_mode) ? EXT2_FT_REG_FILE : EXT2_FT_UNKNOWN;
+}
+
+/**
+ * Resuelve una ruta de la raíz (p.ej., "dir1/dir2/file") a su número de inodo,
+ * sea del tipo que sea. La ruta vacía o "/" es la raíz. Los enlaces
+ * simbólicos intermedios se siguen siempre (los relativos desde el directorio
+ * que los contiene); el último solo si follow es TRUE.
  * @param fp     Puntero al fichero de imagen EXT2.
- * @param inode  Puntero al inodo de directorio.
- * @param name   Nombre de la entrada a buscar.
- * @return Número de inodo encontrado, o 0 si no existe.
+ * @param path   Ruta dentro del sistema de ficheros.
+ * @param follow TRUE para seguir también el último componente si es un enlace.
+ * @return Número de inodo si existe, 0 si no existe o hay más de
+ *         EXT2_MAX_SYMLINKS enlaces por el camino.
  */
-static uint32_t find_inode_in_dir(FILE *fp, ext2_inode *inode, const char *name) {
-    // direct blocks
-    for(int i=0;i<EXT2_NDIR_BLOCKS;i++){
-        uint32_t blk = inode->i_block[i];
-        if (!blk) continue;
-        uint32_t f = scan_dir_block(fp, blk, name);
-        if (f) return f;
-    }
-    // indirect levels
-    int idxs[3] = { EXT2_IND_BLOCK,
-                    EXT2_DIND_BLOCK,
-                    EXT2_TIND_BLOCK };
-    for(int lvl=0;lvl<3;lvl++){
-        uint32_t ib = inode->i_block[ idxs[lvl] ];
-        if (!ib) continue;
-        uint32_t f = scan_indirect_blocks(fp, ib, lvl+1, name);
-        if (f) return f;
+uint32_t lookup_path_ext2(FILE *fp, const char *path, int follow) {
+    return lookup_at_ext2(fp, EXT2_ROOT_INO, path, follow);
+}
+
+/**
+ * Like lookup_path_ext2, but relative paths start at directory dir.
+ */
+static uint32_t lookup_at_ext2(FILE *fp, uint32_t dir, const char *path, int follow) {
+    if (*path == '/') dir = EXT2_ROOT_INO;
+    uint32_t ino = dir;
+    char *pending = NULL;           // Ruta que queda tras expandir un enlace
+    int links = 0;
+
+    for (const char *p = path; ino; ) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        size_t len = strcspn(p, "/");
+        const char *rest = p + len;
+        int last = rest[strspn(rest, "/")] == '\0';
+
+        uint8_t type;
+        ino = find_inode_in_dir(fp, dir, p, len, &type);
+        if (!ino || (last && !follow)) break;
+        type = ext2_entry_type(fp, ino, type);
+
+        if (type == EXT2_FT_SYMLINK) {
+            char target[EXT2_PATH_MAX];
+            ext2_inode link;
+            if (++links > EXT2_MAX_SYMLINKS || read_inode_ext2(fp, ino, &link) != 0 ||
+                readlink_ext2(fp, &link, target, sizeof(target)) != 0 || !target[0]) {
+                ino = 0;
+                break;
+            }
+            size_t tlen = strlen(target), rlen = strlen(rest);
+            char *next = malloc(tlen + rlen + 1);
+            if (!next) { ino = 0; break; }
+            memcpy(next, target, tlen);
+            memcpy(next + tlen, rest, rlen + 1);
+            free(pending);
+            p = pending = next;
+            if (target[0] == '/') dir = EXT2_ROOT_INO;
+            ino = dir;
+            continue;
+        }
+        if (!last && type != EXT2_FT_DIR) {
+            ino = 0;
+            break;
+        }
+        dir = ino;
+        p = rest;
     }
-    return 0;
+
+    free(pending);
+    return ino;
+}
+
+/**
+ * Keep ino only if it is a regular file.
+ */
+static uint32_t regular_or_zero(FILE *fp, uint32_t ino) {
+    ext2_inode node;
+    if (!ino || read_inode_ext2(fp, ino, &node) < 0) return 0;
+    return S_ISREG(node.i_mode) ? ino : 0;
 }
 
 /**
- * @brief Resuelve una ruta de la raíz (p.ej., "dir1/dir2/file") a su número de inodo.
+ * @brief Resuelve una ruta de la raíz (p.ej., "dir1/dir2/file") a su número de
+ * inodo, siguiendo los enlaces simbólicos.
  * @param fp     Puntero al fichero de imagen EXT2.
  * @param path   Ruta dentro del sistema de ficheros.
  * @return Número de inodo si existe y es fichero regular, 0 en caso contrario.
  */
 static uint32_t find_inode_by_path(FILE *fp, const char *path){
-    uint32_t ino = EXT2_ROOT_INO;
-    ext2_inode node;
-    if (read_inode_ext2(fp, ino, &node)<0) return 0;
-    char *p = strdup(path), *tok = strtok(p,"/");
-    while(tok){
-        uint32_t nxt = find_inode_in_dir(fp, &node, tok);
-        if (!nxt){ free(p); return 0; }
-        ino = nxt;
-        if (read_inode_ext2(fp, ino, &node)<0){ free(p); return 0; }
-        tok = strtok(NULL,"/");
-    }
-    free(p);
-    return S_ISREG(node.i_mode) ? ino : 0;
+    return regular_or_zero(fp, lookup_path_ext2(fp, path, TRUE));
 }
 
 /**
- * Recorre un inodo de directorio completo (directos + indirectos + subdirectorios)
- * buscando una entrada target. Marca file_found_flag y file_found_inode si la halla.
+ * Recorre un directorio completo y sus subdirectorios buscando una entrada
+ * target. Marca file_found_flag, file_found_inode y file_found_dir (el
+ * directorio que la contiene) si la halla.
  * @param fp     Puntero al fichero de imagen EXT2.
- * @param inode  Puntero al inodo de directorio raíz de la búsqueda.
- * @param target Nombre de fichero a localizar.
- */
-static void search_dir_block(FILE *fp, uint32_t block, const char *t){
-    uint8_t *buf=malloc(block_size);
-    if(!buf) return;
-    if(fseek(fp,block*block_size,SEEK_SET)|| fread(buf,block_size,1,fp)!=1){
-        free(buf); return;
-    }
-    uint32_t off=0;
-    while(off<block_size && !file_found_flag){
-        ext2_dir_entry *e = (ext2_dir_entry*)(buf+off);
-        if(e->rec_len==0) break;
-        char nm[256]={0};
-        int ln = e->name_len<255?e->name_len:255;
-        memcpy(nm,e->name,ln); nm[ln]='\0';
-        if(e->inode && strcmp(nm,t)==0){
+ * @param ino    Inodo del directorio raíz de la búsqueda.
+ * @param t      Nombre de fichero a localizar.
+ * @param parent Directorio padre en el recorrido (NULL para la raíz).
+ */
+static void search_dir(FILE *fp, uint32_t ino, const char *t, const fs_walk *parent){
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, ino)) return;
+    const ext2_dir_view *v = ext2_dir_view_get(fp, ino);
+    if (!v) return;
+
+    size_t len = strlen(t);
+    for (uint32_t i = 0; i < v->count && !file_found_flag; i++) {
+        if (v->name_len[i] == len && memcmp(v->names + v->name_off[i], t, len) == 0) {
             file_found_flag  = TRUE;
-            file_found_inode = e->inode;
-            break;
+            file_found_inode = v->inodes[i];
+            file_found_dir   = ino;
         }
-        off += e->rec_len;
     }
-    free(buf);
+    // recurse subdirs
+    for (uint32_t i = 0; i < v->count && !file_found_flag; i++) {
+        if (!is_dot_entry(v, i) && is_dir_entry(fp, v, i))
+            search_dir(fp, v->inodes[i], t, &node);
+    }
+
+    ext2_dir_view_put(v);
 }
 
 /**
- * Escanea bloques indirectos buscando en cada bloque de directorio el fichero target.
- * @param fp       Puntero al fichero de imagen EXT2.
- * @param block    Bloque indirecto a procesar.
- * @param level    Nivel de indirección (1, 2 o 3).
- * @param target   Nombre de fichero a localizar.
+ * Recursive helper for collect_files_ext2.
+ *
+ * @param fp   Puntero al fichero de imagen EXT2.
+ * @param ino  Inodo del directorio.
+ * @param path Ruta del directorio ("" para la raíz).
+ * @param out  Lista de ficheros de salida.
+ * @param parent Directorio padre en el recorrido (NULL para el inicial).
  */
-static void search_indirect(FILE *fp, uint32_t block, int lvl, const char *t){
-    if(!block||lvl<1) return;
-    uint32_t ptrs = block_size/sizeof(uint32_t);
-    uint32_t *ib=malloc(block_size);
-    if(!ib) return;
-    if(fseek(fp,block*block_size,SEEK_SET)|| fread(ib,block_size,1,fp)!=1){
-        free(ib); return;
+static void collect_dir_ext2(FILE *fp, uint32_t ino, const char *path, fs_file_list *out, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, ino)) return;
+    const ext2_dir_view *v = ext2_dir_view_get(fp, ino);
+    if (!v) return;
+
+    for (uint32_t i = 0; i < v->count; i++) {
+        if (is_dot_entry(v, i)) continue;
+        char *child = path_join(path, v->names + v->name_off[i]);
+        if (!child) break;
+
+        if (is_dir_entry(fp, v, i)) {
+            collect_dir_ext2(fp, v->inodes[i], child, out, &node);
+        } else if (!trust_file_type || v->types[i] == EXT2_FT_REG_FILE) {
+            ext2_inode inode;
+            if (read_inode_ext2(fp, v->inodes[i], &inode) == 0 && S_ISREG(inode.i_mode))
+                fs_file_list_add(out, child, ext2_file_size(&inode), bmap_ext2(fp, &inode, 0), v->inodes[i]);
+        }
+        free(child);
     }
-    for(uint32_t i=0;i<ptrs&&!file_found_flag;i++){
-        if(!ib[i]) continue;
-        if(lvl==1) search_dir_block(fp, ib[i], t);
-        else      search_indirect(fp, ib[i], lvl-1, t);
+
+    ext2_dir_view_put(v);
+}
+
+/**
+ * Collect every regular file under a path (a directory or a single file).
+ *
+ * @param fp   Puntero al fichero de imagen EXT2.
+ * @param path Ruta de inicio ("" o "/" para la raíz).
+ * @param out  Lista de ficheros de salida.
+ * @return 0 si tiene éxito, -1 si la ruta no existe.
+ */
+int collect_files_ext2(FILE *fp, const char *path, fs_file_list *out) {
+    uint32_t ino = lookup_path_ext2(fp, path, TRUE);
+    ext2_inode inode;
+    if (!ino || read_inode_ext2(fp, ino, &inode) != 0) return -1;
+
+    // Ruta normalizada, sin '/' al principio ni al final
+    while (*path == '/') path++;
+    char *base = strdup(path);
+    if (!base) return -1;
+    for (size_t n = strlen(base); n > 0 && base[n - 1] == '/'; n--) base[n - 1] = '\0';
+
+    if (S_ISDIR(inode.i_mode)) {
+        fs_walk top;
+        fs_walk_begin(&top);
+        collect_dir_ext2(fp, ino, base, out, &top);
+        fs_walk_end(&top);
+    } else if (S_ISREG(inode.i_mode)) fs_file_list_add(out, base, ext2_file_size(&inode), bmap_ext2(fp, &inode, 0), ino);
+    free(base);
+    return 0;
+}
+
+/**
+ * Get pointer block `block` from the block cache, reading it on a miss.
+ *
+ * @param fp    Puntero al fichero de imagen EXT2.
+ * @param block Número de bloque de punteros.
+ * @return Contenido del bloque, o NULL en caso de error.
+ */
+static const uint32_t *cached_pointer_block(FILE *fp, uint32_t block) {
+    if (!valid_block(block)) return NULL;
+    ext2_block_cache_slot *slot = &block_cache[block % EXT2_BLOCK_CACHE_SLOTS];
+    if (slot->data && slot->fp == fp && slot->block == block) return slot->data;
+
+    if (!slot->data) slot->data = malloc(block_size);
+    if (!slot->data) return NULL;
+    if (fseeko(fp, (uint64_t)block * block_size, SEEK_SET) != 0 ||
+        fread(slot->data, block_size, 1, fp) != 1) {
+        slot->block = 0;
+        return NULL;
     }
-    free(ib);
+    slot->fp = fp;
+    slot->block = block;
+    return slot->data;
 }
 
 /**
- * Recorre un inodo de directorio completo (directos + indirectos + subdirectorios)
- * buscando una entrada target. Marca file_found_flag y file_found_inode si la halla.
- * @param fp     Puntero al fichero de imagen EXT2.
- * @param inode  Puntero al inodo de directorio raíz de la búsqueda.
- * @param target Nombre de fichero a localizar.
- */
-static void search_dir(FILE *fp, ext2_inode *node, const char *t){
-    // direct
-    for(int i=0;i<EXT2_NDIR_BLOCKS&&!file_found_flag;i++){
-        if(node->i_block[i]) search_dir_block(fp, node->i_block[i], t);
-    }
-    // indirect
-    int idxs[3]={EXT2_IND_BLOCK,EXT2_DIND_BLOCK,EXT2_TIND_BLOCK};
-    for(int l=0;l<3&&!file_found_flag;l++){
-        if(node->i_block[idxs[l]])
-            search_indirect(fp,node->i_block[idxs[l]],l+1,t);
-    }
-    // recurse subdirs (solo direct para simplicidad)
-    for(int i=0;i<EXT2_NDIR_BLOCKS&&!file_found_flag;i++){
-        uint32_t blk=node->i_block[i];
-        if(!blk) continue;
-        uint8_t *buf=malloc(block_size);
-        if(fseek(fp,blk*block_size,SEEK_SET)|| fread(buf,block_size,1,fp)!=1){
-            free(buf); continue;
+ * Entry `idx` of pointer block `block`, or 0 for a hole.
+ */
+static uint32_t pointer_at(FILE *fp, uint32_t block, uint64_t idx) {
+    if (!block) return 0;
+    const uint32_t *ptrs = cached_pointer_block(fp, block);
+    return ptrs ? ptrs[idx] : 0;
+}
+
+/**
+ * Map a logical block of an extent-mapped file. Every node is binary-searched
+ * for the last entry starting at or before `lblk`; nodes below the root come
+ * from the pointer-block cache.
+ *
+ * @param fp    Puntero al fichero de imagen EXT2.
+ * @param inode Inodo del fichero (con EXT4_EXTENTS_FL).
+ * @param lblk  Bloque lógico dentro del fichero.
+ * @param run   Salida: bloques desde lblk con el mismo mapeo (contiguos en
+ *              disco, o hueco), al menos 1.
+ * @return Bloque físico, 0 si es un hueco, no está inicializado o el árbol
+ *         está corrupto, o -1 si el bloque no cabe en 32 bits.
+ */
+static int64_t extent_map(FILE *fp, const ext2_inode *inode, uint64_t lblk, uint64_t *run) {
+    *run = 1;
+    if (lblk > UINT32_MAX) return 0;
+    const ext4_extent_header *h = extent_node(inode->i_block, sizeof(inode->i_block), -1);
+    uint64_t end = (uint64_t)UINT32_MAX + 1;     // Inicio del siguiente tramo conocido
+
+    while (h && h->eh_entries > 0) {
+        // Última entrada con primer bloque <= lblk; las entradas miden lo mismo en ambos tipos de nodo
+        const uint32_t *first = (const uint32_t *)(h + 1);
+        const size_t stride = sizeof(ext4_extent) / sizeof(uint32_t);
+        uint32_t lo = 0, hi = h->eh_entries;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (first[mid * stride] <= lblk) lo = mid;
+            else hi = mid;
+        }
+        if (lo + 1 < h->eh_entries && first[(lo + 1) * stride] < end) end = first[(lo + 1) * stride];
+        if (first[lo * stride] > lblk) {
+            *run = end - lblk;                          // Hueco antes del primer tramo
+            return 0;
         }
-        uint32_t off=0;
-        while(off<block_size&&!file_found_flag){
-            ext2_dir_entry*e=(ext2_dir_entry*)(buf+off);
-            if(e->rec_len==0) break;
-            if(e->inode==0 || e->file_type!=EXT2_FT_DIR){
-                off+=e->rec_len; continue;
+
+        if (h->eh_depth == 0) {
+            const ext4_extent *ex = (const ext4_extent *)(h + 1) + lo;
+            uint32_t len = ex->ee_len > EXT4_EXT_INIT_MAX ? ex->ee_len - EXT4_EXT_INIT_MAX : ex->ee_len;
+            uint64_t off = lblk - ex->ee_block;
+            if (off >= len) {
+                *run = end - lblk;                      // Hueco tras el tramo
+                return 0;
             }
-            char nm2[256]={0};
-            int ln2=e->name_len<255?e->name_len:255;
-            memcpy(nm2,e->name,ln2); nm2[ln2]='\0';
-            if(strcmp(nm2,".")&&strcmp(nm2,"..")){
-                ext2_inode sub;
-                if(read_inode_ext2(fp,e->inode,&sub)==0)
-                    search_dir(fp,&sub,t);
+            *run = len - off;
+            uint64_t pblk = (uint64_t)ex->ee_start_lo + off;
+            if (ex->ee_len > EXT4_EXT_INIT_MAX) return 0;
+            if (ex->ee_start_hi) return extent_unsupported();
+            if (pblk + *run - 1 > UINT32_MAX) return -1;
+            return pblk;
+        }
+
+        const ext4_extent_idx *ix = (const ext4_extent_idx *)(h + 1) + lo;
+        if (ix->ei_leaf_hi) return extent_unsupported();
+        const uint32_t *node = cached_pointer_block(fp, ix->ei_leaf_lo);
+        h = node ? extent_node(node, block_size, h->eh_depth - 1) : NULL;
+    }
+    return 0;
+}
+
+/**
+ * Map a logical block of a file to its physical block. The indirection level
+ * and the index at each level are computed arithmetically, so at most three
+ * (cached) pointer blocks are read whatever the offset.
+ *
+ * @param fp    Puntero al fichero de imagen EXT2.
+ * @param inode Inodo del fichero.
+ * @param lblk  Bloque lógico dentro del fichero.
+ * @return Bloque físico, o 0 si es un hueco o está fuera de rango.
+ */
+uint32_t bmap_ext2(FILE *fp, const ext2_inode *inode, uint64_t lblk) {
+    uint64_t ptrs = block_size / sizeof(uint32_t);
+    uint64_t run;
+
+    if (inode->i_flags & EXT4_EXTENTS_FL) {
+        int64_t pblk = extent_map(fp, inode, lblk, &run);
+        return pblk > 0 ? pblk : 0;
+    }
+
+    if (lblk < EXT2_NDIR_BLOCKS) return inode->i_block[lblk];
+    lblk -= EXT2_NDIR_BLOCKS;
+
+    if (lblk < ptrs) return pointer_at(fp, inode->i_block[EXT2_IND_BLOCK], lblk);
+    lblk -= ptrs;
+
+    if (lblk < ptrs * ptrs) {
+        uint32_t b = pointer_at(fp, inode->i_block[EXT2_DIND_BLOCK], lblk / ptrs);
+        return pointer_at(fp, b, lblk % ptrs);
+    }
+    lblk -= ptrs * ptrs;
+
+    if (lblk < ptrs * ptrs * ptrs) {
+        uint32_t b1 = pointer_at(fp, inode->i_block[EXT2_TIND_BLOCK], lblk / (ptrs * ptrs));
+        uint32_t b2 = pointer_at(fp, b1, (lblk / ptrs) % ptrs);
+        return pointer_at(fp, b2, lblk % ptrs);
+    }
+    return 0;
+}
+
+/**
+ * Read a byte range of a file. Physically contiguous blocks are fetched with
+ * a single read (a whole extent at a time on ext4) and holes read back as
+ * zeros.
+ *
+ * @param fp     Puntero al fichero de imagen EXT2.
+ * @param inode  Inodo del fichero.
+ * @param offset Desplazamiento inicial dentro del fichero.
+ * @param buf    Buffer de salida.
+ * @param len    Bytes a leer como máximo.
+ * @return Bytes leídos (0 al final del fichero), o -1 en caso de error.
+ */
+int64_t read_file_ext2(FILE *fp, const ext2_inode *inode, uint64_t offset, void *buf, size_t len) {
+    uint64_t size = ext2_file_size(inode);
+    if (offset >= size) return 0;
+    if (len > size - offset) len = size - offset;
+
+    uint8_t *out = buf;
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint64_t lblk = pos / block_size;
+        uint32_t boff = pos % block_size;
+        uint32_t pblk;
+        size_t n = block_size - boff;
+
+        if (inode->i_flags & EXT4_EXTENTS_FL) {
+            // Un extent es un único tramo contiguo: se lee de una vez
+            uint64_t run;
+            int64_t m = extent_map(fp, inode, lblk, &run);
+            if (m < 0) return -1;
+            pblk = m;
+            if (run - 1 < (len - done) / block_size + 1) n += (run - 1) * block_size;
+            else n = len - done;
+        } else {
+            pblk = bmap_ext2(fp, inode, lblk);
+            // Extendemos la lectura mientras los bloques sigan contiguos en disco
+            while (pblk && done + n < len && bmap_ext2(fp, inode, lblk + 1) == pblk + (n + boff) / block_size) {
+                n += block_size;
+                lblk++;
             }
-            off += e->rec_len;
         }
-        free(buf);
+        if (n > len - done) n = len - done;
+        if (pblk && (!valid_block(pblk) || pblk + (uint64_t)(boff + n - 1) / block_size >= sb.s_blocks_count)) return -1;
+
+        if (!pblk) {
+            memset(out + done, 0, n);
+        } else if (fseeko(fp, (uint64_t)pblk * block_size + boff, SEEK_SET) != 0 ||
+                   fread(out + done, n, 1, fp) != 1) {
+            return -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+/**
+ * Read the target of a symbolic link. Short targets ("fast symlinks") are
+ * stored inline in i_block; longer ones live in the first data block.
+ *
+ * @param fp    Puntero al fichero de imagen EXT2.
+ * @param inode Inodo del enlace.
+ * @param buf   Buffer de salida (se NUL-termina).
+ * @param size  Tamaño del buffer.
+ * @return 0 si tiene éxito, -1 si el inodo no es un enlace o hay error.
+ */
+int readlink_ext2(FILE *fp, const ext2_inode *inode, char *buf, size_t size) {
+    if (!S_ISLNK(inode->i_mode) || size == 0) return -1;
+    size_t len = inode->i_size < size - 1 ? inode->i_size : size - 1;
+
+    if (inode->i_blocks == 0 && inode->i_size < sizeof(inode->i_block)) {
+        memcpy(buf, inode->i_block, len);
+    } else if (read_file_ext2(fp, inode, 0, buf, len) != (int64_t)len) {
+        return -1;
     }
+    buf[len] = '\0';
+    return 0;
 }
 
 /**
  * Implementa “cat” en EXT2: busca el inodo por nombre o ruta y vuelca sus bloques.
  * @param filename Ruta a la imagen EXT2.
  * @param target   Nombre (o ruta) de fichero a imprimir.
+ * @param offset   Primer byte a imprimir.
+ * @param length   Bytes a imprimir como máximo (CAT_TO_END = hasta el final).
  */
-void cat_ext2(const char *filename, const char *target) {
-    if (!read_ext2_superblock(filename, &sb)) return;
-    block_size = 1024 << sb.s_log_block_size;
+void cat_ext2(const char *filename, const char *target, uint64_t offset, uint64_t length) {
+    if (!load_superblock_ext2(filename)) return;
 
-    FILE *fp = fopen(filename, "rb");
+    FILE *fp = image_open(filename);
     if (!fp) { perror("fopen"); return; }
 
     uint32_t ino = 0;
@@ -633,10 +1729,12 @@ void cat_ext2(const char *filename, const char *target) {
     } else {
         file_found_flag = FALSE;
         file_found_inode = 0;
-        ext2_inode root;
-        if (read_inode_ext2(fp, EXT2_ROOT_INO, &root) == 0)
-            search_dir(fp, &root, target);
-        if (file_found_flag) ino = file_found_inode;
+        fs_walk top;
+        fs_walk_begin(&top);
+        search_dir(fp, EXT2_ROOT_INO, target, &top);
+        fs_walk_end(&top);
+        // Un enlace se resuelve desde su directorio, igual que en una ruta
+        if (file_found_flag) ino = regular_or_zero(fp, lookup_at_ext2(fp, file_found_dir, target, TRUE));
     }
 
     if (!ino) {
@@ -652,19 +1750,23 @@ void cat_ext2(const char *filename, const char *target) {
         return;
     }
 
-    uint32_t rem = inode.i_size;
-    for (int i = 0; i < EXT2_NDIR_BLOCKS && rem > 0; i++) {
-        uint32_t blk = inode.i_block[i];
-        if (!blk) break;
-        uint32_t toread = rem < block_size ? rem : block_size;
-        uint8_t *buf = malloc(toread);
-        if (!buf) break;
-        fseek(fp, blk * block_size, SEEK_SET);
-        fread(buf, 1, toread, fp);
-        fwrite(buf, 1, toread, stdout);
-        free(buf);
-        rem -= toread;
+    // Saltamos directamente al bloque del desplazamiento vía bmap_ext2
+    uint8_t *buf = malloc(CAT_CHUNK_SIZE);
+    if (!buf) { fclose(fp); return; }
+    uint64_t pos = offset;
+    uint64_t end = ext2_file_size(&inode);
+    if (length != CAT_TO_END && offset < end && length < end - offset) end = offset + length;
+    while (pos < end) {
+        size_t want = end - pos < CAT_CHUNK_SIZE ? end - pos : CAT_CHUNK_SIZE;
+        int64_t n = read_file_ext2(fp, &inode, pos, buf, want);
+        if (n <= 0) {
+            if (n < 0) fprintf(stderr, "EXT2: error reading inode %u\n", ino);
+            break;
+        }
+        fwrite(buf, 1, n, fs_out());
+        pos += n;
     }
+    free(buf);
 
     fclose(fp);
 }
\ No newline at end of file
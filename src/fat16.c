@@ -4,16 +4,108 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "../include/fat16.h"
+#include "../include/image.h"
+#include "../include/sort.h"
 
-int file_found_flag = FALSE;
-fat16_dir_entry file_found;
+static _Thread_local int file_found_flag = FALSE;
+static _Thread_local fat16_dir_entry file_found;
 
-// Comprueba si la entrada actual es la última en el directorio.
-static int _is_last_entry(FILE *fp, uint32_t sector, int idx, const fat16_boot_sector *bs);
+// Lee un directorio completo (raíz o cadena de clústeres) a memoria.
+static fat16_dir_entry *_read_dir(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, uint32_t *n_entries);
 
-// Calcula la posición del sector correspondiente a un clúster.
-static uint32_t _calculate_sector(const fat16_dir_entry *entry, uint32_t root_dirs, const fat16_boot_sector *bs);
+// Cadena de clústeres de un fichero o directorio, desde la caché de cadenas.
+static const uint32_t *_get_chain(FILE *fp, const fat16_boot_sector *bs, uint32_t first, uint32_t *n);
+
+// Clasifica un bloque de entradas en una máscara de bits de entradas vivas.
+static void _classify_entries(const fat16_dir_entry *entries, uint32_t n, uint64_t *mask);
+
+// Recorre un directorio imprimiendo el árbol (o buscando un fichero).
+static void tree_fat16_subdir(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, const char *prefix, int find_file, const char *target, const fs_walk *parent);
+
+/*
+ * Geometría de un volumen FAT calculada a partir del boot sector. Todo lo
+ * que distingue FAT12, FAT16 y FAT32 sale de aquí y de los decodificadores
+ * de la FAT; el resto del lector es común.
+ */
+typedef struct {
+    int bits;                       // 12, 16 o 32
+    uint32_t fat_sectors;           // Sectores de cada FAT
+    uint64_t fat_start;             // Primer sector de la FAT activa
+    uint64_t root_start;            // Primer sector de la raíz fija (FAT12/16)
+    uint32_t root_sectors;          // Sectores de la raíz fija (0 en FAT32)
+    uint64_t data_start;            // Primer sector del clúster 2
+    uint32_t clusters;              // Clústeres de datos
+    uint32_t cluster_bytes;         // Bytes por clúster
+} fat_geometry;
+
+/*
+ * Decodificador de una entrada de la FAT, especializado por ancho. Recibe los
+ * bytes de la entrada y devuelve el valor normalizado a 28 bits: FAT_BAD para
+ * un clúster malo y >= FAT_EOC para el final de la cadena, sea cual sea el
+ * ancho.
+ */
+typedef uint32_t (*fat_decode_fn)(const uint8_t *entry, uint32_t cluster);
+
+/*
+ * Caché de directorios para la resolución de rutas. Cada ranura (indexada por
+ * el clúster del directorio) cuenta las visitas; a partir de la segunda se
+ * construye una tabla hash con los nombres 8.3 en formato de disco. Esta y
+ * las demás cachés son de cada hilo, para poder leer varias imágenes a la vez.
+ */
+typedef struct {
+    int used;
+    FILE *fp;                       // Imagen a la que pertenece
+    uint32_t cluster;               // Clúster del directorio (0 = raíz)
+    uint32_t visits;                // Veces que se ha buscado en él
+    fat16_dir_entry *entries;       // Entradas vivas del directorio
+    uint32_t n_entries;
+    int32_t *buckets;               // Índices a entries (-1 = vacío)
+    uint32_t n_buckets;             // Potencia de 2, 0 si aún no hay tabla
+} fat16_dir_cache_slot;
+
+static _Thread_local fat16_dir_cache_slot dir_cache[FAT16_DIR_CACHE_SLOTS];
+
+/*
+ * Caché de cadenas de clústeres: para cada fichero (por su primer clúster)
+ * guarda la cadena completa como array, de modo que pasar de un desplazamiento
+ * a su clúster es un acceso directo.
+ */
+typedef struct {
+    FILE *fp;                       // Imagen a la que pertenece
+    uint32_t first;                 // Primer clúster (0 = ranura vacía)
+    uint32_t *clusters;             // Cadena completa
+    uint32_t n;                     // Longitud de la cadena
+} fat16_chain_cache_slot;
+
+static _Thread_local fat16_chain_cache_slot chain_cache[FAT16_CHAIN_CACHE_SLOTS];
+
+/*
+ * Ventana de la FAT activa y geometría de cada imagen abierta: --diff
+ * trabaja con dos a la vez. En memoria solo hay FAT16_FAT_WINDOW_SECTORS
+ * sectores de la FAT, tal cual están en disco, que se leen con el
+ * decodificador de su ancho; la ventana se mueve cuando se pide una entrada
+ * de fuera.
+ */
+typedef struct {
+    FILE *fp;
+    fat_geometry g;                 // Geometría del volumen, calculada una vez
+    fat_decode_fn decode;
+    uint64_t fat_offset;            // Byte de la imagen donde empieza la FAT activa
+    uint64_t fat_bytes;             // Tamaño de la FAT activa
+    uint8_t *win;                   // Ventana (con 3 bytes de más para la última entrada)
+    uint64_t win_start;             // Byte de la FAT donde empieza (UINT64_MAX = vacía)
+    uint32_t win_bytes;             // Bytes que cubre la ventana
+} fat16_fat_cache_slot;
+
+static _Thread_local fat16_fat_cache_slot fat_cache[FAT16_FAT_CACHE_SLOTS];
+
+// Geometría de una imagen, desde su ranura de la FAT.
+static int _cached_geometry(FILE *fp, const fat16_boot_sector *bs, fat_geometry *g);
 
 /**
  * Read the FAT16 boot sector from the filesystem image.
@@ -23,11 +115,11 @@ static uint32_t _calculate_sector(const fat16_dir_entry *entry, uint32_t root_di
  * @return TRUE (1) on success, FALSE (0) on failure.
  */
 int read_fat16_boot_sector(const char *filename, fat16_boot_sector *bs) {   
-    FILE *fp = fopen(filename, "rb");
+    FILE *fp = image_open(filename);
     if (!fp) return FALSE;
-    if (fseek(fp, 0, SEEK_SET) != 0) { fclose(fp); return FALSE; }
+    if (fseeko(fp, 0, SEEK_SET) != 0) { fclose(fp); return FALSE; }
     if (fread(bs, sizeof(*bs), 1, fp) != 1) {
-        printf(ERR_READING_BOOT_SECTOR);
+        fprintf(fs_out(), ERR_READING_BOOT_SECTOR);
         fclose(fp);
         return FALSE;
     }
@@ -36,121 +128,428 @@ int read_fat16_boot_sector(const char *filename, fat16_boot_sector *bs) {
 }
 
 /**
- * Determine whether a given file contains a FAT16 filesystem.
+ * Compute the geometry of a FAT volume and its type. FAT32 is recognised by
+ * its extended BPB (no 16-bit FAT size), as Linux does, so that small FAT32
+ * volumes are accepted too; FAT12 and FAT16 are told apart by their number
+ * of data clusters. Impossible geometry is rejected so that nothing divides
+ * by zero or reads past the FAT.
+ *
+ * @param bs Boot sector.
+ * @param g  Output geometry.
+ * @return TRUE if the boot sector describes a FAT12, FAT16 or FAT32 volume.
+ */
+static int _geometry(const fat16_boot_sector *bs, fat_geometry *g) {
+    memset(g, 0, sizeof(*g));
+    if (bs->bytes_per_sector < 512 || bs->bytes_per_sector > 4096 || (bs->bytes_per_sector & (bs->bytes_per_sector - 1)) ||
+        bs->sectors_per_cluster == 0 || (bs->sectors_per_cluster & (bs->sectors_per_cluster - 1)) ||
+        bs->number_of_fats == 0 || bs->reserved_sectors == 0 ||
+        (bs->media_descriptor != 0xF0 && bs->media_descriptor < 0xF8)) return FALSE;
+
+    g->fat_sectors = bs->sectors_per_fat ? bs->sectors_per_fat : bs->sectors_per_fat_32;
+    g->root_sectors = ((bs->root_dir_entries * 32) + bs->bytes_per_sector - 1) / bs->bytes_per_sector;
+    uint32_t totsec = bs->total_sectors_small ? bs->total_sectors_small : bs->total_sectors_long;
+    g->fat_start = bs->reserved_sectors;
+    g->root_start = g->fat_start + (uint64_t)bs->number_of_fats * g->fat_sectors;
+    g->data_start = g->root_start + g->root_sectors;
+    if (g->fat_sectors == 0 || g->data_start >= totsec) return FALSE;
+    g->clusters = (totsec - g->data_start) / bs->sectors_per_cluster;
+    g->cluster_bytes = bs->sectors_per_cluster * bs->bytes_per_sector;
+
+    if (bs->sectors_per_fat != 0) {
+        if (g->clusters > FAT16_MAX_CLUSTERS) return FALSE;
+        g->bits = g->clusters <= FAT12_MAX_CLUSTERS ? 12 : 16;
+    } else {
+        // FAT32: la raíz es una cadena de clústeres y puede haber una sola FAT activa
+        if (bs->root_dir_entries != 0 || bs->root_cluster < 2) return FALSE;
+        g->bits = 32;
+        if ((bs->ext_flags & 0x80) && (bs->ext_flags & 0x0F) < bs->number_of_fats) {
+            g->fat_start += (uint64_t)(bs->ext_flags & 0x0F) * g->fat_sectors;
+        }
+    }
+
+    // Una FAT demasiado pequeña limita los clústeres utilizables
+    uint64_t entries = (uint64_t)g->fat_sectors * bs->bytes_per_sector * 8 / g->bits;
+    if (entries < 3) return FALSE;
+    if (g->clusters > entries - 2) g->clusters = entries - 2;
+    return TRUE;
+}
+
+/**
+ * Determine whether a given file contains a FAT12, FAT16 or FAT32 filesystem.
  *
  * @param filename Path to the image file.
- * @return TRUE if the image is FAT16, FALSE otherwise.
+ * @return TRUE if the image is FAT, FALSE otherwise.
  */
 int is_fat16(const char *filename) {
     fat16_boot_sector bs;
+    fat_geometry g;
     if (!read_fat16_boot_sector(filename, &bs)) return FALSE;
-    if (bs.bytes_per_sector == 0) return FALSE;
-    uint32_t root_dirs = ((bs.root_dir_entries * 32) + bs.bytes_per_sector - 1) / bs.bytes_per_sector;
-    uint32_t fatsz = bs.sectors_per_fat ? bs.sectors_per_fat
-                    : *((uint32_t *)(((uint8_t *)&bs) + 36));
-    uint32_t totsec = bs.total_sectors_small ? bs.total_sectors_small : bs.total_sectors_long;
-    uint32_t data_sec = totsec - (bs.reserved_sectors + bs.number_of_fats * fatsz + root_dirs);
-    uint32_t count = data_sec / bs.sectors_per_cluster;
-    return (count >= 4085 && count < 65525);
+    return _geometry(&bs, &g);
 }
 
 /**
- * Print the metadata of a FAT16 filesystem.
+ * Read the free cluster count kept in the FAT32 FSInfo sector.
  *
- * @param filename Path to the FAT16 image file.
+ * @return TRUE if the sector is valid and the count is known.
+ */
+static int _fsinfo_free(FILE *fp, const fat16_boot_sector *bs, const fat_geometry *g, uint32_t *free_count) {
+    fat32_fsinfo fsi;
+    if (bs->fs_info == 0 || bs->fs_info >= bs->reserved_sectors ||
+        fseeko(fp, (uint64_t)bs->fs_info * bs->bytes_per_sector, SEEK_SET) != 0 ||
+        fread(&fsi, sizeof(fsi), 1, fp) != 1) return FALSE;
+    if (fsi.lead_sig != FAT32_FSINFO_LEAD || fsi.struct_sig != FAT32_FSINFO_STRUCT ||
+        fsi.trail_sig != FAT32_FSINFO_TRAIL || fsi.free_count > g->clusters) return FALSE;
+    *free_count = fsi.free_count;
+    return TRUE;
+}
+
+/**
+ * Print the metadata of a FAT filesystem. On FAT32 the free space comes from
+ * the FSInfo sector, so the FAT is not scanned.
+ *
+ * @param filename Path to the FAT image file.
  */
 void metadata_fat16(const char *filename) {
     fat16_boot_sector bs;
-    if (!read_fat16_boot_sector(filename, &bs)) return;
-    printf("\n------ Información del sistema FAT16 ------\n");
-    printf("Sistema: FAT16\n");
-    printf("Tamaño de sector: %u bytes\n", bs.bytes_per_sector);
-    printf("Sectores por clúster: %u\n", bs.sectors_per_cluster);
-    printf("Sectores reservados: %u\n", bs.reserved_sectors);
-    printf("Número de FATs: %u\n", bs.number_of_fats);
-    printf("Entradas raíz máximas: %u\n", bs.root_dir_entries);
-    printf("Sectores por FAT: %u\n", bs.sectors_per_fat);
-    printf("Etiqueta del volumen: %.11s\n\n", bs.volume_label);
+    fat_geometry g;
+    if (!read_fat16_boot_sector(filename, &bs) || !_geometry(&bs, &g)) return;
+    fprintf(fs_out(), "\n------ Información del sistema FAT%d ------\n", g.bits);
+    fprintf(fs_out(), "Sistema: FAT%d\n", g.bits);
+    fprintf(fs_out(), "Tamaño de sector: %u bytes\n", bs.bytes_per_sector);
+    fprintf(fs_out(), "Sectores por clúster: %u\n", bs.sectors_per_cluster);
+    fprintf(fs_out(), "Sectores reservados: %u\n", bs.reserved_sectors);
+    fprintf(fs_out(), "Número de FATs: %u\n", bs.number_of_fats);
+    if (g.bits != 32) {
+        fprintf(fs_out(), "Entradas raíz máximas: %u\n", bs.root_dir_entries);
+        fprintf(fs_out(), "Sectores por FAT: %u\n", g.fat_sectors);
+        fprintf(fs_out(), "Etiqueta del volumen: %.11s\n\n", bs.volume_label);
+        return;
+    }
+
+    fprintf(fs_out(), "Clúster raíz: %u\n", bs.root_cluster);
+    fprintf(fs_out(), "Sectores por FAT: %u\n", g.fat_sectors);
+    fprintf(fs_out(), "Clústeres de datos: %u\n", g.clusters);
+    FILE *fp = image_open(filename);
+    uint32_t free_count;
+    if (fp && _fsinfo_free(fp, &bs, &g, &free_count)) {
+        fprintf(fs_out(), "Clústeres libres: %u (%llu bytes, según FSInfo)\n", free_count,
+                (unsigned long long)free_count * g.cluster_bytes);
+    } else {
+        fprintf(fs_out(), "Clústeres libres: desconocido (FSInfo no válido)\n");
+    }
+    if (fp) fclose(fp);
+    fprintf(fs_out(), "Etiqueta del volumen: %.11s\n\n", bs.volume_label_32);
+}
+
+/**
+ * Normaliza el nombre 8.3 de una entrada a una cadena en minúsculas
+ * ("PRACTICA C  " -> "practica.c").
+ *
+ * @param e    Entrada de directorio.
+ * @param name Salida de al menos 13 bytes.
+ */
+void format_name_fat16(const fat16_dir_entry *e, char name[13]) {
+    int p = 0;
+    for (int i = 0; i < 8 && e->filename[i] != ' '; i++) {
+        name[p++] = tolower((unsigned char)e->filename[i]);
+    }
+    if (e->filename[8] != ' ') {
+        name[p++] = '.';
+        for (int i = 8; i < 11 && e->filename[i] != ' '; i++) {
+            name[p++] = tolower((unsigned char)e->filename[i]);
+        }
+    }
+    name[p] = '\0';
+}
+
+/**
+ * Clasificador escalar: un bit por entrada que no está libre ni borrada, no es
+ * LFN ni etiqueta de volumen (ambas tienen el bit 0x08) y no es "." ni "..".
+ */
+static void _classify_scalar(const uint8_t *buf, uint32_t from, uint32_t n, uint64_t *mask) {
+    for (uint32_t i = from; i < n; i++) {
+        const uint8_t *e = buf + (size_t)i * sizeof(fat16_dir_entry);
+        if (e[0] == 0x00 || e[0] == 0xE5 || e[0] == '.') continue;
+        if (e[11] & ATTR_VOLUME_ID) continue;
+        mask[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Clasificador SSE2: 4 entradas por iteración. Se cargan los 16 primeros
+ * bytes de cada entrada y se trasponen con unpack, de modo que un vector
+ * lleva los bytes 0-3 (primer carácter) y otro los bytes 8-11 (atributos)
+ * de las cuatro entradas, un carril de 32 bits por entrada.
+ */
+static void _classify_sse2(const uint8_t *buf, uint32_t n, uint64_t *mask) {
+    const __m128i low = _mm_set1_epi32(0xFF);
+    const __m128i vol = _mm_set1_epi32(ATTR_VOLUME_ID << 24);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i del = _mm_set1_epi32(0xE5);
+    const __m128i dot = _mm_set1_epi32('.');
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *e = buf + (size_t)i * sizeof(fat16_dir_entry);
+        __m128i e0 = _mm_loadu_si128((const __m128i *)e);
+        __m128i e1 = _mm_loadu_si128((const __m128i *)(e + 32));
+        __m128i e2 = _mm_loadu_si128((const __m128i *)(e + 64));
+        __m128i e3 = _mm_loadu_si128((const __m128i *)(e + 96));
+        __m128i lo01 = _mm_unpacklo_epi32(e0, e1);     // e0[0] e1[0] e0[1] e1[1]
+        __m128i lo23 = _mm_unpacklo_epi32(e2, e3);
+        __m128i hi01 = _mm_unpackhi_epi32(e0, e1);     // e0[2] e1[2] e0[3] e1[3]
+        __m128i hi23 = _mm_unpackhi_epi32(e2, e3);
+        __m128i head = _mm_and_si128(_mm_unpacklo_epi64(lo01, lo23), low);
+        __m128i attr = _mm_and_si128(_mm_unpacklo_epi64(hi01, hi23), vol);
+        __m128i dead = _mm_or_si128(_mm_cmpeq_epi32(head, zero), _mm_cmpeq_epi32(head, del));
+        dead = _mm_or_si128(dead, _mm_cmpeq_epi32(head, dot));
+        dead = _mm_or_si128(dead, _mm_cmpeq_epi32(attr, vol));
+        uint64_t bits = ~_mm_movemask_ps(_mm_castsi128_ps(dead)) & 0xF;
+        mask[i / 64] |= bits << (i % 64);
+    }
+    _classify_scalar(buf, i, n, mask);
+}
+
+/**
+ * Clasificador AVX2: 8 entradas por iteración usando gathers con paso de 32 bytes.
+ */
+__attribute__((target("avx2")))
+static void _classify_avx2(const uint8_t *buf, uint32_t n, uint64_t *mask) {
+    const __m256i stride = _mm256_setr_epi32(0, 32, 64, 96, 128, 160, 192, 224);
+    const __m256i low = _mm256_set1_epi32(0xFF);
+    const __m256i vol = _mm256_set1_epi32(ATTR_VOLUME_ID << 24);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i del = _mm256_set1_epi32(0xE5);
+    const __m256i dot = _mm256_set1_epi32('.');
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const uint8_t *e = buf + (size_t)i * sizeof(fat16_dir_entry);
+        __m256i head = _mm256_and_si256(_mm256_i32gather_epi32((const int *)e, stride, 1), low);
+        __m256i attr = _mm256_and_si256(_mm256_i32gather_epi32((const int *)(e + 8), stride, 1), vol);
+        __m256i dead = _mm256_or_si256(_mm256_cmpeq_epi32(head, zero), _mm256_cmpeq_epi32(head, del));
+        dead = _mm256_or_si256(dead, _mm256_cmpeq_epi32(head, dot));
+        dead = _mm256_or_si256(dead, _mm256_cmpeq_epi32(attr, vol));
+        uint64_t bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(dead)) & 0xFF;
+        mask[i / 64] |= bits << (i % 64);
+    }
+    _classify_scalar(buf, i, n, mask);
+}
+#endif
+
+// Variante del clasificador elegida para esta CPU (NULL = escalar)
+static void (*classify_impl)(const uint8_t *, uint32_t, uint64_t *) = NULL;
+static pthread_once_t classify_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Elige la variante SIMD del clasificador. Se ejecuta una sola vez con
+ * pthread_once, porque los hilos de --batch clasifican a la vez.
+ */
+static void _select_classifier(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) classify_impl = _classify_avx2;
+    else if (__builtin_cpu_supports("sse2")) classify_impl = _classify_sse2;
+#endif
+}
+
+/**
+ * Clasifica un bloque de entradas de directorio en una máscara de bits (un bit
+ * por entrada viva). La variante SIMD se elige una sola vez según la CPU.
+ *
+ * @param entries Entradas de directorio contiguas.
+ * @param n       Número de entradas.
+ * @param mask    Salida de (n + 63) / 64 palabras.
+ */
+static void _classify_entries(const fat16_dir_entry *entries, uint32_t n, uint64_t *mask) {
+    pthread_once(&classify_once, _select_classifier);
+
+    memset(mask, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    if (classify_impl) classify_impl((const uint8_t *)entries, n, mask);
+    else _classify_scalar((const uint8_t *)entries, 0, n, mask);
+}
+
+/**
+ * Devuelve el índice de la última entrada viva (bit más alto de la máscara).
+ *
+ * @param mask  Máscara de entradas vivas.
+ * @param words Número de palabras de 64 bits.
+ * @return      Índice de la entrada, o -1 si no hay ninguna.
+ */
+static int64_t _last_live_entry(const uint64_t *mask, uint32_t words) {
+    for (uint32_t w = words; w-- > 0;) {
+        if (mask[w]) return (int64_t)w * 64 + 63 - __builtin_clzll(mask[w]);
+    }
+    return -1;
+}
+
+/**
+ * Pasa a una ordenación las entradas vivas de un trozo de directorio.
+ *
+ * @param s       Ordenación.
+ * @param entries Entradas del trozo.
+ * @param n       Número de entradas.
+ * @param mask    Máscara de (n + 63) / 64 palabras.
+ * @return        0 si tiene éxito, -1 si hay error.
+ */
+static int _sort_add_entries(dir_sorter *s, const fat16_dir_entry *entries, uint32_t n, uint64_t *mask) {
+    _classify_entries(entries, n, mask);
+    for (uint32_t w = 0; w < (n + 63) / 64; w++) {
+        for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+            const fat16_dir_entry *e = &entries[w * 64 + __builtin_ctzll(bits)];
+            char name[13];
+            format_name_fat16(e, name);
+            uint64_t key = tree_sort == TREE_SORT_SIZE ? e->file_size
+                         : (uint32_t)e->last_write_date << 16 | e->last_write_time;
+            if (dir_sorter_add(s, name, key, first_cluster_fat16(e), (e->attributes & ATTR_DIRECTORY) != 0) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Imprime un nivel del árbol en el orden de --sort. El directorio se lee de
+ * clúster en clúster (la raíz fija, en trozos del mismo tamaño) y sus
+ * entradas vivas pasan directamente a un dir_sorter, así que nunca está
+ * entero en memoria.
+ *
+ * @param fp      FILE* abierto de la imagen FAT.
+ * @param bs      Boot sector.
+ * @param cluster Primer clúster del directorio (0 = raíz).
+ * @param prefix  Prefijo ASCII para este nivel.
+ * @param node    Directorio actual en el recorrido.
+ */
+static void _tree_fat16_sorted(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, const char *prefix,
+                               const fs_walk *node) {
+    fat_geometry g;
+    int ok = _cached_geometry(fp, bs, &g);
+    uint32_t per = ok ? g.cluster_bytes / sizeof(fat16_dir_entry) : 0;
+    dir_sorter *s = dir_sorter_new();
+    fat16_dir_entry *buf = malloc(ok ? g.cluster_bytes : 1);
+    uint64_t *mask = malloc(((per + 63) / 64 ? (per + 63) / 64 : 1) * sizeof(uint64_t));
+    ok = ok && s && buf && mask;
+
+    if (ok && cluster == 0 && g.bits != 32) {
+        uint64_t total = (uint64_t)g.root_sectors * bs->bytes_per_sector;
+        for (uint64_t done = 0; ok && done < total; ) {
+            size_t chunk = total - done < g.cluster_bytes ? total - done : g.cluster_bytes;
+            ok = fseeko(fp, g.root_start * bs->bytes_per_sector + done, SEEK_SET) == 0 && fread(buf, chunk, 1, fp) == 1 &&
+                 _sort_add_entries(s, buf, chunk / sizeof(fat16_dir_entry), mask) == 0;
+            done += chunk;
+        }
+    } else if (ok) {
+        uint32_t n = 0;
+        const uint32_t *chain = _get_chain(fp, bs, cluster ? cluster : bs->root_cluster, &n);
+        ok = chain != NULL;
+        if ((uint64_t)n * g.cluster_bytes > fs_limit.max_dir_bytes) n = fs_limit.max_dir_bytes / g.cluster_bytes;
+        for (uint32_t i = 0; ok && i < n; i++) {
+            uint64_t sector = g.data_start + (uint64_t)(chain[i] - 2) * bs->sectors_per_cluster;
+            // Un clúster ilegible corta el directorio, como en _read_dir
+            if (fseeko(fp, sector * bs->bytes_per_sector, SEEK_SET) != 0 || fread(buf, g.cluster_bytes, 1, fp) != 1) break;
+            ok = _sort_add_entries(s, buf, per, mask) == 0;
+        }
+    }
+    free(mask);
+    free(buf);
+    if (!ok || dir_sorter_finish(s) != 0) {
+        fprintf(stderr, "Error sorting directory %u\n", node->id);
+        dir_sorter_free(s);
+        return;
+    }
+
+    sort_entry e;
+    int last;
+    while (dir_sorter_next(s, &e, &last)) {
+        fprintf(fs_out(), "%s%s%s\n", prefix, last ? "└── " : "├── ", e.name);
+        if (e.is_dir) {
+            char *new_prefix = tree_child_prefix(prefix, last);
+            if (!new_prefix) break;
+            tree_fat16_subdir(fp, bs, e.id, new_prefix, FALSE, NULL, node);
+            free(new_prefix);
+        }
+    }
+    dir_sorter_free(s);
 }
 
 /**
- * Recursively list the contents of a FAT16 directory cluster, printing
- * an ASCII-art tree. Can operate in listing or search mode.
+ * Recursively list the contents of a FAT16 directory, printing an ASCII-art
+ * tree. Can operate in listing or search mode. The whole directory is read
+ * at once and classified into a live-entry bitmask, so only live entries are
+ * touched and deleted padding is skipped a word at a time.
  *
  * @param fp         Open FILE* of the FAT16 image.
  * @param bs         Pointer to the FAT16 boot sector.
- * @param sector     Sector number of the directory to scan.
- * @param root_dirs  Number of root directory sectors.
+ * @param cluster    First cluster of the directory (0 for the root).
  * @param prefix     ASCII prefix to use for tree formatting.
  * @param find_file  If TRUE, search for 'target'; if FALSE, list all entries.
  * @param target     Filename to search for (when find_file is TRUE).
+ * @param parent     Parent directory in the walk (NULL for the root).
  */
-static void tree_fat16_subdir(FILE *fp, const fat16_boot_sector *bs, uint32_t sector, uint32_t root_dirs, const char *prefix, int find_file, const char *target) {
-    uint32_t entries = bs->bytes_per_sector / sizeof(fat16_dir_entry);
+static void tree_fat16_subdir(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, const char *prefix, int find_file, const char *target, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, cluster)) return;
+    if (!find_file && tree_sort != TREE_SORT_NONE) {
+        _tree_fat16_sorted(fp, bs, cluster, prefix, &node);
+        return;
+    }
+    uint32_t entries = 0;
+    fat16_dir_entry *dir = _read_dir(fp, bs, cluster, &entries);
+    if (!dir) return;
 
-    for (uint32_t idx = 0; idx < entries; idx++) {
-        fat16_dir_entry e;
-        fseek(fp, sector * bs->bytes_per_sector + idx * sizeof(e), SEEK_SET);
-        fread(&e, sizeof(e), 1, fp);
-
-        // entrada vacía o borrada
-        if (e.filename[0] == 0x00 || e.filename[0] == 0xE5) continue;
-        // ignorar LFN (long file name) y etiquetas de volumen
-        if ((e.attributes & 0x0F) == 0x0F || (e.attributes & ATTR_VOLUME_ID)) continue;
-        // ignorar “.” y “..”
-        if (e.filename[0] == '.') continue;
-
-
-        // normalizar nombre 8.3 a string
-        char name[13] = {0};
-        int p = 0;
-        for (int i = 0; i < 8 && e.filename[i] != ' '; i++) {
-            name[p++] = tolower((unsigned char)e.filename[i]);
-        }
-        if (e.filename[8] != ' ') {
-            name[p++] = '.';
-            for (int i = 8; i < 11 && e.filename[i] != ' '; i++) {
-                name[p++] = tolower((unsigned char)e.filename[i]);
-            }
-        }
+    uint32_t words = (entries + 63) / 64;
+    uint64_t *mask = malloc((words ? words : 1) * sizeof(uint64_t));
+    if (!mask) { free(dir); return; }
+    _classify_entries(dir, entries, mask);
+    int64_t last_idx = _last_live_entry(mask, words);
 
-        name[p] = '\0';
+    for (uint32_t w = 0; w < words; w++) {
+        for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+            uint32_t idx = w * 64 + __builtin_ctzll(bits);
+            const fat16_dir_entry *e = &dir[idx];
 
-        // ¿es el último en este nivel?
-        int last = _is_last_entry(fp, sector, idx, bs);
+            // normalizar nombre 8.3 a string
+            char name[13];
+            format_name_fat16(e, name);
 
-        if (find_file) { // ----- modo búsqueda -----
-            // solo comparamos ficheros, no directorios
-            if (!(e.attributes & ATTR_DIRECTORY) && strcmp(name, target) == 0) {
-                file_found_flag  = TRUE;
-                file_found       = e;
-                return;  // ¡encontrado! salimos
-            }
-        } else { // ----- modo listado -----
-            printf("%s%s%s\n",
-            prefix,
-            last ? "└── " : "├── ",
-            name);
-        }
+            // ¿es el último en este nivel?
+            int last = ((int64_t)idx == last_idx);
 
-        // recursar en subdirectorios (solo si no hemos encontrado el archivo)
-        if ((e.attributes & ATTR_DIRECTORY) && !file_found_flag) {
-            // construimos el nuevo prefix
-            size_t L = strlen(prefix) + 4 + 1;
-            char *new_prefix = malloc(L);
-            strcpy(new_prefix, prefix);
-            strcat(new_prefix, last ? "    " : "│   ");
+            if (find_file) { // ----- modo búsqueda -----
+                // solo comparamos ficheros, no directorios
+                if (!(e->attributes & ATTR_DIRECTORY) && strcmp(name, target) == 0) {
+                    file_found_flag  = TRUE;
+                    file_found       = *e;
+                    free(mask);
+                    free(dir);
+                    return;  // ¡encontrado! salimos
+                }
+            } else { // ----- modo listado -----
+                fprintf(fs_out(), "%s%s%s\n",
+                prefix,
+                last ? "└── " : "├── ",
+                name);
+            }
 
-            // sector hijo
-            uint32_t child = _calculate_sector(&e, root_dirs, bs);
-            tree_fat16_subdir(fp, bs, child, root_dirs, new_prefix, find_file, target);
+            // recursar en subdirectorios (solo si no hemos encontrado el archivo)
+            if ((e->attributes & ATTR_DIRECTORY) && !file_found_flag) {
+                // construimos el nuevo prefix
+                char *new_prefix = tree_child_prefix(prefix, last);
+                if (new_prefix) tree_fat16_subdir(fp, bs, first_cluster_fat16(e), new_prefix, find_file, target, &node);
+                free(new_prefix);
+            }
 
-            free(new_prefix);
+            // si estamos en búsqueda y ya encontramos, salimos del bucle
+            if (find_file && file_found_flag) {
+                free(mask);
+                free(dir);
+                return;
+            }
         }
-
-        // si estamos en búsqueda y ya encontramos, salimos del bucle
-        if (find_file && file_found_flag) return;
     }
+
+    free(mask);
+    free(dir);
 }
 
 /**
@@ -164,85 +563,836 @@ void tree_fat16(const char *file_system, int find_file, const char *file_name) {
     fat16_boot_sector bs;
     if (!read_fat16_boot_sector(file_system, &bs)) return;
 
-    FILE *fp = fopen(file_system, "rb");
+    FILE *fp = image_open(file_system);
     if (!fp) {
         fprintf(stderr, "Error opening '%s'\n", file_system);
         return;
     }
 
-    uint32_t root_dirs = (bs.root_dir_entries * 32 + bs.bytes_per_sector - 1) / bs.bytes_per_sector;
-    uint32_t first_root = bs.reserved_sectors + bs.number_of_fats * bs.sectors_per_fat;
+    if (!find_file) fprintf(fs_out(), ".\n");
+
+    fs_walk top;
+    fs_walk_begin(&top);
+    tree_fat16_subdir(fp, &bs, 0, "", find_file, file_name, &top);
+    fs_walk_end(&top);
+
+    fclose(fp);
+}
+
+/**
+ * Entrada de FAT12: 12 bits empaquetados, dos entradas cada tres bytes.
+ */
+static uint32_t _decode_fat12(const uint8_t *p, uint32_t cluster) {
+    uint32_t v = p[0] | (uint32_t)p[1] << 8;
+    v = (cluster & 1) ? v >> 4 : v & 0x0FFF;
+    return v >= 0x0FF7 ? v | 0x0FFFF000 : v;
+}
 
-    if (!find_file) printf(".\n");
+/**
+ * Entrada de FAT16: 16 bits little-endian.
+ */
+static uint32_t _decode_fat16(const uint8_t *p, uint32_t cluster) {
+    (void)cluster;
+    uint32_t v = p[0] | (uint32_t)p[1] << 8;
+    return v >= 0xFFF7 ? v | 0x0FFF0000 : v;
+}
 
-    const char *empty = "";
-    
-    for (uint32_t i = 0; i < root_dirs; i++) {
-        tree_fat16_subdir(fp, &bs, first_root + i, root_dirs, empty, find_file, file_name);
-        if (find_file && file_found_flag) break;
+/**
+ * Entrada de FAT32: 32 bits little-endian de los que solo cuentan los 28 bajos.
+ */
+static uint32_t _decode_fat32(const uint8_t *p, uint32_t cluster) {
+    (void)cluster;
+    return (p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24) & 0x0FFFFFFF;
+}
+
+/**
+ * Devuelve la ranura de la FAT de una imagen, calculando su geometría la
+ * primera vez. No lee nada: la ventana se carga al pedir la primera entrada.
+ *
+ * @param fp FILE* abierto de la imagen FAT.
+ * @param bs Puntero al boot sector.
+ * @return   Ranura de la imagen, o NULL si la geometría no es válida.
+ */
+static fat16_fat_cache_slot *_get_fat(FILE *fp, const fat16_boot_sector *bs) {
+    // Buscamos la ranura de esta imagen, o una libre (o la primera)
+    fat16_fat_cache_slot *slot = NULL;
+    for (int i = 0; i < FAT16_FAT_CACHE_SLOTS && !slot; i++) {
+        if (fat_cache[i].fp == fp) slot = &fat_cache[i];
+    }
+    for (int i = 0; i < FAT16_FAT_CACHE_SLOTS && !slot; i++) {
+        if (!fat_cache[i].fp) slot = &fat_cache[i];
     }
+    if (!slot) slot = &fat_cache[0];
+    if (slot->fp == fp) return slot->win ? slot : NULL;
 
-    fclose(fp);
+    free(slot->win);
+    memset(slot, 0, sizeof(*slot));
+    slot->fp = fp;
+    if (!_geometry(bs, &slot->g)) return NULL;
+
+    slot->fat_offset = slot->g.fat_start * bs->bytes_per_sector;
+    slot->fat_bytes = (uint64_t)slot->g.fat_sectors * bs->bytes_per_sector;
+    slot->win_bytes = FAT16_FAT_WINDOW_SECTORS * bs->bytes_per_sector;
+    slot->win_start = UINT64_MAX;
+    slot->decode = slot->g.bits == 12 ? _decode_fat12 : slot->g.bits == 16 ? _decode_fat16 : _decode_fat32;
+    slot->win = malloc(slot->win_bytes + 3);
+    return slot->win ? slot : NULL;
 }
 
 /**
- * Comprueba si la entrada en la posición `idx` de un directorio es la última,
- * mirando a partir de `idx + 1` hasta el final del sector.
+ * Geometría de una imagen, calculada una sola vez y guardada con su ranura
+ * de la FAT.
  *
- * @param fp        FILE* abierto de la imagen FAT16.
- * @param sector    Número de sector donde está el directorio.
- * @param idx       Índice de la entrada actual dentro del sector.
- * @param bs        Puntero al boot sector FAT16 para obtener bytes por sector.
- * @return          TRUE si no hay más entradas válidas tras `idx`, FALSE en caso contrario.
- */
-static int _is_last_entry(FILE *fp, uint32_t sector, int idx, const fat16_boot_sector *bs) {
-    uint32_t entries = bs->bytes_per_sector / sizeof(fat16_dir_entry);
-    for (uint32_t k = idx + 1; k < entries; k++) {
-        fat16_dir_entry e;
-        fseek(fp, sector * bs->bytes_per_sector + k * sizeof(e), SEEK_SET);
-        fread(&e, sizeof(e), 1, fp);
-        if (e.filename[0] != 0x00 && e.filename[0] != 0xE5) return FALSE;
+ * @param fp FILE* abierto de la imagen FAT.
+ * @param bs Puntero al boot sector.
+ * @param g  Salida: geometría.
+ * @return   TRUE si es válida, FALSE si no.
+ */
+static int _cached_geometry(FILE *fp, const fat16_boot_sector *bs, fat_geometry *g) {
+    const fat16_fat_cache_slot *fat = _get_fat(fp, bs);
+    if (!fat) return FALSE;
+    *g = fat->g;
+    return TRUE;
+}
+
+/**
+ * Lee una entrada de la FAT, moviendo la ventana si no la contiene. La
+ * ventana se alinea a su tamaño y lleva unos bytes de más, así una entrada
+ * que empieza dentro nunca queda cortada (FAT12 puede cruzar sectores).
+ *
+ * @param fat     Ranura de la imagen.
+ * @param cluster Clúster cuya entrada se quiere.
+ * @return        Valor normalizado, FAT_EOC si está fuera del volumen o no se puede leer.
+ */
+static uint32_t _fat_entry(fat16_fat_cache_slot *fat, uint32_t cluster) {
+    if (cluster >= fat->g.clusters + 2) return FAT_EOC;
+    uint64_t byte = (uint64_t)cluster * fat->g.bits / 8;
+    if (byte < fat->win_start || byte - fat->win_start >= fat->win_bytes) {
+        uint64_t start = byte - byte % fat->win_bytes;
+        size_t len = fat->fat_bytes - start < (uint64_t)fat->win_bytes + 3 ? fat->fat_bytes - start : fat->win_bytes + 3;
+        memset(fat->win + len, 0, fat->win_bytes + 3 - len);
+        if (fseeko(fat->fp, fat->fat_offset + start, SEEK_SET) != 0 || fread(fat->win, len, 1, fat->fp) != 1) {
+            fat->win_start = UINT64_MAX;
+            return FAT_EOC;
+        }
+        fat->win_start = start;
+    }
+    return fat->decode(fat->win + (byte - fat->win_start), cluster);
+}
+
+/**
+ * Lee la entrada de la FAT correspondiente a un clúster.
+ *
+ * @param fp      FILE* abierto de la imagen FAT.
+ * @param bs      Puntero al boot sector.
+ * @param cluster Clúster cuyo sucesor se quiere conocer.
+ * @return        Siguiente clúster de la cadena (>= FAT_EOC si es el último).
+ */
+static uint32_t _next_cluster(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster) {
+    fat16_fat_cache_slot *fat = _get_fat(fp, bs);
+    return fat ? _fat_entry(fat, cluster) : FAT_EOC;
+}
+
+/**
+ * Lee un directorio completo a memoria. La raíz de FAT12/16 ocupa una región
+ * fija; la de FAT32 y los subdirectorios se leen siguiendo su cadena de
+ * clústeres (de la caché de cadenas), con una lectura por tramo contiguo.
+ *
+ * @param fp        FILE* abierto de la imagen FAT.
+ * @param bs        Puntero al boot sector.
+ * @param cluster   Primer clúster del directorio (0 = raíz).
+ * @param n_entries Salida: número de entradas de 32 bytes leídas.
+ * @return          Buffer con las entradas (liberar con free), NULL si falla.
+ */
+static fat16_dir_entry *_read_dir(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, uint32_t *n_entries) {
+    fat_geometry g;
+    uint8_t *buf = NULL;
+    size_t len = 0;
+
+    *n_entries = 0;
+    if (!_cached_geometry(fp, bs, &g)) return NULL;
+    if (cluster == 0 && g.bits != 32) {
+        len = (size_t)g.root_sectors * bs->bytes_per_sector;
+        buf = malloc(len ? len : 1);
+        if (!buf) return NULL;
+        if (fseeko(fp, g.root_start * bs->bytes_per_sector, SEEK_SET) != 0 ||
+            fread(buf, len, 1, fp) != 1) {
+            free(buf);
+            return NULL;
+        }
+    } else {
+        // La cadena ya se corta en ciclos; además no pasamos del tamaño máximo de directorio
+        uint32_t n = 0;
+        const uint32_t *chain = _get_chain(fp, bs, cluster ? cluster : bs->root_cluster, &n);
+        if (!chain) return NULL;
+        if ((uint64_t)n * g.cluster_bytes > fs_limit.max_dir_bytes) n = fs_limit.max_dir_bytes / g.cluster_bytes;
+        buf = malloc(n ? (size_t)n * g.cluster_bytes : 1);
+        if (!buf) return NULL;
+        for (uint32_t i = 0, run; i < n; i += run) {
+            for (run = 1; i + run < n && chain[i + run] == chain[i] + run; run++) {}
+            uint64_t sector = g.data_start + (uint64_t)(chain[i] - 2) * bs->sectors_per_cluster;
+            if (fseeko(fp, sector * bs->bytes_per_sector, SEEK_SET) != 0 ||
+                fread(buf + len, (size_t)run * g.cluster_bytes, 1, fp) != 1) break;
+            len += (size_t)run * g.cluster_bytes;
+        }
     }
 
+    *n_entries = len / sizeof(fat16_dir_entry);
+    return (fat16_dir_entry *)buf;
+}
+
+/**
+ * Convierte un componente de ruta ("practica.c") al formato 8.3 de disco
+ * ("PRACTICA C  "), en mayúsculas y relleno con espacios.
+ *
+ * @param component Componente de ruta (sin '/').
+ * @param len       Longitud del componente.
+ * @param out       Salida de 11 bytes.
+ * @return          TRUE si el nombre es representable en 8.3, FALSE si no.
+ */
+static int _to_83_name(const char *component, size_t len, uint8_t out[11]) {
+    memset(out, ' ', 11);
+    if (len == 0) return FALSE;
+    if ((len == 1 && component[0] == '.') || (len == 2 && component[0] == '.' && component[1] == '.')) {
+        memcpy(out, component, len);
+        return TRUE;
+    }
+
+    const char *dot = memchr(component, '.', len);
+    size_t base_len = dot ? (size_t)(dot - component) : len;
+    size_t ext_len = dot ? len - base_len - 1 : 0;
+    if (base_len == 0 || base_len > 8 || ext_len > 3) return FALSE;
+    if (dot && memchr(dot + 1, '.', ext_len)) return FALSE;
+
+    for (size_t i = 0; i < base_len; i++) out[i] = toupper((unsigned char)component[i]);
+    for (size_t i = 0; i < ext_len; i++) out[8 + i] = toupper((unsigned char)dot[1 + i]);
     return TRUE;
 }
 
 /**
- * Calcula el número de sector de datos donde comienza el clúster
- * especificado en una entrada de directorio FAT16.
+ * Hash FNV-1a de un nombre 8.3 de 11 bytes.
+ */
+static uint32_t _hash_83(const uint8_t name[11]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 11; i++) {
+        h ^= name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Indica si una entrada de directorio corresponde a un fichero o directorio visible
+ * (no borrada, ni LFN, ni etiqueta de volumen).
+ */
+static int _is_live_entry(const fat16_dir_entry *e) {
+    if (e->filename[0] == 0x00 || e->filename[0] == 0xE5) return FALSE;
+    if ((e->attributes & 0x0F) == 0x0F || (e->attributes & ATTR_VOLUME_ID)) return FALSE;
+    return TRUE;
+}
+
+/**
+ * Construye la tabla hash de una ranura de la caché de directorios.
  *
- * @param entry     Puntero a la entrada de directorio con el primer clúster.
- * @param root_dirs Número de sectores reservados para el directorio raíz.
- * @param bs        Puntero al boot sector FAT16 para obtener parámetros.
- * @return          Sector de inicio de los datos del clúster.
+ * @param slot Ranura con las entradas ya cargadas.
  */
-static uint32_t _calculate_sector(const fat16_dir_entry *e, uint32_t root_dirs, const fat16_boot_sector *bs) {
-    uint32_t cluster = e->first_cluster_low;
-    uint32_t data_start = bs->reserved_sectors + bs->number_of_fats * bs->sectors_per_fat
-                          + root_dirs;
-    return data_start + (cluster - 2) * bs->sectors_per_cluster;
+static void _build_dir_hash(fat16_dir_cache_slot *slot) {
+    uint32_t n = 16;
+    while (n < slot->n_entries * 2) n <<= 1;
+    slot->buckets = malloc(n * sizeof(int32_t));
+    if (!slot->buckets) return;
+    memset(slot->buckets, 0xFF, n * sizeof(int32_t));
+    slot->n_buckets = n;
+
+    for (uint32_t i = 0; i < slot->n_entries; i++) {
+        uint32_t b = _hash_83(slot->entries[i].filename) & (n - 1);
+        while (slot->buckets[b] >= 0) b = (b + 1) & (n - 1);
+        slot->buckets[b] = (int32_t)i;
+    }
+}
+
+/**
+ * Busca un nombre 8.3 en un directorio. Los directorios que se visitan más de
+ * una vez quedan en caché con una tabla hash, de modo que las búsquedas
+ * repetidas (modo batch) no vuelven a leer ni recorrer el directorio.
+ *
+ * @param fp      FILE* abierto de la imagen FAT16.
+ * @param bs      Puntero al boot sector FAT16.
+ * @param cluster Primer clúster del directorio (0 = raíz).
+ * @param name    Nombre en formato de disco (11 bytes).
+ * @param out     Salida con la entrada encontrada.
+ * @return        TRUE si se encuentra, FALSE en caso contrario.
+ */
+static int _find_in_dir(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, const uint8_t name[11], fat16_dir_entry *out) {
+    fat16_dir_cache_slot *slot = &dir_cache[cluster % FAT16_DIR_CACHE_SLOTS];
+
+    if (!slot->used || slot->fp != fp || slot->cluster != cluster) {
+        // Ranura vacía u ocupada por otro directorio: la reciclamos
+        free(slot->entries);
+        free(slot->buckets);
+        memset(slot, 0, sizeof(*slot));
+        slot->used = TRUE;
+        slot->fp = fp;
+        slot->cluster = cluster;
+    }
+    slot->visits++;
+
+    if (!slot->entries) {
+        uint32_t n = 0;
+        fat16_dir_entry *raw = _read_dir(fp, bs, cluster, &n);
+        if (!raw) return FALSE;
+        // Compactamos: solo nos quedamos con las entradas vivas
+        uint32_t live = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (_is_live_entry(&raw[i])) raw[live++] = raw[i];
+        }
+        slot->entries = raw;
+        slot->n_entries = live;
+    }
+
+    if (!slot->buckets && slot->visits >= FAT16_HASH_MIN_VISITS) _build_dir_hash(slot);
+
+    if (slot->buckets) {
+        uint32_t mask = slot->n_buckets - 1;
+        for (uint32_t b = _hash_83(name) & mask; slot->buckets[b] >= 0; b = (b + 1) & mask) {
+            const fat16_dir_entry *e = &slot->entries[slot->buckets[b]];
+            if (memcmp(e->filename, name, 11) == 0) { *out = *e; return TRUE; }
+        }
+        return FALSE;
+    }
+
+    for (uint32_t i = 0; i < slot->n_entries; i++) {
+        if (memcmp(slot->entries[i].filename, name, 11) == 0) {
+            *out = slot->entries[i];
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Libera la caché de directorios, la de cadenas y la copia de la FAT.
+ */
+void fat16_cache_clear(void) {
+    for (int i = 0; i < FAT16_DIR_CACHE_SLOTS; i++) {
+        free(dir_cache[i].entries);
+        free(dir_cache[i].buckets);
+    }
+    memset(dir_cache, 0, sizeof(dir_cache));
+    for (int i = 0; i < FAT16_CHAIN_CACHE_SLOTS; i++) free(chain_cache[i].clusters);
+    memset(chain_cache, 0, sizeof(chain_cache));
+    for (int i = 0; i < FAT16_FAT_CACHE_SLOTS; i++) free(fat_cache[i].win);
+    memset(fat_cache, 0, sizeof(fat_cache));
+}
+
+/**
+ * Resuelve una ruta descendiendo un componente cada vez, de modo que el coste
+ * es proporcional a la profundidad de la ruta y no al tamaño del volumen.
+ *
+ * @param fp   FILE* abierto de la imagen FAT16.
+ * @param bs   Puntero al boot sector FAT16.
+ * @param path Ruta relativa a la raíz ("dir/sub/fichero.txt").
+ * @param out  Salida con la entrada del último componente.
+ * @return     TRUE si la ruta existe, FALSE en caso contrario.
+ */
+int find_path_fat16(FILE *fp, const fat16_boot_sector *bs, const char *path, fat16_dir_entry *out) {
+    uint32_t cluster = 0;
+    int found_any = FALSE;
+    const char *p = path;
+
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        size_t len = strcspn(p, "/");
+
+        uint8_t name[11];
+        fat16_dir_entry e;
+        if (!_to_83_name(p, len, name)) return FALSE;
+        if (!_find_in_dir(fp, bs, cluster, name, &e)) return FALSE;
+        p += len;
+
+        // Un componente intermedio tiene que ser un directorio
+        if (*p == '/' && !(e.attributes & ATTR_DIRECTORY)) {
+            while (*p == '/') p++;
+            if (*p) return FALSE;
+        }
+        cluster = first_cluster_fat16(&e);
+        *out = e;
+        found_any = TRUE;
+    }
+
+    return found_any;
+}
+
+/**
+ * Devuelve la cadena de clústeres de un fichero, construyéndola la primera vez.
+ *
+ * @param fp    FILE* abierto de la imagen FAT16.
+ * @param bs    Puntero al boot sector FAT16.
+ * @param first Primer clúster del fichero.
+ * @param n     Salida: longitud de la cadena.
+ * @return      Array de clústeres (propiedad de la caché), NULL si falla.
+ */
+static const uint32_t *_get_chain(FILE *fp, const fat16_boot_sector *bs, uint32_t first, uint32_t *n) {
+    fat16_chain_cache_slot *slot = &chain_cache[first % FAT16_CHAIN_CACHE_SLOTS];
+    if (slot->fp == fp && slot->first == first && slot->clusters) {
+        *n = slot->n;
+        return slot->clusters;
+    }
+
+    free(slot->clusters);
+    memset(slot, 0, sizeof(*slot));
+
+    // Una FAT corrupta puede tener ciclos. Ninguna cadena válida pasa de
+    // g.clusters eslabones; además el ciclo se detecta con el método de Brent
+    // (memoria constante) y la cadena se corta en la primera repetición
+    fat_geometry g;
+    if (!_cached_geometry(fp, bs, &g)) return NULL;
+    uint32_t cap = 16, len = 0;
+    uint32_t mark = 0, power = 1, lam = 0;
+    uint32_t *chain = malloc(cap * sizeof(uint32_t));
+    for (uint32_t c = first; chain && c >= 2 && c < g.clusters + 2 && len < g.clusters; c = _next_cluster(fp, bs, c)) {
+        if (c == mark) {
+            // El ciclo mide lam: empieza en el primer eslabón que se repite lam más allá
+            uint32_t mu = 0;
+            while (mu + lam < len && chain[mu] != chain[mu + lam]) mu++;
+            len = mu + lam;
+            break;
+        }
+        if (lam == power) {
+            mark = c;
+            power *= 2;
+            lam = 0;
+        }
+        lam++;
+        if (len == cap) {
+            uint32_t *tmp = realloc(chain, (cap *= 2) * sizeof(uint32_t));
+            if (!tmp) { free(chain); chain = NULL; break; }
+            chain = tmp;
+        }
+        chain[len++] = c;
+    }
+    if (!chain) return NULL;
+
+    slot->fp = fp;
+    slot->first = first;
+    slot->clusters = chain;
+    slot->n = len;
+    *n = len;
+    return chain;
+}
+
+/**
+ * Cuenta los clústeres de la cadena de un fichero o directorio, con la FAT
+ * en memoria y sin leer sus datos.
+ *
+ * @param fp    FILE* abierto de la imagen FAT16.
+ * @param bs    Puntero al boot sector FAT16.
+ * @param first Primer clúster (0 = fichero vacío).
+ * @return      Número de clústeres.
+ */
+uint32_t chain_length_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t first) {
+    uint32_t n = 0;
+    if (first < 2 || !_get_chain(fp, bs, first, &n)) return 0;
+    return n;
+}
+
+/**
+ * Primer clúster de una entrada. En FAT12/16 la parte alta debe valer 0 y,
+ * si no, el clúster cae fuera del volumen y la cadena sale vacía.
+ *
+ * @param e Entrada de directorio.
+ * @return  Número de clúster.
+ */
+uint32_t first_cluster_fat16(const fat16_dir_entry *e) {
+    return (uint32_t)e->first_cluster_high << 16 | e->first_cluster_low;
+}
+
+/**
+ * Lee un rango de bytes de un fichero. El clúster de cada desplazamiento se
+ * obtiene directamente de la cadena en caché, sin recorrer los datos previos,
+ * y los clústeres consecutivos en disco se leen de una vez.
+ *
+ * @param fp     FILE* abierto de la imagen FAT16.
+ * @param bs     Puntero al boot sector FAT16.
+ * @param e      Entrada de directorio del fichero.
+ * @param offset Desplazamiento inicial.
+ * @param buf    Buffer de salida.
+ * @param len    Bytes a leer como máximo.
+ * @return       Bytes leídos (0 al final del fichero), -1 en caso de error.
+ */
+int64_t read_file_fat16(FILE *fp, const fat16_boot_sector *bs, const fat16_dir_entry *e, uint64_t offset, void *buf, size_t len) {
+    if (offset >= e->file_size) return 0;
+    if (len > e->file_size - offset) len = e->file_size - offset;
+
+    uint32_t n = 0;
+    fat_geometry g;
+    const uint32_t *chain = _get_chain(fp, bs, first_cluster_fat16(e), &n);
+    if (!chain || !_cached_geometry(fp, bs, &g)) return -1;
+
+    uint64_t data_base = g.data_start;
+    uint32_t cluster_bytes = g.cluster_bytes;
+
+    uint8_t *out = buf;
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint32_t idx = pos / cluster_bytes;
+        uint32_t coff = pos % cluster_bytes;
+        if (idx >= n) return -1;
+
+        // Extendemos la lectura mientras los clústeres sigan contiguos en disco
+        size_t chunk = cluster_bytes - coff;
+        for (uint32_t last = idx; done + chunk < len && last + 1 < n && chain[last + 1] == chain[last] + 1; last++) {
+            chunk += cluster_bytes;
+        }
+        if (chunk > len - done) chunk = len - done;
+
+        uint64_t byte = (data_base + (uint64_t)(chain[idx] - 2) * bs->sectors_per_cluster)
+                        * bs->bytes_per_sector + coff;
+        if (fseeko(fp, byte, SEEK_SET) != 0 || fread(out + done, chunk, 1, fp) != 1) return -1;
+        done += chunk;
+    }
+    return done;
+}
+
+/**
+ * Recorre las entradas vivas de un directorio (sin "." ni "..").
+ *
+ * @param fp      FILE* abierto de la imagen FAT16.
+ * @param bs      Puntero al boot sector FAT16.
+ * @param cluster Primer clúster del directorio (0 = raíz).
+ * @param cb      Callback por entrada; si devuelve distinto de 0 se para.
+ * @param ctx     Contexto para el callback.
+ * @return        0 si se ha recorrido, -1 si no se pudo leer el directorio.
+ */
+int list_dir_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, fat16_dir_cb cb, void *ctx) {
+    uint32_t entries = 0;
+    fat16_dir_entry *dir = _read_dir(fp, bs, cluster, &entries);
+    if (!dir) return -1;
+
+    uint32_t words = (entries + 63) / 64;
+    uint64_t *mask = malloc((words ? words : 1) * sizeof(uint64_t));
+    if (!mask) { free(dir); return -1; }
+    _classify_entries(dir, entries, mask);
+
+    int stop = 0;
+    for (uint32_t w = 0; w < words && !stop; w++) {
+        for (uint64_t bits = mask[w]; bits && !stop; bits &= bits - 1) {
+            const fat16_dir_entry *e = &dir[w * 64 + __builtin_ctzll(bits)];
+            char name[13];
+            format_name_fat16(e, name);
+            stop = cb(e, name, ctx);
+        }
+    }
+
+    free(mask);
+    free(dir);
+    return 0;
+}
+
+/**
+ * Lee un directorio completo tal como está en disco (raíz o cadena de clústeres).
+ *
+ * @param fp        FILE* abierto de la imagen FAT16.
+ * @param bs        Puntero al boot sector FAT16.
+ * @param cluster   Primer clúster del directorio (0 = raíz).
+ * @param n_entries Salida: número de entradas de 32 bytes leídas.
+ * @return          Buffer con las entradas (liberar con free), NULL si falla.
+ */
+fat16_dir_entry *read_dir_fat16(FILE *fp, const fat16_boot_sector *bs, uint32_t cluster, uint32_t *n_entries) {
+    return _read_dir(fp, bs, cluster, n_entries);
+}
+
+/*
+ * Contexto de la recursión de collect_files_fat16.
+ */
+typedef struct {
+    FILE *fp;
+    const fat16_boot_sector *bs;
+    const char *path;
+    fs_file_list *out;
+    const fs_walk *walk;            // Directorio que se está recorriendo
+} fat16_collect_ctx;
+
+/**
+ * Callback de list_dir_fat16: añade ficheros y desciende en subdirectorios.
+ */
+static int _collect_entry(const fat16_dir_entry *e, const char *name, void *ctx) {
+    fat16_collect_ctx *c = ctx;
+    char *child = path_join(c->path, name);
+    if (!child) return 1;
+
+    fs_walk node;
+    if (e->attributes & ATTR_DIRECTORY) {
+        fat16_collect_ctx sub = { c->fp, c->bs, child, c->out, &node };
+        if (fs_walk_enter(&node, c->walk, first_cluster_fat16(e)))
+            list_dir_fat16(c->fp, c->bs, first_cluster_fat16(e), _collect_entry, &sub);
+    } else {
+        fs_file_list_add(c->out, child, e->file_size, first_cluster_fat16(e), first_cluster_fat16(e));
+    }
+    free(child);
+    return 0;
+}
+
+/**
+ * Recoge todos los ficheros bajo una ruta (directorio o fichero).
+ *
+ * @param fp   FILE* abierto de la imagen FAT16.
+ * @param bs   Puntero al boot sector FAT16.
+ * @param path Ruta de inicio ("" o "/" para la raíz).
+ * @param out  Lista de ficheros de salida.
+ * @return     0 si tiene éxito, -1 si la ruta no existe.
+ */
+int collect_files_fat16(FILE *fp, const fat16_boot_sector *bs, const char *path, fs_file_list *out) {
+    while (*path == '/') path++;
+    fat16_dir_entry e;
+    memset(&e, 0, sizeof(e));
+    e.attributes = ATTR_DIRECTORY;
+    if (*path && !find_path_fat16(fp, bs, path, &e)) return -1;
+
+    char *base = strdup(path);
+    if (!base) return -1;
+    for (size_t n = strlen(base); n > 0 && base[n - 1] == '/'; n--) base[n - 1] = '\0';
+
+    if (e.attributes & ATTR_DIRECTORY) {
+        fs_walk top, root;
+        fs_walk_begin(&top);
+        fat16_collect_ctx ctx = { fp, bs, base, out, &root };
+        if (fs_walk_enter(&root, &top, first_cluster_fat16(&e)))
+            list_dir_fat16(fp, bs, first_cluster_fat16(&e), _collect_entry, &ctx);
+        fs_walk_end(&top);
+    } else {
+        fs_file_list_add(out, base, e.file_size, first_cluster_fat16(&e), first_cluster_fat16(&e));
+    }
+    free(base);
+    return 0;
+}
+
+/**
+ * Análisis de espacio libre ("--usage"). Recorre la FAT en orden, ventana a
+ * ventana, con el decodificador de su ancho, acumulando extents
+ * libres, utilización por tramos de FAT16_USAGE_GROUP clústeres y los saltos
+ * de las cadenas de ficheros.
+ *
+ * @param filename Ruta al archivo de imagen FAT.
+ */
+void usage_fat16(const char *filename) {
+    fat16_boot_sector bs;
+    fat_geometry g;
+    if (!read_fat16_boot_sector(filename, &bs) || !_geometry(&bs, &g)) return;
+
+    FILE *fp = image_open(filename);
+    if (!fp) {
+        fprintf(stderr, "Error opening '%s'\n", filename);
+        return;
+    }
+
+    fat16_cache_clear();
+    fat16_fat_cache_slot *fat = _get_fat(fp, &bs);
+    if (!fat) {
+        fprintf(fs_out(), "Error leyendo la FAT\n");
+        fclose(fp);
+        return;
+    }
+    uint32_t clusters = g.clusters;
+
+    usage_stats st;
+    memset(&st, 0, sizeof(st));
+    uint64_t breaks = 0, bad = 0;
+
+    fprintf(fs_out(), "\n------ Uso del sistema FAT%d ------\n", g.bits);
+    fprintf(fs_out(), "\nUTILIZACIÓN POR TRAMOS (%u clústeres)\n", FAT16_USAGE_GROUP);
+    for (uint32_t g = 0; g * FAT16_USAGE_GROUP < clusters; g++) {
+        uint32_t first = 2 + g * FAT16_USAGE_GROUP;
+        uint32_t end = first + FAT16_USAGE_GROUP;
+        if (end > clusters + 2) end = clusters + 2;
+
+        uint32_t used = 0;
+        uint32_t c = first;
+        while (c < end) {
+            // Agrupamos clústeres consecutivos con el mismo estado
+            uint32_t next = _fat_entry(fat, c);
+            int is_free = (next == 0);
+            uint32_t run = c;
+            while (run < end && (next == 0) == is_free) {
+                if (next == FAT_BAD) bad++;
+                else if (next >= 2 && next < FAT_EOC && next != run + 1) breaks++;
+                if (++run < end) next = _fat_entry(fat, run);
+            }
+            usage_feed(&st, c, run - c, is_free);
+            if (!is_free) used += run - c;
+            c = run;
+        }
+        fprintf(fs_out(), "  %5u  %6u/%-6u %5.1f%%\n", g, used, end - first, 100.0 * used / (end - first));
+    }
+    usage_finish(&st);
+
+    fprintf(fs_out(), "\nCADENAS\n");
+    fprintf(fs_out(), "  Saltos en cadenas: %llu\n", (unsigned long long)breaks);
+    fprintf(fs_out(), "  Clústeres malos..: %llu\n", (unsigned long long)bad);
+    usage_print(&st, g.cluster_bytes, "cluster");
+
+    fat16_cache_clear();
+    fclose(fp);
+}
+
+/*
+ * Contexto de la recursión de recover_fat16.
+ */
+typedef struct {
+    FILE *fp;
+    const fat16_boot_sector *bs;
+    fat16_fat_cache_slot *fat;      // Ventana de la FAT
+    uint32_t clusters;              // Clústeres de datos del volumen
+    const char *outdir;             // Directorio de extracción (NULL = listar)
+    uint64_t deleted, found, extracted;
+} fat16_recover_ctx;
+
+/**
+ * Copia a outdir los clústeres de una entrada borrada, suponiendo (como
+ * cualquier undelete de FAT) que el fichero ocupaba clústeres consecutivos.
+ *
+ * @return 0 si tiene éxito, -1 en caso de error.
+ */
+static int _recover_extract(fat16_recover_ctx *c, const fat16_dir_entry *e, const char *name) {
+    // El nombre solo no es único (mismo nombre en otro directorio, o que solo
+    // difiere en la primera letra): lo prefijamos con el primer clúster y no
+    // sobrescribimos nunca un fichero existente
+    char unique[32];
+    snprintf(unique, sizeof(unique), "cluster_%u_%s", first_cluster_fat16(e), name);
+    char *path = path_join(c->outdir, unique);
+    FILE *out = path ? fopen(path, "wbx") : NULL;
+    if (!out && path && errno == EEXIST) fprintf(stderr, "Not overwriting '%s'\n", path);
+    free(path);
+    uint8_t *buf = malloc(CAT_CHUNK_SIZE);
+    if (!out || !buf) {
+        if (out) fclose(out);
+        free(buf);
+        return -1;
+    }
+
+    fat_geometry g = c->fat->g;
+    uint64_t byte = (g.data_start + (uint64_t)(first_cluster_fat16(e) - 2) * c->bs->sectors_per_cluster)
+                    * c->bs->bytes_per_sector;
+
+    int ret = fseeko(c->fp, byte, SEEK_SET) == 0 ? 0 : -1;
+    for (uint64_t left = e->file_size; ret == 0 && left > 0; ) {
+        size_t n = left < CAT_CHUNK_SIZE ? left : CAT_CHUNK_SIZE;
+        if (fread(buf, n, 1, c->fp) != 1 || fwrite(buf, n, 1, out) != 1) ret = -1;
+        left -= n;
+    }
+    free(buf);
+    fclose(out);
+    return ret;
+}
+
+/**
+ * Recorre un directorio en busca de entradas borradas (0xE5) cuyos clústeres
+ * sigan libres en la FAT, y desciende en los subdirectorios vivos.
+ */
+static void _recover_dir(fat16_recover_ctx *c, uint32_t cluster, const char *prefix, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, cluster)) return;
+    uint32_t entries = 0;
+    fat16_dir_entry *dir = _read_dir(c->fp, c->bs, cluster, &entries);
+    if (!dir) return;
+
+    uint32_t cluster_bytes = c->fat->g.cluster_bytes;
+    for (uint32_t i = 0; i < entries && dir[i].filename[0] != 0x00; i++) {
+        const fat16_dir_entry *e = &dir[i];
+        if (e->attributes & ATTR_VOLUME_ID) continue;      // LFN o etiqueta
+        if (e->filename[0] == '.') continue;
+
+        char name[13];
+        format_name_fat16(e, name);
+        if ((uint8_t)e->filename[0] != 0xE5) {
+            // Entrada viva: solo nos interesan sus subdirectorios
+            if (e->attributes & ATTR_DIRECTORY) {
+                char *child = path_join(prefix, name);
+                if (child) _recover_dir(c, first_cluster_fat16(e), child, &node);
+                free(child);
+            }
+            continue;
+        }
+
+        // El primer carácter del nombre se pierde al borrar
+        name[0] = '_';
+        c->deleted++;
+        if (first_cluster_fat16(e) < 2 || e->file_size == 0) continue;
+
+        uint32_t n = (e->attributes & ATTR_DIRECTORY) ? 1 : (e->file_size + cluster_bytes - 1) / cluster_bytes;
+        int is_free = (uint64_t)first_cluster_fat16(e) + n <= (uint64_t)c->clusters + 2;
+        for (uint32_t k = 0; is_free && k < n; k++) is_free = _fat_entry(c->fat, first_cluster_fat16(e) + k) == 0;
+        if (!is_free) continue;
+
+        char *path = path_join(prefix, name);
+        fprintf(fs_out(), "  %-40s %10u  %s\n", path ? path : name, e->file_size,
+                          (e->attributes & ATTR_DIRECTORY) ? "<DIR>" : "");
+        free(path);
+        c->found++;
+        if (c->outdir && !(e->attributes & ATTR_DIRECTORY) && _recover_extract(c, e, name) == 0) c->extracted++;
+    }
+    free(dir);
+}
+
+/**
+ * Búsqueda de ficheros borrados ("--recover"). Lista las entradas de
+ * directorio marcadas con 0xE5 cuyos clústeres siguen libres en la FAT y,
+ * si se indica un directorio, extrae su contenido.
+ *
+ * @param filename Ruta al archivo de imagen FAT16.
+ * @param outdir   Directorio donde extraer los ficheros, o NULL para listar.
+ */
+void recover_fat16(const char *filename, const char *outdir) {
+    fat16_boot_sector bs;
+    fat_geometry g;
+    if (!read_fat16_boot_sector(filename, &bs) || !_geometry(&bs, &g)) return;
+
+    FILE *fp = image_open(filename);
+    if (!fp) {
+        fprintf(stderr, "Error opening '%s'\n", filename);
+        return;
+    }
+
+    fat16_cache_clear();
+    fat16_fat_cache_slot *fat = _get_fat(fp, &bs);
+    if (!fat) {
+        fprintf(fs_out(), "Error leyendo la FAT\n");
+        fclose(fp);
+        return;
+    }
+
+    fat16_recover_ctx ctx = { fp, &bs, fat, g.clusters, outdir, 0, 0, 0 };
+    fprintf(fs_out(), "\n------ Ficheros borrados ------\n\n");
+    fs_walk top;
+    fs_walk_begin(&top);
+    _recover_dir(&ctx, 0, "", &top);
+    fs_walk_end(&top);
+
+    fprintf(fs_out(), "\n  Entradas borradas: %llu\n", (unsigned long long)ctx.deleted);
+    fprintf(fs_out(), "  Recuperables.....: %llu\n", (unsigned long long)ctx.found);
+    if (outdir) fprintf(fs_out(), "  Extraídos........: %llu\n", (unsigned long long)ctx.extracted);
+
+    fat16_cache_clear();
+    fclose(fp);
 }
 
 /**
  * Imprime el contenido de un archivo almacenado en un sistema FAT16.
- * Lee clúster a clúster hasta que se haya mostrado todo el archivo.
+ * Sigue la cadena de clústeres desde el desplazamiento pedido hasta
+ * mostrar `length` bytes o llegar al final del archivo.
  *
  * @param file_system Ruta al archivo de imagen FAT16.
  * @param file_name   Nombre del archivo dentro del sistema FAT16.
+ * @param offset      Primer byte a mostrar.
+ * @param length      Bytes a mostrar como máximo (CAT_TO_END = hasta el final).
  */
-void cat_fat16(const char *file_system, const char *file_name) {
-    // Inicialitza l'estat de cerca
-    file_found_flag = FALSE;
-    tree_fat16(file_system, TRUE, file_name);
-
-    // Comprovem si s'ha trobat el fitxer
-    if (!file_found_flag) {
-        fprintf(stderr, "Fitxer '%s' no trobat.\n", file_name);
-        exit(EXIT_FAILURE);
-    }
+void cat_fat16(const char *file_system, const char *file_name, uint64_t offset, uint64_t length) {
+    fat16_cache_clear();
 
     // Obrim la imatge FAT16
-    FILE *fp = fopen(file_system, "rb");
+    FILE *fp = image_open(file_system);
     if (!fp) {
         perror("No s'ha pogut obrir el sistema de fitxers");
         exit(EXIT_FAILURE);
@@ -252,29 +1402,42 @@ void cat_fat16(const char *file_system, const char *file_name) {
     fat16_boot_sector bs;
     fread(&bs, sizeof(bs), 1, fp);
 
-    // Calculem el sector inicial de dades
-    uint32_t root_sectors = (bs.root_dir_entries * 32 + bs.bytes_per_sector - 1) / bs.bytes_per_sector;
-    uint32_t data_base = bs.reserved_sectors + bs.number_of_fats * bs.sectors_per_fat + root_sectors;
-
-    // Obtenim el primer clúster del fitxer
-    uint32_t cluster = ((uint32_t)file_found.first_cluster_high << 16) | file_found.first_cluster_low;
-    uint32_t first_sector = data_base + (cluster - 2) * bs.sectors_per_cluster;
-
-    uint32_t remaining = file_found.file_size;
-
-    // Bucle per llegir i imprimir el contingut
-    while (remaining > 0) {
-        uint32_t chunk = bs.bytes_per_sector;
-        if (chunk > remaining) chunk = remaining;
+    // Resolem la ruta component a component; si és només un nom i no és a
+    // l'arrel, mantenim la cerca per tot l'arbre com a alternativa
+    file_found_flag = find_path_fat16(fp, &bs, file_name, &file_found)
+                      && !(file_found.attributes & ATTR_DIRECTORY);
+    if (!file_found_flag && !strchr(file_name, '/')) {
+        tree_fat16(file_system, TRUE, file_name);
+    }
 
-        uint8_t block[chunk];
-        fseek(fp, first_sector * bs.bytes_per_sector, SEEK_SET);
-        fread(block, 1, chunk, fp);
-        fwrite(block, 1, chunk, stdout);
+    // Comprovem si s'ha trobat el fitxer
+    if (!file_found_flag) {
+        fprintf(stderr, "Fitxer '%s' no trobat.\n", file_name);
+        fclose(fp);
+        exit(EXIT_FAILURE);
+    }
 
-        remaining -= chunk;
-        first_sector++;
+    // Llegim a trossos des de l'offset; el clúster inicial surt directament
+    // de la cadena en memòria, sense llegir les dades anteriors
+    uint8_t *buf = malloc(CAT_CHUNK_SIZE);
+    if (!buf) {
+        fclose(fp);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t pos = offset;
+    uint64_t end = file_found.file_size;
+    if (length != CAT_TO_END && offset < end && length < end - offset) end = offset + length;
+    while (pos < end) {
+        size_t want = end - pos < CAT_CHUNK_SIZE ? end - pos : CAT_CHUNK_SIZE;
+        int64_t n = read_file_fat16(fp, &bs, &file_found, pos, buf, want);
+        if (n <= 0) {
+            if (n < 0) fprintf(stderr, "Error llegint '%s'.\n", file_name);
+            break;
+        }
+        fwrite(buf, 1, n, fs_out());
+        pos += n;
     }
+    free(buf);
 
     fclose(fp);
 }
\ No newline at end of file
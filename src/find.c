@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/find.h"
+
+// De más barato a más caro: se evalúan en este orden
+typedef enum { FIND_NAME, FIND_TYPE, FIND_SIZE, FIND_MTIME } find_kind;
+
+typedef struct {
+    find_kind kind;
+    int negate;
+    int cmp;                    // -1 menor que, 0 igual, 1 mayor que (-size, -mtime)
+    const char *glob;           // -name
+    char type;                  // -type: 'f', 'd' o 'l'
+    uint64_t n;                 // -size (en unidades) o -mtime (en días)
+    uint64_t unit;              // Bytes por unidad de -size
+} find_pred;
+
+typedef struct {
+    find_pred preds[FIND_MAX_PREDS];
+    int npreds;
+    const char *prune[FIND_MAX_PREDS];
+    int nprune;
+    uint32_t maxdepth;
+    int need_inode;             // Algún predicado necesita tamaño o fecha
+    int fnm_flags;
+    time_t now;
+    fs_image img;
+} find_query;
+
+/*
+ * Entrada que se está evaluando. El tipo, el tamaño y la fecha se rellenan
+ * solo cuando hacen falta.
+ */
+typedef struct {
+    const char *name;
+    uint32_t id;                // Inodo (ext2) o primer clúster (FAT16)
+    char type;                  // 'f', 'd', 'l', '?' o 0 si aún no se sabe
+    int have_meta;
+    uint64_t size;
+    int64_t mtime;
+    uint8_t ft;                 // file_type de la entrada (ext2)
+    const fat16_dir_entry *fe;  // Entrada original (FAT16)
+} find_entry;
+
+/**
+ * Parse "[+-]N" followed by an optional unit letter (only for -size).
+ */
+static int parse_number(const char *s, find_pred *p) {
+    p->cmp = *s == '+' ? 1 : *s == '-' ? -1 : 0;
+    if (p->cmp) s++;
+    if (*s < '0' || *s > '9') return -1;
+    char *end = NULL;
+    errno = 0;
+    p->n = strtoull(s, &end, 10);
+    if (errno) return -1;
+
+    p->unit = 512;
+    if (p->kind == FIND_SIZE && *end) {
+        switch (*end++) {
+            case 'c': p->unit = 1; break;
+            case 'w': p->unit = 2; break;
+            case 'b': p->unit = 512; break;
+            case 'k': p->unit = 1024; break;
+            case 'M': p->unit = 1024 * 1024; break;
+            case 'G': p->unit = 1024 * 1024 * 1024; break;
+            default: return -1;
+        }
+    }
+    return *end ? -1 : 0;
+}
+
+static int cmp_cost(const void *x, const void *y) {
+    return (int)((const find_pred *)x)->kind - (int)((const find_pred *)y)->kind;
+}
+
+/**
+ * Parse the predicates of a search.
+ *
+ * @return 0 on success, -1 if an argument is not valid.
+ */
+static int parse_query(find_query *q, int argc, char *const argv[]) {
+    q->maxdepth = UINT32_MAX;
+    for (int i = 0; i < argc; i++) {
+        int negate = FALSE;
+        if (strcmp(argv[i], "!") == 0 || strcmp(argv[i], "-not") == 0) {
+            negate = TRUE;
+            if (++i == argc) return -1;
+        }
+        if (i + 1 >= argc) return -1;
+        const char *arg = argv[i], *val = argv[++i];
+
+        if (strcmp(arg, "-maxdepth") == 0 || strcmp(arg, "-prune") == 0) {
+            if (negate) return -1;
+            if (arg[1] == 'p') {
+                if (q->nprune == FIND_MAX_PREDS) return -1;
+                q->prune[q->nprune++] = val;
+            } else {
+                char *end = NULL;
+                unsigned long d = strtoul(val, &end, 10);
+                if (*val < '0' || *val > '9' || *end || d > UINT32_MAX) return -1;
+                q->maxdepth = d;
+            }
+            continue;
+        }
+
+        if (q->npreds == FIND_MAX_PREDS) return -1;
+        find_pred *p = &q->preds[q->npreds++];
+        memset(p, 0, sizeof(*p));
+        p->negate = negate;
+        if (strcmp(arg, "-name") == 0) {
+            p->kind = FIND_NAME;
+            p->glob = val;
+        } else if (strcmp(arg, "-type") == 0) {
+            p->kind = FIND_TYPE;
+            p->type = val[0];
+            if (val[1] || !strchr("fdl", val[0])) return -1;
+        } else if (strcmp(arg, "-size") == 0 || strcmp(arg, "-mtime") == 0) {
+            p->kind = arg[1] == 's' ? FIND_SIZE : FIND_MTIME;
+            if (parse_number(val, p) != 0) return -1;
+            q->need_inode = TRUE;
+        } else {
+            return -1;
+        }
+    }
+
+    // Orden estable por coste: los nombres antes que el tipo, y este antes que el inodo
+    for (int i = 1; i < q->npreds; i++) {
+        for (int j = i; j > 0 && cmp_cost(&q->preds[j - 1], &q->preds[j]) > 0; j--) {
+            find_pred tmp = q->preds[j];
+            q->preds[j] = q->preds[j - 1];
+            q->preds[j - 1] = tmp;
+        }
+    }
+    return 0;
+}
+
+static char type_of_mode(uint16_t mode) {
+    return S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISREG(mode) ? 'f' : '?';
+}
+
+/**
+ * Fill in the size and modification time of an entry; on ext2 this is the
+ * only place the inode is read.
+ */
+static void load_meta(find_query *q, find_entry *e) {
+    if (e->have_meta) return;
+    e->have_meta = TRUE;
+
+    if (!q->img.is_ext2) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_year = (e->fe->last_write_date >> 9) + 80;
+        tm.tm_mon = ((e->fe->last_write_date >> 5) & 0x0F) - 1;
+        tm.tm_mday = e->fe->last_write_date & 0x1F;
+        tm.tm_hour = e->fe->last_write_time >> 11;
+        tm.tm_min = (e->fe->last_write_time >> 5) & 0x3F;
+        tm.tm_sec = (e->fe->last_write_time & 0x1F) * 2;
+        tm.tm_isdst = -1;
+        e->size = e->fe->file_size;
+        e->mtime = mktime(&tm);
+        return;
+    }
+
+    ext2_inode inode;
+    if (read_inode_ext2(q->img.fp, e->id, &inode) != 0) {
+        e->type = '?';
+        return;
+    }
+    e->size = ext2_file_size(&inode);
+    e->mtime = inode.i_mtime;
+    e->type = type_of_mode(inode.i_mode);
+}
+
+/**
+ * Type of an entry: free on FAT16 and on ext2 images with FILETYPE, an inode
+ * read otherwise.
+ */
+static char entry_type(find_query *q, find_entry *e) {
+    if (e->type) return e->type;
+    if (q->need_inode) {
+        load_meta(q, e);
+        return e->type;
+    }
+    switch (ext2_entry_type(q->img.fp, e->id, e->ft)) {
+        case EXT2_FT_DIR: e->type = 'd'; break;
+        case EXT2_FT_SYMLINK: e->type = 'l'; break;
+        case EXT2_FT_REG_FILE: e->type = 'f'; break;
+        default: e->type = '?';
+    }
+    return e->type;
+}
+
+static int compare(uint64_t value, const find_pred *p) {
+    return p->cmp > 0 ? value > p->n : p->cmp < 0 ? value < p->n : value == p->n;
+}
+
+static int match_pred(find_query *q, find_entry *e, const find_pred *p) {
+    switch (p->kind) {
+        case FIND_NAME:
+            return fnmatch(p->glob, e->name, q->fnm_flags) == 0;
+        case FIND_TYPE:
+            return entry_type(q, e) == p->type;
+        case FIND_SIZE:
+            load_meta(q, e);
+            return compare((e->size + p->unit - 1) / p->unit, p);
+        case FIND_MTIME:
+            load_meta(q, e);
+            return compare(e->mtime > q->now ? 0 : (uint64_t)(q->now - e->mtime) / 86400, p);
+    }
+    return FALSE;
+}
+
+static void find_dir(find_query *q, uint32_t id, const char *path, const fs_walk *parent);
+
+/**
+ * Evaluate one entry: print it if every predicate holds, then descend into
+ * it unless it is pruned or at the maximum depth.
+ */
+static void visit(find_query *q, find_entry *e, const char *dir, const fs_walk *walk) {
+    int pruned = FALSE;
+    for (int i = 0; i < q->nprune && !pruned; i++) {
+        pruned = fnmatch(q->prune[i], e->name, q->fnm_flags) == 0;
+    }
+
+    // Un directorio podado no se imprime ni se lee, sea del tipo que sea lo demás
+    int descend = walk->depth + 1 < q->maxdepth;
+    if (pruned && entry_type(q, e) == 'd') return;
+
+    int match = TRUE;
+    for (int i = 0; i < q->npreds && match; i++) {
+        match = match_pred(q, e, &q->preds[i]) != q->preds[i].negate;
+    }
+    if (!match && !descend) return;
+
+    char *path = path_join(dir, e->name);
+    if (!path) return;
+    if (match) printf("%s\n", path);
+    if (descend && entry_type(q, e) == 'd') find_dir(q, e->id, path, walk);
+    free(path);
+}
+
+/**
+ * list_dir_fat16 callback.
+ */
+typedef struct {
+    find_query *q;
+    const char *path;
+    const fs_walk *walk;
+} find_fat16_ctx;
+
+static int find_fat16_entry(const fat16_dir_entry *fe, const char *name, void *arg) {
+    find_fat16_ctx *c = arg;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+    find_entry e;
+    memset(&e, 0, sizeof(e));
+    e.name = name;
+    e.id = first_cluster_fat16(fe);
+    e.type = fe->attributes & ATTR_DIRECTORY ? 'd' : 'f';
+    e.fe = fe;
+    visit(c->q, &e, c->path, c->walk);
+    return 0;
+}
+
+/**
+ * Walk one directory of the search.
+ */
+static void find_dir(find_query *q, uint32_t id, const char *path, const fs_walk *parent) {
+    fs_walk node;
+    if (!fs_walk_enter(&node, parent, id)) return;
+
+    if (!q->img.is_ext2) {
+        find_fat16_ctx c = { q, path, &node };
+        list_dir_fat16(q->img.fp, &q->img.bs, id, find_fat16_entry, &c);
+        return;
+    }
+
+    const ext2_dir_view *v = ext2_dir_view_get(q->img.fp, id);
+    if (!v) return;
+    for (uint32_t i = 0; i < v->count; i++) {
+        const char *name = v->names + v->name_off[i];
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        find_entry e;
+        memset(&e, 0, sizeof(e));
+        e.name = name;
+        e.id = v->inodes[i];
+        e.ft = v->types[i];
+        visit(q, &e, path, &node);
+    }
+    ext2_dir_view_put(v);
+}
+
+/**
+ * Search the tree of an image ("--find"). Prints the path of every entry
+ * under the start directory that satisfies all the predicates.
+ *
+ * @param filename Path to the image file.
+ * @param path     Directory to start from ("" for the root).
+ * @param argc     Number of search arguments.
+ * @param argv     Search arguments.
+ * @return 0 on success, 1 if the image or the path cannot be read, -1 if the
+ *         arguments are not valid.
+ */
+int find_image(const char *filename, const char *path, int argc, char *const argv[]) {
+    find_query *q = calloc(1, sizeof(find_query));
+    if (!q) return 1;
+    if (parse_query(q, argc, argv) != 0) {
+        free(q);
+        return -1;
+    }
+    q->now = time(NULL);
+
+    if (fs_open(&q->img, filename) != 0) {
+        printf("Error opening the file\n");
+        free(q);
+        return 1;
+    }
+
+    while (*path == '/') path++;
+    char *base = strdup(path);
+    for (size_t n = base ? strlen(base) : 0; n > 0 && base[n - 1] == '/'; n--) base[n - 1] = '\0';
+
+    uint32_t id = 0;
+    int found = base != NULL;
+    if (q->img.is_ext2) {
+        ext2_inode inode;
+        id = lookup_path_ext2(q->img.fp, path, TRUE);
+        found = found && id && read_inode_ext2(q->img.fp, id, &inode) == 0 && S_ISDIR(inode.i_mode);
+    } else {
+        // Los nombres 8.3 no distinguen mayúsculas
+        q->fnm_flags = FNM_CASEFOLD;
+        fat16_dir_entry e;
+        if (found && *path) {
+            found = find_path_fat16(q->img.fp, &q->img.bs, path, &e) && (e.attributes & ATTR_DIRECTORY);
+            id = first_cluster_fat16(&e);
+        }
+    }
+
+    int status = 0;
+    if (!found) {
+        printf("Directory '%s' not found\n", path);
+        status = 1;
+    } else if (q->maxdepth > 0) {
+        fs_walk top;
+        fs_walk_begin(&top);
+        find_dir(q, id, base, &top);
+        fs_walk_end(&top);
+    }
+
+    free(base);
+    fs_close(&q->img);
+    free(q);
+    return status;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/fs.h"
+#include "../include/image.h"
+
+/**
+ * Open an ext2 or FAT16 image and prepare its reader.
+ *
+ * @param img      Image to fill in.
+ * @param filename Path to the image file.
+ * @return 0 on success, -1 if the image is not recognised or cannot be opened.
+ */
+int fs_open(fs_image *img, const char *filename) {
+    memset(img, 0, sizeof(*img));
+    if (is_ext2(filename)) {
+        img->is_ext2 = TRUE;
+        if (!load_superblock_ext2(filename)) return -1;
+    } else if (is_fat16(filename)) {
+        img->is_ext2 = FALSE;
+        if (!read_fat16_boot_sector(filename, &img->bs)) return -1;
+        fat16_cache_clear();
+    } else {
+        return -1;
+    }
+
+    img->fp = image_open(filename);
+    return img->fp ? 0 : -1;
+}
+
+/**
+ * Close an image opened with fs_open.
+ *
+ * @param img Image to close.
+ */
+void fs_close(fs_image *img) {
+    if (img->fp) fclose(img->fp);
+    img->fp = NULL;
+}
+
+/**
+ * Collect every regular file under a path of the image.
+ *
+ * @param img  Open image.
+ * @param path Start path ("" or "/" for the root).
+ * @param out  Output list.
+ * @return 0 on success, -1 if the path does not exist.
+ */
+int fs_collect(fs_image *img, const char *path, fs_file_list *out) {
+    if (img->is_ext2) return collect_files_ext2(img->fp, path, out);
+    return collect_files_fat16(img->fp, &img->bs, path, out);
+}
+
+/**
+ * Read a byte range of a file collected with fs_collect.
+ *
+ * @param img    Open image.
+ * @param file   The file.
+ * @param offset First byte to read.
+ * @param buf    Output buffer.
+ * @param len    Maximum number of bytes to read.
+ * @return Bytes read, or -1 on error.
+ */
+int64_t fs_read(fs_image *img, const fs_file *file, uint64_t offset, void *buf, size_t len) {
+    if (img->is_ext2) {
+        ext2_inode inode;
+        if (read_inode_ext2(img->fp, file->id, &inode) != 0) return -1;
+        return read_file_ext2(img->fp, &inode, offset, buf, len);
+    }
+
+    fat16_dir_entry e;
+    memset(&e, 0, sizeof(e));
+    e.first_cluster_low = file->id & 0xFFFF;
+    e.first_cluster_high = file->id >> 16;
+    e.file_size = file->size;
+    return read_file_fat16(img->fp, &img->bs, &e, offset, buf, len);
+}
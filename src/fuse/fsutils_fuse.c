@@ -0,0 +1,268 @@
+#define FUSE_USE_VERSION 31
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../../include/ext2.h"
+#include "../../include/fat16.h"
+#include "../../include/image.h"
+
+#define ERR_USAGE "Usage: fsutils-fuse <file system> <mount point> [FUSE options]\n"
+
+/*
+ * Estado del montaje. La imagen se abre una sola vez y se mantiene abierta,
+ * de modo que las cachés de inodos, directorios, bloques y cadenas de los
+ * lectores persisten entre operaciones.
+ */
+static struct {
+    int is_ext2;
+    FILE *fp;
+    fat16_boot_sector bs;
+} image;
+
+/**
+ * Convierte fecha y hora de una entrada FAT16 a time_t.
+ *
+ * @param date Fecha en formato FAT (año-1980, mes, día).
+ * @param time Hora en formato FAT (hora, minuto, segundos/2).
+ * @return Marca de tiempo local.
+ */
+static time_t fat16_time(uint16_t date, uint16_t time) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = ((date >> 9) & 0x7F) + 80;
+    tm.tm_mon = ((date >> 5) & 0x0F) - 1;
+    tm.tm_mday = date & 0x1F;
+    tm.tm_hour = (time >> 11) & 0x1F;
+    tm.tm_min = (time >> 5) & 0x3F;
+    tm.tm_sec = (time & 0x1F) * 2;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/**
+ * Rellena un struct stat a partir de una entrada de directorio FAT16.
+ */
+static void fat16_stat(const fat16_dir_entry *e, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    if (e->attributes & ATTR_DIRECTORY) {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+    } else {
+        st->st_mode = S_IFREG | 0444;
+        st->st_nlink = 1;
+        st->st_size = e->file_size;
+    }
+    st->st_ino = first_cluster_fat16(e);
+    st->st_mtime = fat16_time(e->last_write_date, e->last_write_time);
+    st->st_ctime = fat16_time(e->creation_date, e->creation_time);
+    st->st_atime = fat16_time(e->last_access_date, 0);
+    st->st_blocks = (e->file_size + 511) / 512;
+}
+
+/**
+ * Resuelve una ruta FAT16. La raíz no tiene entrada propia, así que se
+ * devuelve una sintética con el atributo de directorio y clúster 0.
+ */
+static int fat16_lookup(const char *path, fat16_dir_entry *e) {
+    if (path[strspn(path, "/")] == '\0') {
+        memset(e, 0, sizeof(*e));
+        e->attributes = ATTR_DIRECTORY;
+        return TRUE;
+    }
+    return find_path_fat16(image.fp, &image.bs, path, e);
+}
+
+static int fs_getattr(const char *path, struct stat *st, struct fuse_file_info *fi) {
+    (void)fi;
+    if (!image.is_ext2) {
+        fat16_dir_entry e;
+        if (!fat16_lookup(path, &e)) return -ENOENT;
+        fat16_stat(&e, st);
+        return 0;
+    }
+
+    uint32_t ino = lookup_path_ext2(image.fp, path, FALSE);
+    ext2_inode inode;
+    if (!ino || read_inode_ext2(image.fp, ino, &inode) != 0) return -ENOENT;
+
+    memset(st, 0, sizeof(*st));
+    st->st_ino = ino;
+    st->st_mode = inode.i_mode & ~0222;
+    st->st_nlink = inode.i_links_count;
+    st->st_uid = inode.i_uid;
+    st->st_gid = inode.i_gid;
+    st->st_size = ext2_file_size(&inode);
+    st->st_blocks = inode.i_blocks;
+    st->st_atime = inode.i_atime;
+    st->st_mtime = inode.i_mtime;
+    st->st_ctime = inode.i_ctime;
+    return 0;
+}
+
+static int fs_readlink(const char *path, char *buf, size_t size) {
+    if (!image.is_ext2) return -EINVAL;
+
+    uint32_t ino = lookup_path_ext2(image.fp, path, FALSE);
+    ext2_inode inode;
+    if (!ino || read_inode_ext2(image.fp, ino, &inode) != 0) return -ENOENT;
+    if (readlink_ext2(image.fp, &inode, buf, size) != 0) return -EINVAL;
+    return 0;
+}
+
+static int fs_open(const char *path, struct fuse_file_info *fi) {
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) return -EROFS;
+
+    if (!image.is_ext2) {
+        fat16_dir_entry e;
+        if (!fat16_lookup(path, &e)) return -ENOENT;
+        if (e.attributes & ATTR_DIRECTORY) return -EISDIR;
+        // Guardamos tamaño y primer clúster para no resolver la ruta en cada read
+        fi->fh = ((uint64_t)e.file_size << 32) | first_cluster_fat16(&e);
+        return 0;
+    }
+
+    uint32_t ino = lookup_path_ext2(image.fp, path, FALSE);
+    ext2_inode inode;
+    if (!ino || read_inode_ext2(image.fp, ino, &inode) != 0) return -ENOENT;
+    if (S_ISDIR(inode.i_mode)) return -EISDIR;
+    fi->fh = ino;
+    fi->keep_cache = 1;
+    return 0;
+}
+
+static int fs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+    (void)path;
+    int64_t n;
+
+    if (!image.is_ext2) {
+        fat16_dir_entry e;
+        memset(&e, 0, sizeof(e));
+        e.first_cluster_low = fi->fh & 0xFFFF;
+        e.first_cluster_high = (fi->fh >> 16) & 0xFFFF;
+        e.file_size = fi->fh >> 32;
+        n = read_file_fat16(image.fp, &image.bs, &e, offset, buf, size);
+    } else {
+        ext2_inode inode;
+        if (read_inode_ext2(image.fp, fi->fh, &inode) != 0) return -EIO;
+        n = read_file_ext2(image.fp, &inode, offset, buf, size);
+    }
+    return n < 0 ? -EIO : (int)n;
+}
+
+/*
+ * Contexto para pasar las entradas FAT16 al filler de FUSE.
+ */
+typedef struct {
+    void *buf;
+    fuse_fill_dir_t filler;
+} fat16_fill_ctx;
+
+static int fat16_fill(const fat16_dir_entry *e, const char *name, void *ctx) {
+    fat16_fill_ctx *c = ctx;
+    struct stat st;
+    fat16_stat(e, &st);
+    return c->filler(c->buf, name, &st, 0, 0);
+}
+
+static int fs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                      struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+    (void)offset;
+    (void)fi;
+    (void)flags;
+
+    if (!image.is_ext2) {
+        fat16_dir_entry e;
+        if (!fat16_lookup(path, &e)) return -ENOENT;
+        if (!(e.attributes & ATTR_DIRECTORY)) return -ENOTDIR;
+        filler(buf, ".", NULL, 0, 0);
+        filler(buf, "..", NULL, 0, 0);
+        fat16_fill_ctx ctx = { buf, filler };
+        return list_dir_fat16(image.fp, &image.bs, first_cluster_fat16(&e), fat16_fill, &ctx) == 0 ? 0 : -EIO;
+    }
+
+    uint32_t ino = lookup_path_ext2(image.fp, path, FALSE);
+    if (!ino) return -ENOENT;
+    const ext2_dir_view *v = ext2_dir_view_get(image.fp, ino);
+    if (!v) return -EIO;
+    for (uint32_t i = 0; i < v->count; i++) {
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        st.st_ino = v->inodes[i];
+        if (filler(buf, v->names + v->name_off[i], &st, 0, 0)) break;
+    }
+    ext2_dir_view_put(v);
+    return 0;
+}
+
+static void *fs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+    (void)conn;
+    cfg->kernel_cache = 1;
+    cfg->use_ino = 1;
+    return NULL;
+}
+
+static void fs_destroy(void *private_data) {
+    (void)private_data;
+    if (image.fp) fclose(image.fp);
+}
+
+static const struct fuse_operations fs_ops = {
+    .init     = fs_init,
+    .destroy  = fs_destroy,
+    .getattr  = fs_getattr,
+    .readlink = fs_readlink,
+    .open     = fs_open,
+    .read     = fs_read,
+    .readdir  = fs_readdir,
+};
+
+int main(int argc, char *argv[]) {
+    // ./fsutils-fuse <file system> <mount point> [FUSE options]
+    if (argc < 3) {
+        fprintf(stderr, ERR_USAGE);
+        return 1;
+    }
+
+    fs_limits_from_env();
+    image_options_from_env();
+    const char *fileName = argv[1];
+    if (is_ext2(fileName)) {
+        image.is_ext2 = TRUE;
+        if (!load_superblock_ext2(fileName)) return 1;
+    } else if (is_fat16(fileName)) {
+        image.is_ext2 = FALSE;
+        if (!read_fat16_boot_sector(fileName, &image.bs)) return 1;
+        fat16_cache_clear();
+    } else {
+        fprintf(stderr, "Error opening the file\n");
+        return 1;
+    }
+
+    image.fp = image_open(fileName);
+    if (!image.fp) {
+        perror("fopen");
+        return 1;
+    }
+
+    // El estado de los lectores es de cada hilo y todos comparten un FILE*:
+    // forzamos un solo hilo (este, que ya ha cargado la imagen) y solo lectura.
+    char **fargs = malloc((argc + 3) * sizeof(char *));
+    if (!fargs) return 1;
+    int n = 0;
+    fargs[n++] = argv[0];
+    for (int i = 2; i < argc; i++) fargs[n++] = argv[i];
+    fargs[n++] = "-s";
+    fargs[n++] = "-oro";
+    fargs[n] = NULL;
+
+    int ret = fuse_main(n, fargs, &fs_ops, NULL);
+    free(fargs);
+    return ret;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
+#include "../include/grep.h"
+
+/**
+ * Scalar search: memchr for the first byte, then verify the rest.
+ */
+static const uint8_t *find_scalar(const uint8_t *hay, size_t n, const uint8_t *pat, size_t m) {
+    const uint8_t *p = hay, *end = hay + n;
+    while ((size_t)(end - p) >= m) {
+        p = memchr(p, pat[0], end - p - m + 1);
+        if (!p) return NULL;
+        if (memcmp(p + 1, pat + 1, m - 1) == 0) return p;
+        p++;
+    }
+    return NULL;
+}
+
+/**
+ * Find the first occurrence of a pattern in a buffer. On x86 the candidates
+ * are filtered 16 positions at a time by comparing both the first and the
+ * last byte of the pattern with SSE2, and only those are verified.
+ *
+ * @param hay Buffer to search.
+ * @param n   Length of the buffer.
+ * @param pat Pattern.
+ * @param m   Length of the pattern (> 0).
+ * @return Pointer to the first occurrence, or NULL if there is none.
+ */
+const uint8_t *grep_find(const uint8_t *hay, size_t n, const uint8_t *pat, size_t m) {
+    if (m == 0 || n < m) return NULL;
+    if (m == 1) return memchr(hay, pat[0], n);
+
+#if defined(__x86_64__) || defined(__i386__)
+    const __m128i first = _mm_set1_epi8((char)pat[0]);
+    const __m128i last = _mm_set1_epi8((char)pat[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(hay + pos + 1, pat + 1, m - 2) == 0) return hay + pos;
+        }
+    }
+    return find_scalar(hay + i, n - i, pat, m);
+#else
+    return find_scalar(hay, n, pat, m);
+#endif
+}
+
+/**
+ * Search one file. The last m - 1 bytes of each chunk are kept in front of
+ * the next one so matches that cross a block boundary are found too.
+ *
+ * @param img  Open image.
+ * @param file File to search.
+ * @param pat  Pattern.
+ * @param m    Length of the pattern.
+ * @param buf  Work buffer of GREP_CHUNK_SIZE + m - 1 bytes.
+ * @return Number of matches.
+ */
+static uint64_t grep_file(fs_image *img, const fs_file *file, const uint8_t *pat, size_t m, uint8_t *buf) {
+    uint64_t matches = 0;
+    uint64_t pos = 0;       // File offset of the next byte to read
+    size_t carry = 0;       // Bytes kept from the previous chunk
+
+    while (pos < file->size) {
+        size_t want = file->size - pos < GREP_CHUNK_SIZE ? file->size - pos : GREP_CHUNK_SIZE;
+        int64_t n = fs_read(img, file, pos, buf + carry, want);
+        if (n <= 0) {
+            fprintf(stderr, "%s: read error\n", file->path);
+            break;
+        }
+
+        size_t len = carry + n;
+        uint64_t base = pos - carry;    // File offset of buf[0]
+        for (const uint8_t *p = buf; (p = grep_find(p, buf + len - p, pat, m)) != NULL; p++) {
+            printf("%s:%llu\n", file->path, (unsigned long long)(base + (p - buf)));
+            matches++;
+        }
+
+        carry = m - 1 < len ? m - 1 : len;
+        memmove(buf, buf + len - carry, carry);
+        pos += n;
+    }
+    return matches;
+}
+
+/**
+ * Search a literal pattern in the contents of every regular file under a
+ * path, without extracting them, and print "<path>:<offset>" per match.
+ *
+ * @param filename Path to the image file.
+ * @param pattern  Pattern to search.
+ * @param path     Start path inside the image ("" for the root).
+ */
+void grep_image(const char *filename, const char *pattern, const char *path) {
+    size_t m = strlen(pattern);
+    if (m == 0) {
+        printf("Error arguments\n");
+        return;
+    }
+
+    fs_image img;
+    if (fs_open(&img, filename) != 0) {
+        printf("Error opening the file\n");
+        return;
+    }
+
+    fs_file_list list;
+    memset(&list, 0, sizeof(list));
+    if (fs_collect(&img, path, &list) != 0) {
+        fprintf(stderr, "'%s' not found\n", path);
+        fs_close(&img);
+        return;
+    }
+
+    uint8_t *buf = malloc(GREP_CHUNK_SIZE + m);
+    if (buf) {
+        for (size_t i = 0; i < list.count; i++) {
+            grep_file(&img, &list.files[i], (const uint8_t *)pattern, m, buf);
+        }
+    }
+
+    free(buf);
+    fs_file_list_free(&list);
+    fs_close(&img);
+}
@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/hash.h"
+
+/*
+ * Trozo de un fichero en camino del lector a un hilo de hash.
+ */
+typedef struct {
+    uint8_t *data;          // Datos (NULL en el trozo de parada)
+    size_t len;
+    size_t file;            // Índice del fichero en la lista
+    int first;              // Primer trozo del fichero
+    int last;               // Último trozo del fichero
+    int error;              // Error de lectura en el fichero
+} hash_chunk;
+
+/*
+ * Resultado por fichero.
+ */
+typedef struct {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    int error;
+} hash_result;
+
+/*
+ * Hilo de hash con su cola acotada. Todos los trozos de un fichero van al
+ * mismo hilo y en orden, así que cada hilo mantiene un único contexto SHA-256.
+ */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    hash_chunk ring[HASH_QUEUE_DEPTH];
+    size_t head;
+    size_t count;
+    hash_result *results;
+} hash_worker;
+
+/**
+ * Push a chunk into a worker's queue, waiting while it is full.
+ */
+static void queue_push(hash_worker *w, const hash_chunk *c) {
+    pthread_mutex_lock(&w->lock);
+    while (w->count == HASH_QUEUE_DEPTH) pthread_cond_wait(&w->not_full, &w->lock);
+    w->ring[(w->head + w->count) % HASH_QUEUE_DEPTH] = *c;
+    w->count++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * Pop a chunk from a worker's queue, waiting while it is empty.
+ */
+static void queue_pop(hash_worker *w, hash_chunk *c) {
+    pthread_mutex_lock(&w->lock);
+    while (w->count == 0) pthread_cond_wait(&w->not_empty, &w->lock);
+    *c = w->ring[w->head];
+    w->head = (w->head + 1) % HASH_QUEUE_DEPTH;
+    w->count--;
+    pthread_cond_signal(&w->not_full);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * Hash one chunk into ctx, storing the digest when it is the file's last,
+ * and free its data.
+ */
+static void hash_chunk_apply(sha256_ctx *ctx, hash_result *results, hash_chunk *c) {
+    if (c->first) sha256_init(ctx);
+    if (c->data) sha256_update(ctx, c->data, c->len);
+    if (c->last) {
+        sha256_final(ctx, results[c->file].digest);
+        results[c->file].error = c->error;
+    }
+    free(c->data);
+}
+
+/**
+ * Worker thread: hash chunks until the stop chunk (data == NULL, last == FALSE).
+ */
+static void *hash_worker_main(void *arg) {
+    hash_worker *w = arg;
+    sha256_ctx ctx;
+
+    for (;;) {
+        hash_chunk c;
+        queue_pop(w, &c);
+        if (!c.data && !c.last) break;
+        hash_chunk_apply(&ctx, w->results, &c);
+    }
+    return NULL;
+}
+
+/*
+ * Índice de fichero con su primer bloque, para ordenar las lecturas.
+ */
+typedef struct {
+    uint64_t first_block;
+    size_t file;
+} hash_order;
+
+static int cmp_order(const void *a, const void *b) {
+    const hash_order *x = a, *y = b;
+    if (x->first_block != y->first_block) return x->first_block < y->first_block ? -1 : 1;
+    return x->file < y->file ? -1 : x->file > y->file;
+}
+
+/**
+ * Hash every regular file under a path and print "<sha256>  <path>" lines in
+ * traversal order. The calling thread reads the files in physical block order
+ * and feeds bounded queues; a pool of threads hashes while the next reads run.
+ *
+ * @param filename Path to the image file.
+ * @param path     Start path inside the image ("" for the root).
+ */
+void hash_image(const char *filename, const char *path) {
+    fs_image img;
+    if (fs_open(&img, filename) != 0) {
+        printf("Error opening the file\n");
+        return;
+    }
+
+    fs_file_list list;
+    memset(&list, 0, sizeof(list));
+    if (fs_collect(&img, path, &list) != 0) {
+        fprintf(stderr, "'%s' not found\n", path);
+        fs_close(&img);
+        return;
+    }
+
+    hash_result *results = calloc(list.count ? list.count : 1, sizeof(hash_result));
+    hash_order *order = malloc((list.count ? list.count : 1) * sizeof(hash_order));
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nworkers = cpus < 1 ? 1 : cpus > HASH_MAX_WORKERS ? HASH_MAX_WORKERS : (size_t)cpus;
+    hash_worker *workers = calloc(nworkers, sizeof(hash_worker));
+    if (!results || !order || !workers) {
+        free(results);
+        free(order);
+        free(workers);
+        fs_file_list_free(&list);
+        fs_close(&img);
+        return;
+    }
+
+    for (size_t i = 0; i < nworkers; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        pthread_cond_init(&workers[i].not_empty, NULL);
+        pthread_cond_init(&workers[i].not_full, NULL);
+        workers[i].results = results;
+    }
+    // Solo repartimos entre los hilos que se han podido crear; sin ninguno, hashea el lector
+    size_t started = 0;
+    while (started < nworkers && pthread_create(&workers[started].thread, NULL, hash_worker_main, &workers[started]) == 0)
+        started++;
+    sha256_ctx inline_ctx;
+
+    // Leemos los ficheros en orden físico para que la E/S sea lo más secuencial posible
+    for (size_t i = 0; i < list.count; i++) {
+        order[i].first_block = list.files[i].first_block;
+        order[i].file = i;
+    }
+    qsort(order, list.count, sizeof(hash_order), cmp_order);
+
+    for (size_t k = 0; k < list.count; k++) {
+        size_t f = order[k].file;
+        const fs_file *file = &list.files[f];
+        hash_worker *w = started ? &workers[k % started] : NULL;
+        uint64_t pos = 0;
+        int first = TRUE;
+
+        do {
+            hash_chunk c;
+            memset(&c, 0, sizeof(c));
+            c.file = f;
+            c.first = first;
+            size_t want = file->size - pos < HASH_CHUNK_SIZE ? file->size - pos : HASH_CHUNK_SIZE;
+            if (want) {
+                c.data = malloc(want);
+                int64_t n = c.data ? fs_read(&img, file, pos, c.data, want) : -1;
+                if (n != (int64_t)want) c.error = TRUE;
+                c.len = n > 0 ? (size_t)n : 0;
+                pos += want;
+            }
+            c.last = (pos >= file->size) || c.error;
+            if (w) queue_push(w, &c);
+            else hash_chunk_apply(&inline_ctx, results, &c);
+            first = FALSE;
+            if (c.error) break;
+        } while (pos < file->size);
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        hash_chunk stop;
+        memset(&stop, 0, sizeof(stop));
+        queue_push(&workers[i], &stop);
+    }
+    for (size_t i = 0; i < nworkers; i++) {
+        if (i < started) pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].lock);
+        pthread_cond_destroy(&workers[i].not_empty);
+        pthread_cond_destroy(&workers[i].not_full);
+    }
+
+    for (size_t i = 0; i < list.count; i++) {
+        if (results[i].error) {
+            fprintf(stderr, "%s: read error\n", list.files[i].path);
+            continue;
+        }
+        char hex[2 * SHA256_DIGEST_SIZE + 1];
+        sha256_hex(results[i].digest, hex);
+        printf("%s  %s\n", hex, list.files[i].path);
+    }
+
+    free(workers);
+    free(order);
+    free(results);
+    fs_file_list_free(&list);
+    fs_close(&img);
+}
@@ -0,0 +1,623 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../include/image.h"
+
+#define QCOW2_MAGIC         0x514649FBu             // "QFI\xfb"
+#define QCOW2_OFFSET_MASK   0x00fffffffffffe00ULL   // Desplazamiento en las entradas L1/L2
+#define QCOW2_COMPRESSED    (1ULL << 62)
+#define QCOW2_ZERO          1ULL                    // Clúster de ceros (qcow2 v3)
+#define ZSTD_FRAME_MAGIC    0xFD2FB528u
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1u             // Pie de la tabla de saltos
+#define ZSTD_SEEK_FOOTER    9
+
+enum { IMAGE_RAW, IMAGE_QCOW2, IMAGE_ZSTD };
+
+// Modo de E/S directa (FSUTILS_DIRECT): se decide una vez al arrancar
+static int direct_io = 0;
+
+typedef struct {
+    uint64_t idx;               // Trozo guardado (UINT64_MAX si el hueco está libre)
+    uint64_t used;              // Último acceso, para expulsar el menos reciente
+    uint8_t *data;
+} image_chunk;
+
+struct image_source {
+    char *name;
+    int refs;
+    int kind;
+    int fd;                     // Fichero de la imagen
+    int direct;                 // Lecturas alineadas a través de la caché propia
+    int drop_cache;             // Sin O_DIRECT: se descarta lo leído de la caché de páginas
+    uint8_t *bulk;              // Buffer alineado para lecturas grandes (modo directo)
+    uint64_t size;              // Tamaño de la imagen descomprimida
+    struct image_source *next;
+
+    // qcow2
+    uint32_t cluster_bits;
+    uint32_t l1_size;
+    uint64_t *l1;
+
+    // zstd seekable: inicio de cada frame en el fichero y en la imagen (nframes + 1)
+    uint32_t nframes;
+    uint64_t *frame_in;
+    uint64_t *frame_out;
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *dctx;
+#endif
+
+    uint32_t chunk_max;         // Tamaño máximo de un trozo descomprimido
+    uint8_t *zbuf;              // Datos comprimidos de un trozo
+    size_t zbuf_len;
+
+    pthread_mutex_t lock;       // Protege la caché y zbuf
+    image_chunk *cache;
+    uint32_t slots;
+    uint64_t clock;
+};
+
+static image_source *open_sources = NULL;
+static pthread_mutex_t sources_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t be64(const uint8_t *p) {
+    return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+/**
+ * pread until len bytes are read or the end of the file is reached.
+ *
+ * @return Bytes read, or -1 on error.
+ */
+static int64_t read_at(int fd, void *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (uint8_t *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+/**
+ * Read from the image file of a source. In direct mode without O_DIRECT the
+ * range is dropped from the page cache right after it is read.
+ */
+static int64_t src_read(image_source *src, void *buf, size_t len, uint64_t offset) {
+    int64_t n = read_at(src->fd, buf, len, offset);
+    if (src->drop_cache && n > 0) posix_fadvise(src->fd, (off_t)offset, n, POSIX_FADV_DONTNEED);
+    return n;
+}
+
+/**
+ * Explain why an image cannot be read. The readers open the same image
+ * several times, so each file is only reported once.
+ */
+static void unsupported(const char *filename, const char *why) {
+    static _Thread_local char last[4096];
+    if (strcmp(last, filename) != 0) {
+        fprintf(stderr, "%s: %s\n", filename, why);
+        snprintf(last, sizeof(last), "%s", filename);
+    }
+    errno = ENOTSUP;
+}
+
+/**
+ * Parse a qcow2 header and load its L1 table. Images with a backing file,
+ * encryption or a compression method other than deflate are rejected.
+ */
+static int open_qcow2(image_source *src) {
+    uint8_t h[104];
+    memset(h, 0, sizeof(h));
+    if (src_read(src, h, sizeof(h), 0) < 72) return -1;
+
+    uint32_t version = be32(h + 4);
+    uint64_t backing = be64(h + 8);
+    src->cluster_bits = be32(h + 20);
+    src->size = be64(h + 24);
+    uint32_t crypt = be32(h + 32);
+    src->l1_size = be32(h + 36);
+    uint64_t l1_offset = be64(h + 40);
+    uint64_t incompatible = version >= 3 ? be64(h + 72) : 0;
+
+    if (version != 2 && version != 3) { unsupported(src->name, "unsupported qcow2 version"); return -1; }
+    if (backing) { unsupported(src->name, "qcow2 images with a backing file are not supported"); return -1; }
+    if (crypt) { unsupported(src->name, "encrypted qcow2 images are not supported"); return -1; }
+    // Bit 0: imagen sucia, bit 1: marcada como corrupta. El resto cambia el formato
+    if (incompatible & ~3ULL) { unsupported(src->name, "unsupported qcow2 features"); return -1; }
+    if (src->cluster_bits < 9 || src->cluster_bits > 21) { unsupported(src->name, "bad qcow2 cluster size"); return -1; }
+
+    uint32_t l2_bits = src->cluster_bits - 3;
+    uint64_t needed = (src->size + (1ULL << (src->cluster_bits + l2_bits)) - 1) >> (src->cluster_bits + l2_bits);
+    if (src->l1_size < needed || src->l1_size > (1u << 25)) { unsupported(src->name, "bad qcow2 L1 table"); return -1; }
+
+    src->l1 = malloc((size_t)src->l1_size * sizeof(uint64_t) + 1);
+    if (!src->l1) return -1;
+    if (src_read(src, src->l1, (size_t)src->l1_size * sizeof(uint64_t), l1_offset) !=
+        (int64_t)src->l1_size * (int64_t)sizeof(uint64_t)) return -1;
+    for (uint32_t i = 0; i < src->l1_size; i++) src->l1[i] = be64((const uint8_t *)&src->l1[i]) & QCOW2_OFFSET_MASK;
+
+    src->chunk_max = 1u << src->cluster_bits;
+    // Un clúster comprimido ocupa como mucho (2^(cluster_bits-8)) sectores de 512 bytes
+    src->zbuf_len = (size_t)src->chunk_max * 2;
+    return 0;
+}
+
+/**
+ * Read one cluster of a qcow2 image: unallocated and zero clusters read as
+ * zeros, compressed ones are inflated.
+ */
+static int load_qcow2(image_source *src, uint64_t idx, uint8_t *out, uint32_t len) {
+    uint32_t cb = src->cluster_bits;
+    uint32_t l2_bits = cb - 3;
+    uint64_t l1_index = idx >> l2_bits;
+    uint64_t l2_offset = l1_index < src->l1_size ? src->l1[l1_index] : 0;
+    memset(out, 0, len);
+    if (!l2_offset) return 0;
+
+    uint8_t raw[8];
+    uint64_t l2_index = idx & ((1ULL << l2_bits) - 1);
+    if (src_read(src, raw, 8, l2_offset + l2_index * 8) != 8) return -1;
+    uint64_t entry = be64(raw);
+
+    if (!(entry & QCOW2_COMPRESSED)) {
+        uint64_t host = entry & QCOW2_OFFSET_MASK;
+        if ((entry & QCOW2_ZERO) || !host) return 0;
+        return src_read(src, out, len, host) == (int64_t)len ? 0 : -1;
+    }
+
+#ifdef HAVE_ZLIB
+    uint32_t x = 62 - (cb - 8);
+    uint64_t host = entry & ((1ULL << x) - 1);
+    uint64_t sectors = ((entry >> x) & ((1ULL << (cb - 8)) - 1)) + 1;
+    size_t clen = sectors * 512 - (host & 511);
+    int64_t got = src_read(src, src->zbuf, clen, host);
+    if (got <= 0) return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -12) != Z_OK) return -1;
+    zs.next_in = src->zbuf;
+    zs.avail_in = got;
+    zs.next_out = out;
+    zs.avail_out = len;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END || zs.avail_out == 0 ? 0 : -1;
+#else
+    (void)len;
+    unsupported(src->name, "compressed qcow2 clusters need zlib support");
+    return -1;
+#endif
+}
+
+/**
+ * Load the seek table of a zstd image in the seekable format: a skippable
+ * frame at the end of the file that lists the compressed and decompressed
+ * size of every frame.
+ */
+static int open_zstd(image_source *src) {
+#ifdef HAVE_ZSTD
+    struct stat st;
+    uint8_t foot[ZSTD_SEEK_FOOTER];
+    if (fstat(src->fd, &st) != 0 || st.st_size < ZSTD_SEEK_FOOTER ||
+        src_read(src, foot, sizeof(foot), st.st_size - ZSTD_SEEK_FOOTER) != ZSTD_SEEK_FOOTER) return -1;
+    if (le32(foot + 5) != ZSTD_SEEKABLE_MAGIC) {
+        unsupported(src->name, "zstd image without a seek table; recompress it in the seekable format");
+        return -1;
+    }
+
+    src->nframes = le32(foot);
+    uint32_t entry = foot[4] & 0x80 ? 12 : 8;
+    uint64_t table_len = (uint64_t)src->nframes * entry;
+    if (table_len + 8 + ZSTD_SEEK_FOOTER > (uint64_t)st.st_size) { unsupported(src->name, "bad zstd seek table"); return -1; }
+    uint64_t table_start = st.st_size - ZSTD_SEEK_FOOTER - table_len;
+
+    uint8_t *table = malloc(table_len + 1);
+    src->frame_in = malloc(((size_t)src->nframes + 1) * sizeof(uint64_t));
+    src->frame_out = malloc(((size_t)src->nframes + 1) * sizeof(uint64_t));
+    src->dctx = ZSTD_createDCtx();
+    if (!table || !src->frame_in || !src->frame_out || !src->dctx ||
+        src_read(src, table, table_len, table_start) != (int64_t)table_len) {
+        free(table);
+        return -1;
+    }
+
+    uint64_t in = 0, out = 0;
+    size_t zmax = 0;
+    for (uint32_t i = 0; i < src->nframes; i++) {
+        uint32_t csize = le32(table + (size_t)i * entry);
+        uint32_t dsize = le32(table + (size_t)i * entry + 4);
+        src->frame_in[i] = in;
+        src->frame_out[i] = out;
+        in += csize;
+        out += dsize;
+        if (dsize > src->chunk_max) src->chunk_max = dsize;
+        if (csize > zmax) zmax = csize;
+    }
+    src->frame_in[src->nframes] = in;
+    src->frame_out[src->nframes] = out;
+    free(table);
+
+    if (in > table_start - 8 || src->chunk_max > IMAGE_MAX_CHUNK || zmax > ZSTD_compressBound(IMAGE_MAX_CHUNK)) {
+        unsupported(src->name, "bad zstd seek table");
+        return -1;
+    }
+    src->size = out;
+    src->zbuf_len = zmax;
+    return 0;
+#else
+    unsupported(src->name, "zstd images need zstd support (rebuild with libzstd)");
+    return -1;
+#endif
+}
+
+/**
+ * Decompress one frame of a seekable zstd image.
+ */
+static int load_zstd(image_source *src, uint64_t idx, uint8_t *out, uint32_t len) {
+#ifdef HAVE_ZSTD
+    size_t clen = src->frame_in[idx + 1] - src->frame_in[idx];
+    if (src_read(src, src->zbuf, clen, src->frame_in[idx]) != (int64_t)clen) return -1;
+    size_t n = ZSTD_decompressDCtx(src->dctx, out, len, src->zbuf, clen);
+    return !ZSTD_isError(n) && n == len ? 0 : -1;
+#else
+    (void)src; (void)idx; (void)out; (void)len;
+    return -1;
+#endif
+}
+
+/**
+ * Read one chunk of a raw image in direct mode. The length is rounded up to
+ * the alignment O_DIRECT asks for; the buffer has room for it.
+ */
+static int load_raw(image_source *src, uint64_t idx, uint8_t *out, uint32_t len) {
+    uint32_t aligned = (len + IMAGE_DIRECT_ALIGN - 1) & ~(uint32_t)(IMAGE_DIRECT_ALIGN - 1);
+    return src_read(src, out, aligned, idx << src->cluster_bits) < (int64_t)len ? -1 : 0;
+}
+
+/**
+ * Find the chunk that holds a byte of the decompressed image.
+ */
+static void locate(const image_source *src, uint64_t offset, uint64_t *idx, uint64_t *start, uint32_t *len) {
+    if (src->kind != IMAGE_ZSTD) {
+        *idx = offset >> src->cluster_bits;
+        *start = *idx << src->cluster_bits;
+        uint64_t left = src->size - *start;
+        *len = left < src->chunk_max ? left : src->chunk_max;
+        return;
+    }
+
+    // Último frame que empieza antes del desplazamiento (los vacíos quedan atrás)
+    uint32_t lo = 0, hi = src->nframes;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (src->frame_out[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    *idx = lo;
+    *start = src->frame_out[lo];
+    *len = src->frame_out[lo + 1] - src->frame_out[lo];
+}
+
+/**
+ * Look a chunk up in the cache, decompressing it into the least recently
+ * used slot on a miss. Called with the source locked.
+ *
+ * @return The chunk data, or NULL on error.
+ */
+static const uint8_t *get_chunk(image_source *src, uint64_t idx, uint32_t len) {
+    image_chunk *victim = &src->cache[0];
+    src->clock++;
+    for (uint32_t i = 0; i < src->slots; i++) {
+        image_chunk *c = &src->cache[i];
+        if (c->idx == idx) {
+            c->used = src->clock;
+            return c->data;
+        }
+        if (c->used < victim->used) victim = c;
+    }
+
+    if (!victim->data && posix_memalign((void **)&victim->data, IMAGE_DIRECT_ALIGN, src->chunk_max) != 0) {
+        victim->data = NULL;
+        return NULL;
+    }
+    victim->idx = UINT64_MAX;
+    int ret = src->kind == IMAGE_QCOW2 ? load_qcow2(src, idx, victim->data, len)
+            : src->kind == IMAGE_ZSTD ? load_zstd(src, idx, victim->data, len)
+            : load_raw(src, idx, victim->data, len);
+    if (ret != 0) return NULL;
+    victim->idx = idx;
+    victim->used = src->clock;
+    return victim->data;
+}
+
+static void free_source(image_source *src) {
+    if (!src) return;
+    if (src->fd >= 0) close(src->fd);
+    for (uint32_t i = 0; src->cache && i < src->slots; i++) free(src->cache[i].data);
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(src->dctx);
+#endif
+    free(src->cache);
+    free(src->bulk);
+    free(src->zbuf);
+    free(src->l1);
+    free(src->frame_in);
+    free(src->frame_out);
+    free(src->name);
+    free(src);
+}
+
+/**
+ * Open an image file and work out its format from the first bytes.
+ */
+static image_source *open_source(const char *filename) {
+    image_source *src = calloc(1, sizeof(image_source));
+    if (!src) return NULL;
+    src->fd = open(filename, O_RDONLY);
+    src->name = strdup(filename);
+    if (src->fd < 0 || !src->name) {
+        free_source(src);
+        return NULL;
+    }
+
+    uint8_t magic[4] = { 0, 0, 0, 0 };
+    read_at(src->fd, magic, sizeof(magic), 0);
+    int ret = 0;
+    if (be32(magic) == QCOW2_MAGIC) {
+        src->kind = IMAGE_QCOW2;
+        ret = open_qcow2(src);
+    } else if (le32(magic) == ZSTD_FRAME_MAGIC) {
+        src->kind = IMAGE_ZSTD;
+        ret = open_zstd(src);
+    } else if (magic[0] == 0x1f && magic[1] == 0x8b) {
+        unsupported(filename, "gzip images cannot be read in place; recompress them as seekable zstd");
+        ret = -1;
+    } else {
+        struct stat st;
+        src->kind = IMAGE_RAW;
+        ret = fstat(src->fd, &st);
+        src->size = st.st_size;
+    }
+
+    if (ret == 0 && direct_io) {
+        src->direct = 1;
+        src->drop_cache = src->kind != IMAGE_RAW;
+    }
+    if (ret == 0 && src->kind == IMAGE_RAW && src->direct) {
+        // Algunos sistemas de ficheros (tmpfs) no admiten O_DIRECT
+        int fd = open(filename, O_RDONLY | O_DIRECT);
+        if (fd >= 0) {
+            close(src->fd);
+            src->fd = fd;
+        } else {
+            src->drop_cache = 1;
+            posix_fadvise(src->fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        src->cluster_bits = IMAGE_DIRECT_CHUNK_BITS;
+        src->chunk_max = 1u << IMAGE_DIRECT_CHUNK_BITS;
+        if (posix_memalign((void **)&src->bulk, IMAGE_DIRECT_ALIGN, IMAGE_DIRECT_BULK) != 0) {
+            src->bulk = NULL;
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && (src->kind != IMAGE_RAW || src->direct)) {
+        src->slots = (src->kind == IMAGE_RAW ? IMAGE_DIRECT_CACHE_BYTES : IMAGE_CACHE_BYTES) / src->chunk_max;
+        if (src->slots < IMAGE_CACHE_MIN_SLOTS) src->slots = IMAGE_CACHE_MIN_SLOTS;
+        src->cache = calloc(src->slots, sizeof(image_chunk));
+        src->zbuf = malloc(src->zbuf_len ? src->zbuf_len : 1);
+        if (!src->cache || !src->zbuf) ret = -1;
+        for (uint32_t i = 0; src->cache && i < src->slots; i++) src->cache[i].idx = UINT64_MAX;
+    }
+    if (ret != 0) {
+        int err = errno;
+        free_source(src);
+        errno = err;
+        return NULL;
+    }
+    pthread_mutex_init(&src->lock, NULL);
+    return src;
+}
+
+/**
+ * Open the block source of an image, sharing it with any other open of the
+ * same file so the chunk cache survives the readers reopening the image.
+ *
+ * @param filename Path to the image file.
+ * @return The source, or NULL on error.
+ */
+image_source *image_source_get(const char *filename) {
+    pthread_mutex_lock(&sources_lock);
+    image_source *src = open_sources;
+    while (src && strcmp(src->name, filename) != 0) src = src->next;
+    if (!src && (src = open_source(filename))) {
+        src->next = open_sources;
+        open_sources = src;
+    }
+    if (src) src->refs++;
+    pthread_mutex_unlock(&sources_lock);
+    return src;
+}
+
+/**
+ * Drop a reference to a block source; the last one closes it.
+ *
+ * @param src Source to release.
+ */
+void image_source_put(image_source *src) {
+    if (!src) return;
+    pthread_mutex_lock(&sources_lock);
+    if (--src->refs == 0) {
+        image_source **p = &open_sources;
+        while (*p != src) p = &(*p)->next;
+        *p = src->next;
+        pthread_mutex_destroy(&src->lock);
+        free_source(src);
+    }
+    pthread_mutex_unlock(&sources_lock);
+}
+
+/**
+ * Large read of a raw image in direct mode: straight into the pooled aligned
+ * buffer, without going through the chunk cache, so that file data does not
+ * push out the metadata kept there.
+ */
+static int64_t read_bulk(image_source *src, void *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    pthread_mutex_lock(&src->lock);
+    while (done < len && offset < src->size) {
+        uint64_t start = offset & ~(uint64_t)(IMAGE_DIRECT_ALIGN - 1);
+        uint64_t end = (offset + (len - done) + IMAGE_DIRECT_ALIGN - 1) & ~(uint64_t)(IMAGE_DIRECT_ALIGN - 1);
+        size_t want = end - start < IMAGE_DIRECT_BULK ? end - start : IMAGE_DIRECT_BULK;
+        int64_t got = src_read(src, src->bulk, want, start);
+        if (got < 0) {
+            pthread_mutex_unlock(&src->lock);
+            return -1;
+        }
+        if ((uint64_t)got <= offset - start) break;
+        size_t n = got - (offset - start);
+        if (n > len - done) n = len - done;
+        memcpy((uint8_t *)buf + done, src->bulk + (offset - start), n);
+        done += n;
+        offset += n;
+        if ((size_t)got < want) break;
+    }
+    pthread_mutex_unlock(&src->lock);
+    return done;
+}
+
+/**
+ * Read a range of the decompressed image, going through the chunk cache for
+ * qcow2 and zstd images and for raw images in direct mode.
+ *
+ * @param src    Source to read from.
+ * @param buf    Output buffer.
+ * @param len    Bytes to read.
+ * @param offset Offset in the decompressed image.
+ * @return Bytes read (short at the end of the image), or -1 on error.
+ */
+int64_t image_pread(image_source *src, void *buf, size_t len, uint64_t offset) {
+    if (src->kind == IMAGE_RAW && !src->direct) return read_at(src->fd, buf, len, offset);
+    if (src->kind == IMAGE_RAW && len >= (1u << IMAGE_DIRECT_CHUNK_BITS)) return read_bulk(src, buf, len, offset);
+
+    size_t done = 0;
+    pthread_mutex_lock(&src->lock);
+    while (done < len && offset < src->size) {
+        uint64_t idx, start;
+        uint32_t clen;
+        locate(src, offset, &idx, &start, &clen);
+        const uint8_t *data = get_chunk(src, idx, clen);
+        if (!data) {
+            pthread_mutex_unlock(&src->lock);
+            return -1;
+        }
+        size_t n = start + clen - offset;
+        if (n > len - done) n = len - done;
+        memcpy((uint8_t *)buf + done, data + (offset - start), n);
+        done += n;
+        offset += n;
+    }
+    pthread_mutex_unlock(&src->lock);
+    return done;
+}
+
+uint64_t image_size(const image_source *src) {
+    return src->size;
+}
+
+/*
+ * Posición de lectura de un FILE abierto con image_open sobre un origen
+ * comprimido.
+ */
+typedef struct {
+    image_source *src;
+    uint64_t pos;
+} image_cookie;
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t size) {
+    image_cookie *c = cookie;
+    int64_t n = image_pread(c->src, buf, size, c->pos);
+    if (n < 0) return -1;
+    c->pos += n;
+    return n;
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence) {
+    image_cookie *c = cookie;
+    int64_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? (int64_t)c->pos : (int64_t)c->src->size;
+    if (*offset < -base) return -1;
+    c->pos = base + *offset;
+    *offset = c->pos;
+    return 0;
+}
+
+static int cookie_close(void *cookie) {
+    image_cookie *c = cookie;
+    image_source_put(c->src);
+    free(c);
+    return 0;
+}
+
+/**
+ * Open an image for reading with stdio. Raw images are opened as they are;
+ * qcow2 and zstd images, and raw ones in direct mode, get a FILE that reads
+ * through their block source.
+ *
+ * @param filename Path to the image file.
+ * @return Read-only FILE, or NULL on error.
+ */
+FILE *image_open(const char *filename) {
+    image_source *src = image_source_get(filename);
+    if (!src) return NULL;
+    if (src->kind == IMAGE_RAW && !src->direct) {
+        image_source_put(src);
+        return fopen(filename, "rb");
+    }
+
+    image_cookie *c = malloc(sizeof(image_cookie));
+    cookie_io_functions_t io = { cookie_read, NULL, cookie_seek, cookie_close };
+    FILE *fp = c ? fopencookie(c, "rb", io) : NULL;
+    if (!fp) {
+        free(c);
+        image_source_put(src);
+        return NULL;
+    }
+    c->src = src;
+    c->pos = 0;
+    return fp;
+}
+
+/**
+ * Read the I/O mode from the environment: FSUTILS_DIRECT=1 opens raw images
+ * with O_DIRECT and reads them through aligned buffers and the chunk cache,
+ * keeping image data out of the page cache.
+ */
+void image_options_from_env(void) {
+    const char *v = getenv("FSUTILS_DIRECT");
+    direct_io = v && *v && strcmp(v, "0") != 0;
+}
@@ -1,8 +1,20 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
+#include "../include/batch.h"
 #include "../include/ext2.h"
+#include "../include/check.h"
+#include "../include/diff.h"
+#include "../include/du.h"
 #include "../include/fat16.h"
+#include "../include/find.h"
+#include "../include/grep.h"
+#include "../include/hash.h"
+#include "../include/image.h"
+#include "../include/sort.h"
 
 #define ERR_OPEN_FILE "Error opening the file\n"
 
@@ -11,11 +23,13 @@
 * This function retrieves the metadata of the file system.
 * It checks the file system type and calls the appropriate function to retrieve the metadata.
 * @param fileName The name of the file system image.
+* @return 0 on success, 1 if the file system is not recognised.
 */
-void phase1(const char *fileName) {
+int phase1(const char *fileName) {
     if (is_ext2(fileName)) metadata_ext2(fileName);
     else if (is_fat16(fileName)) metadata_fat16(fileName);
-    else printf(ERR_OPEN_FILE);
+    else { fprintf(fs_out(), ERR_OPEN_FILE); return 1; }
+    return 0;
 }
 
 /**
@@ -23,24 +37,129 @@ void phase1(const char *fileName) {
  * This function retrieves the file system tree.
  * It checks the file system type and calls the appropriate function to retrieve the tree.
  * @param fileName The name of the file system image.
+ * @return 0 on success, 1 if the file system is not recognised.
  */
-void phase2(const char *fileName) {
+int phase2(const char *fileName) {
     if (is_ext2(fileName)) tree_ext2(fileName);
     else if (is_fat16(fileName)) tree_fat16(fileName, FALSE, "");
-    else printf(ERR_OPEN_FILE);
+    else { fprintf(fs_out(), ERR_OPEN_FILE); return 1; }
+    return 0;
 }
 
 /**
- * Phase 3 of the project. FILE CONTENTS RETRIEVAL.
- * This function retrieves the contents of a file.
+ * Phase 3 and 4 of the project. FILE CONTENTS RETRIEVAL.
+ * This function retrieves the contents of a file, or of a byte range of it.
  * It checks the file system type and calls the appropriate function to retrieve the contents.
  * @param fileName The name of the file system image.
  * @param file The name of the file to retrieve contents from.
+ * @param offset First byte to retrieve.
+ * @param length Maximum number of bytes to retrieve (CAT_TO_END for all).
+ */
+void phase3(const char *fileName, const char *file, uint64_t offset, uint64_t length) {
+    if (is_ext2(fileName)) cat_ext2(fileName, file, offset, length);
+    else if (is_fat16(fileName)) cat_fat16(fileName, file, offset, length);
+    else printf(ERR_OPEN_FILE);
+}
+
+/**
+ * Parses the optional "--offset N" and "--length M" arguments of --cat.
+ * @param argc Number of arguments.
+ * @param argv Arguments; options start at argv[4].
+ * @param offset Output: offset, 0 if not given.
+ * @param length Output: length, CAT_TO_END if not given.
+ * @return TRUE if every option is valid, FALSE otherwise.
+ */
+int parse_cat_options(int argc, char *argv[], uint64_t *offset, uint64_t *length) {
+    *offset = 0;
+    *length = CAT_TO_END;
+    for (int i = 4; i < argc; i += 2) {
+        if (i + 1 >= argc) return FALSE;
+        char *end = NULL;
+        errno = 0;
+        unsigned long long value = strtoull(argv[i + 1], &end, 0);
+        if (errno || end == argv[i + 1] || *end != '\0' || argv[i + 1][0] == '-') return FALSE;
+
+        if (strcmp(argv[i], "--offset") == 0) *offset = value;
+        else if (strcmp(argv[i], "--length") == 0) *length = value;
+        else return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * FREE SPACE ANALYSIS.
+ * This function reports free extents, fragmentation and per-group utilisation.
+ * It checks the file system type and calls the appropriate function to scan the bitmaps or the FAT.
+ * @param fileName The name of the file system image.
+ */
+void phase_usage(const char *fileName) {
+    if (is_ext2(fileName)) usage_ext2(fileName);
+    else if (is_fat16(fileName)) usage_fat16(fileName);
+    else printf(ERR_OPEN_FILE);
+}
+
+/**
+ * List deleted files that can still be recovered, optionally extracting them.
+ * @param fileName Path to the file system image.
+ * @param outDir Directory to extract the files into, or NULL to only list them.
+ */
+void phase_recover(const char *fileName, const char *outDir) {
+    if (is_ext2(fileName)) recover_ext2(fileName, outDir);
+    else if (is_fat16(fileName)) recover_fat16(fileName, outDir);
+    else printf(ERR_OPEN_FILE);
+}
+
+/**
+ * Check the metadata of an EXT2 image for consistency.
+ * @param fileName Path to the file system image.
+ * @return 0 if the image is clean, 1 otherwise.
+ */
+int phase_check(const char *fileName) {
+    if (is_ext2(fileName)) return check_ext2(fileName) == 0 ? 0 : 1;
+    if (is_fat16(fileName)) printf("--check is only available for EXT2\n");
+    else printf(ERR_OPEN_FILE);
+    return 1;
+}
+
+/**
+ * List every inode in use of an EXT2 image in inode-table order.
+ * @param fileName Path to the file system image.
+ * @return 0 on success, 1 if the image is not EXT2.
  */
-void phase3(const char *fileName, const char *file) {
-    if (is_ext2(fileName)) printf("cat for ext2 still not implemented (phase 4)\n");
-    else if (is_fat16(fileName)) cat_fat16(fileName, file);
+int phase_list_inodes(const char *fileName) {
+    if (is_ext2(fileName)) { list_inodes_ext2(fileName); return 0; }
+    if (is_fat16(fileName)) printf("--list-inodes is only available for EXT2\n");
     else printf(ERR_OPEN_FILE);
+    return 1;
+}
+
+/**
+ * Resolves an image argument: the path as given when it exists, otherwise the
+ * same name under res/, where the sample images live.
+ * @param arg The image argument.
+ * @return A newly allocated path.
+ */
+char *image_path(const char *arg) {
+    struct stat st;
+    if (stat(arg, &st) == 0) return strdup(arg);
+    return path_join("res", arg);
+}
+
+/**
+ * Runs --info or --tree over several images, or over a directory of images.
+ * @param fn phase1 or phase2.
+ * @param argc Number of arguments.
+ * @param argv Arguments; images start at argv[2].
+ * @return 0 if every image was read, 1 otherwise.
+ */
+int phase_batch(batch_fn fn, int argc, char *argv[]) {
+    char **paths = calloc(argc - 2, sizeof(char *));
+    if (!paths) return 1;
+    for (int i = 2; i < argc; i++) paths[i - 2] = image_path(argv[i]);
+    int failed = batch_run(fn, paths, argc - 2);
+    for (int i = 2; i < argc; i++) free(paths[i - 2]);
+    free(paths);
+    return failed ? 1 : 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -48,7 +167,10 @@ int main(int argc, char *argv[]) {
     // ./fsutils --info <file system>
 
     // PHASE 2
-    // ./fsutils --tree <file system>
+    // ./fsutils --tree [--sort=name|size|mtime] <file system>
+
+    // MANY IMAGES (in parallel)
+    // ./fsutils --info|--tree <file system or directory> [...]
 
     // PHASE 3
     // ./fsutils --cat <FAT16 file system> <file>
@@ -56,32 +178,107 @@ int main(int argc, char *argv[]) {
     // PHASE 4
     // ./fsutils --cat <EXT2 file system> <file>
 
-    char *fullPath = malloc(strlen("res/") + strlen(argv[2]) + 1);
-    strcpy(fullPath, "res/"); strcat(fullPath, argv[2]);
+    // RANGED CAT
+    // ./fsutils --cat <file system> <file> [--offset N] [--length M]
 
-    if (argc == 3) {
-        if (strcmp(argv[1], "--info") == 0) phase1(fullPath);
-        else if (strcmp(argv[1], "--tree") == 0) phase2(fullPath);
-        else printf("Error arguments\n");
-    } else if (argc == 4) {
-        if (strcmp(argv[1], "--cat") == 0) {
-            if (is_ext2(fullPath)) {
-                cat_ext2(fullPath, argv[3]);
-            }
-            else if (is_fat16(fullPath)) {
-                cat_fat16(fullPath, argv[3]);
-            }
-            else {
-                printf(ERR_OPEN_FILE);
-            }
-        }
-        else {
+    // FREE SPACE
+    // ./fsutils --usage <file system>
+
+    // CONTENT HASHES
+    // ./fsutils --hash <file system> [path]
+
+    // DELETED FILES
+    // ./fsutils --recover <file system> [output dir]
+
+    // CONTENT SEARCH
+    // ./fsutils --grep <pattern> <file system> [path]
+
+    // CONSISTENCY CHECK
+    // ./fsutils --check <EXT2 file system>
+
+    // SNAPSHOT DIFF
+    // ./fsutils --diff <file system A> <file system B>
+
+    // DISK USAGE
+    // ./fsutils --du <file system> [path]
+
+    // INODE INVENTORY
+    // ./fsutils --list-inodes <EXT2 file system>
+
+    // METADATA SEARCH
+    // ./fsutils --find <file system> [path] [-name GLOB] [-type f|d|l] [-size [+-]N[ckMG]]
+    //           [-mtime [+-]N] [-maxdepth N] [-prune GLOB] (any predicate can be negated with !)
+
+    // Images are looked up as given, then under res/
+
+    fs_limits_from_env();
+    image_options_from_env();
+
+    // --sort=... may go anywhere after --tree; it applies to every image
+    for (int i = 2; argc > 1 && strcmp(argv[1], "--tree") == 0 && i < argc; i++) {
+        if (strncmp(argv[i], "--sort=", 7) != 0) continue;
+        if (!tree_sort_parse(argv[i] + 7)) {
             printf("Error arguments\n");
+            return 1;
         }
+        memmove(argv + i, argv + i + 1, (argc - i) * sizeof(char *));
+        argc--;
+        i--;
+    }
+    if (argc < 3) {
+        printf("Error arguments\n");
+        return 1;
+    }
+
+    char *fullPath = image_path(argv[2]);
+    struct stat st;
+    int isDir = stat(fullPath, &st) == 0 && S_ISDIR(st.st_mode);
+
+    int status = 0;
+    if ((argc > 3 || isDir) && strcmp(argv[1], "--info") == 0) {
+        status = phase_batch(phase1, argc, argv);
+    } else if ((argc > 3 || isDir) && strcmp(argv[1], "--tree") == 0) {
+        status = phase_batch(phase2, argc, argv);
+    } else if (argc == 3) {
+        if (strcmp(argv[1], "--info") == 0) status = phase1(fullPath);
+        else if (strcmp(argv[1], "--tree") == 0) status = phase2(fullPath);
+        else if (strcmp(argv[1], "--usage") == 0) phase_usage(fullPath);
+        else if (strcmp(argv[1], "--hash") == 0) hash_image(fullPath, "");
+        else if (strcmp(argv[1], "--recover") == 0) phase_recover(fullPath, NULL);
+        else if (strcmp(argv[1], "--check") == 0) status = phase_check(fullPath);
+        else if (strcmp(argv[1], "--du") == 0) du_image(fullPath, "");
+        else if (strcmp(argv[1], "--list-inodes") == 0) status = phase_list_inodes(fullPath);
+        else if (strcmp(argv[1], "--find") == 0) status = find_image(fullPath, "", 0, NULL);
+        else printf("Error arguments\n");
+    } else if (argc == 4 && strcmp(argv[1], "--hash") == 0) {
+        hash_image(fullPath, argv[3]);
+    } else if (argc == 4 && strcmp(argv[1], "--du") == 0) {
+        du_image(fullPath, argv[3]);
+    } else if (argc == 4 && strcmp(argv[1], "--recover") == 0) {
+        phase_recover(fullPath, argv[3]);
+    } else if (argc >= 4 && strcmp(argv[1], "--find") == 0) {
+        // The start path is optional: the first argument that is not a predicate
+        int hasPath = argv[3][0] != '-' && strcmp(argv[3], "!") != 0;
+        status = find_image(fullPath, hasPath ? argv[3] : "", argc - 3 - hasPath, argv + 3 + hasPath);
+        if (status < 0) printf("Error arguments\n");
+        status = status != 0;
+    } else if ((argc == 4 || argc == 5) && strcmp(argv[1], "--grep") == 0) {
+        // Here argv[2] is the pattern and argv[3] the image
+        char *imagePath = image_path(argv[3]);
+        grep_image(imagePath, argv[2], argc == 5 ? argv[4] : "");
+        free(imagePath);
+    } else if (argc == 4 && strcmp(argv[1], "--diff") == 0) {
+        char *otherPath = image_path(argv[3]);
+        diff_images(fullPath, otherPath);
+        free(otherPath);
+    } else if (argc >= 4 && strcmp(argv[1], "--cat") == 0) {
+        uint64_t offset, length;
+        if (parse_cat_options(argc, argv, &offset, &length)) phase3(fullPath, argv[3], offset, length);
+        else printf("Error arguments\n");
     } else {
         printf("Error arguments\n");
     }
 
     free(fullPath);
-  return 0;
+  return status;
 }
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/sort.h"
+#include "../include/util.h"
+
+tree_sort_order tree_sort = TREE_SORT_NONE;
+
+// Bytes de entradas en memoria entre todas las ordenaciones abiertas del hilo
+static _Thread_local uint64_t sort_mem_used = 0;
+
+/*
+ * Entrada en memoria: cabecera fija y nombre en el mismo bloque. Cada una
+ * ocupa sizeof(sort_rec) + name_len + 1 bytes del pool, redondeado a 8.
+ */
+typedef struct {
+    uint64_t key;
+    uint32_t id;
+    uint8_t is_dir;
+    uint8_t name_len;
+    char name[];
+} sort_rec;
+
+/*
+ * Tramo ordenado en disco y su entrada actual durante la mezcla.
+ */
+typedef struct {
+    FILE *fp;
+    sort_entry cur;
+} sort_run;
+
+struct dir_sorter {
+    uint8_t *pool;              // Entradas en memoria
+    size_t pool_len;
+    size_t pool_cap;
+    sort_rec **recs;            // Entradas del pool, a ordenar
+    uint32_t count;
+    uint32_t cap;
+    uint32_t pos;               // Siguiente entrada en memoria a devolver
+
+    FILE **spilled;             // Tramos volcados, a la espera de la mezcla
+    uint32_t nspilled;
+    sort_run *runs;             // Tramos en mezcla, como montículo por entrada actual
+    uint32_t nruns;
+
+    int has_next;               // Entrada leída por adelantado, para saber cuál es la última
+    sort_entry next;
+};
+
+/**
+ * Order two entries: by name, or by size or date (largest or newest first)
+ * with the name as tie-breaker.
+ */
+static int compare(uint64_t ka, const char *na, uint64_t kb, const char *nb) {
+    if (tree_sort != TREE_SORT_NAME && ka != kb) return ka > kb ? -1 : 1;
+    return strcmp(na, nb);
+}
+
+static int cmp_rec(const void *a, const void *b) {
+    const sort_rec *x = *(const sort_rec *const *)a;
+    const sort_rec *y = *(const sort_rec *const *)b;
+    return compare(x->key, x->name, y->key, y->name);
+}
+
+static int cmp_run(const sort_run *a, const sort_run *b) {
+    return compare(a->cur.key, a->cur.name, b->cur.key, b->cur.name);
+}
+
+/**
+ * Set the order of --tree from its name ("name", "size" or "mtime").
+ *
+ * @param name Name of the order.
+ * @return TRUE if the name is valid, FALSE otherwise.
+ */
+int tree_sort_parse(const char *name) {
+    if (strcmp(name, "name") == 0) tree_sort = TREE_SORT_NAME;
+    else if (strcmp(name, "size") == 0) tree_sort = TREE_SORT_SIZE;
+    else if (strcmp(name, "mtime") == 0) tree_sort = TREE_SORT_MTIME;
+    else return FALSE;
+    return TRUE;
+}
+
+/**
+ * Create an empty sorter for the order in tree_sort.
+ *
+ * @return The sorter, or NULL if there is no memory.
+ */
+dir_sorter *dir_sorter_new(void) {
+    return calloc(1, sizeof(dir_sorter));
+}
+
+/**
+ * Write an entry to a run.
+ */
+static int write_entry(FILE *fp, uint64_t key, uint32_t id, uint8_t is_dir, uint8_t name_len, const char *name) {
+    return fwrite(&key, sizeof(key), 1, fp) == 1 && fwrite(&id, sizeof(id), 1, fp) == 1 &&
+           fwrite(&is_dir, 1, 1, fp) == 1 && fwrite(&name_len, 1, 1, fp) == 1 &&
+           (!name_len || fwrite(name, name_len, 1, fp) == 1) ? 0 : -1;
+}
+
+/**
+ * Read the next entry of a run.
+ *
+ * @return TRUE if an entry was read, FALSE at the end of the run.
+ */
+static int read_entry(FILE *fp, sort_entry *e) {
+    if (fread(&e->key, sizeof(e->key), 1, fp) != 1 || fread(&e->id, sizeof(e->id), 1, fp) != 1 ||
+        fread(&e->is_dir, 1, 1, fp) != 1 || fread(&e->name_len, 1, 1, fp) != 1 ||
+        (e->name_len && fread(e->name, e->name_len, 1, fp) != 1)) return FALSE;
+    e->name[e->name_len] = '\0';
+    return TRUE;
+}
+
+/**
+ * Drop the entries held in memory and give their bytes back to the budget.
+ */
+static void release_pool(dir_sorter *s) {
+    sort_mem_used -= s->pool_len + (uint64_t)s->cap * sizeof(sort_rec *);
+    free(s->pool);
+    free(s->recs);
+    s->pool = NULL;
+    s->recs = NULL;
+    s->pool_len = s->pool_cap = 0;
+    s->count = s->cap = s->pos = 0;
+}
+
+static void sort_pool(dir_sorter *s) {
+    // Un directorio vacío no tiene recs: qsort no admite NULL ni con 0 elementos
+    if (s->count == 0) return;
+    // Los punteros se rehacen aquí: el pool puede haberse movido al crecer
+    size_t off = 0;
+    for (uint32_t i = 0; i < s->count; i++) {
+        s->recs[i] = (sort_rec *)(s->pool + off);
+        off += (sizeof(sort_rec) + s->recs[i]->name_len + 1 + 7) & ~(size_t)7;
+    }
+    qsort(s->recs, s->count, sizeof(sort_rec *), cmp_rec);
+}
+
+/**
+ * Sort the entries in memory and write them out as a new run.
+ */
+static int spill(dir_sorter *s) {
+    FILE **tmp = realloc(s->spilled, (s->nspilled + 1) * sizeof(FILE *));
+    if (!tmp) return -1;
+    s->spilled = tmp;
+    FILE *fp = tmpfile();
+    if (!fp) return -1;
+    s->spilled[s->nspilled++] = fp;
+
+    sort_pool(s);
+    for (uint32_t i = 0; i < s->count; i++) {
+        const sort_rec *r = s->recs[i];
+        if (write_entry(fp, r->key, r->id, r->is_dir, r->name_len, r->name) != 0) return -1;
+    }
+    release_pool(s);
+    return fflush(fp) == 0 && fseek(fp, 0, SEEK_SET) == 0 ? 0 : -1;
+}
+
+/**
+ * Add an entry. When the memory budget of the thread is used up, the entries
+ * held so far are sorted and spilled to a temporary file as one run.
+ *
+ * @param s      Sorter.
+ * @param name   Entry name (copied).
+ * @param key    Size or modification time.
+ * @param id     Inode or first cluster.
+ * @param is_dir TRUE for a directory.
+ * @return 0 on success, -1 on error.
+ */
+int dir_sorter_add(dir_sorter *s, const char *name, uint64_t key, uint32_t id, int is_dir) {
+    size_t len = strlen(name);
+    if (len > SORT_NAME_MAX) len = SORT_NAME_MAX;
+    size_t size = (sizeof(sort_rec) + len + 1 + 7) & ~(size_t)7;
+
+    // Sin sitio en el presupuesto: lo que haya en memoria pasa a disco, en tramos
+    // de al menos SORT_MIN_RUN bytes aunque otros directorios ocupen el resto
+    if (s->pool_len >= SORT_MIN_RUN && sort_mem_used + size + sizeof(sort_rec *) > fs_limit.sort_mem &&
+        spill(s) != 0) return -1;
+
+    if (s->pool_len + size > s->pool_cap) {
+        size_t cap = s->pool_cap ? s->pool_cap * 2 : 4096;
+        while (cap < s->pool_len + size) cap *= 2;
+        uint8_t *pool = realloc(s->pool, cap);
+        if (!pool) return -1;
+        s->pool = pool;
+        s->pool_cap = cap;
+    }
+    if (s->count == s->cap) {
+        uint32_t cap = s->cap ? s->cap * 2 : 64;
+        sort_rec **recs = realloc(s->recs, cap * sizeof(sort_rec *));
+        if (!recs) return -1;
+        sort_mem_used += (uint64_t)(cap - s->cap) * sizeof(sort_rec *);
+        s->recs = recs;
+        s->cap = cap;
+    }
+
+    sort_rec *r = (sort_rec *)(s->pool + s->pool_len);
+    r->key = key;
+    r->id = id;
+    r->is_dir = is_dir != 0;
+    r->name_len = len;
+    memcpy(r->name, name, len);
+    r->name[len] = '\0';
+    s->pool_len += size;
+    sort_mem_used += size;
+    s->count++;
+    return 0;
+}
+
+static void heap_down(sort_run *h, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t m = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && cmp_run(&h[l], &h[m]) < 0) m = l;
+        if (r < n && cmp_run(&h[r], &h[m]) < 0) m = r;
+        if (m == i) return;
+        sort_run tmp = h[i];
+        h[i] = h[m];
+        h[m] = tmp;
+        i = m;
+    }
+}
+
+/**
+ * Open runs for merging: read the first entry of each and build the heap.
+ */
+static void merge_open(dir_sorter *s, FILE **files, uint32_t n) {
+    s->runs = calloc(n ? n : 1, sizeof(sort_run));
+    s->nruns = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (s->runs && read_entry(files[i], &s->runs[s->nruns].cur)) s->runs[s->nruns++].fp = files[i];
+        else fclose(files[i]);
+    }
+    for (uint32_t i = s->nruns / 2; i-- > 0;) heap_down(s->runs, s->nruns, i);
+}
+
+/**
+ * Take the smallest entry of the runs being merged.
+ */
+static int merge_pop(dir_sorter *s, sort_entry *out) {
+    if (!s->nruns) return FALSE;
+    *out = s->runs[0].cur;
+    if (!read_entry(s->runs[0].fp, &s->runs[0].cur)) {
+        fclose(s->runs[0].fp);
+        s->runs[0] = s->runs[--s->nruns];
+    }
+    heap_down(s->runs, s->nruns, 0);
+    return TRUE;
+}
+
+static void merge_close(dir_sorter *s) {
+    for (uint32_t i = 0; i < s->nruns; i++) fclose(s->runs[i].fp);
+    free(s->runs);
+    s->runs = NULL;
+    s->nruns = 0;
+}
+
+/**
+ * Pull the next entry in order into s->next.
+ */
+static void advance(dir_sorter *s) {
+    if (s->runs) {
+        s->has_next = merge_pop(s, &s->next);
+        return;
+    }
+    s->has_next = s->pos < s->count;
+    if (!s->has_next) return;
+    const sort_rec *r = s->recs[s->pos++];
+    s->next.key = r->key;
+    s->next.id = r->id;
+    s->next.is_dir = r->is_dir;
+    s->next.name_len = r->name_len;
+    memcpy(s->next.name, r->name, r->name_len + 1);
+}
+
+/**
+ * Stop adding and get ready to read the entries back: an in-memory sort, or
+ * a k-way merge of the runs on disk, merged in groups of SORT_MAX_FANIN
+ * first when there are more.
+ *
+ * @param s Sorter.
+ * @return 0 on success, -1 on error.
+ */
+int dir_sorter_finish(dir_sorter *s) {
+    if (!s->nspilled) {
+        sort_pool(s);
+        advance(s);
+        return 0;
+    }
+    if (s->count && spill(s) != 0) return -1;
+
+    // Demasiados tramos para abrirlos a la vez: se mezclan por grupos en tramos mayores
+    while (s->nspilled > SORT_MAX_FANIN) {
+        FILE *out = tmpfile();
+        if (!out) return -1;
+        merge_open(s, s->spilled, SORT_MAX_FANIN);
+        sort_entry e;
+        int ok = TRUE;
+        while (ok && merge_pop(s, &e)) ok = write_entry(out, e.key, e.id, e.is_dir, e.name_len, e.name) == 0;
+        merge_close(s);
+        memmove(s->spilled, s->spilled + SORT_MAX_FANIN, (s->nspilled - SORT_MAX_FANIN) * sizeof(FILE *));
+        s->nspilled -= SORT_MAX_FANIN;
+        s->spilled[s->nspilled++] = out;
+        if (!ok || fflush(out) != 0 || fseek(out, 0, SEEK_SET) != 0) return -1;
+    }
+
+    merge_open(s, s->spilled, s->nspilled);
+    s->nspilled = 0;
+    if (!s->runs) return -1;
+    advance(s);
+    return 0;
+}
+
+/**
+ * Next entry in order. One entry is always read ahead, so the caller knows
+ * which one is the last without a second pass.
+ *
+ * @param s       Sorter.
+ * @param out     Output entry.
+ * @param is_last Output: TRUE if this is the last entry.
+ * @return TRUE if there was an entry, FALSE at the end.
+ */
+int dir_sorter_next(dir_sorter *s, sort_entry *out, int *is_last) {
+    if (!s->has_next) return FALSE;
+    *out = s->next;
+    advance(s);
+    *is_last = !s->has_next;
+    return TRUE;
+}
+
+/**
+ * Free a sorter, closing (and so deleting) its temporary files.
+ *
+ * @param s Sorter.
+ */
+void dir_sorter_free(dir_sorter *s) {
+    if (!s) return;
+    release_pool(s);
+    merge_close(s);
+    for (uint32_t i = 0; i < s->nspilled; i++) fclose(s->spilled[i]);
+    free(s->spilled);
+    free(s);
+}
@@ -1,12 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "../include/util.h"
 
 /**
 * This function formats a time_t value into a human-readable string.
 * @param t The time_t value to format.
-* @return A pointer to a static buffer containing the formatted time string.
+* @return A pointer to a per-thread buffer containing the formatted time string.
 */
 char *format_time(time_t t) {
-    static char buf[64];
-    strftime(buf, sizeof(buf), "%a %b %d %H:%M:%S %Y", localtime(&t));
+    static _Thread_local char buf[64];
+    struct tm tm;
+    strftime(buf, sizeof(buf), "%a %b %d %H:%M:%S %Y", localtime_r(&t, &tm));
     return buf;
 }
+
+static _Thread_local FILE *thread_out = NULL;
+
+/**
+* Stream the readers print their reports to.
+* @return The stream set with fs_set_out, or stdout.
+*/
+FILE *fs_out(void) {
+    return thread_out ? thread_out : stdout;
+}
+
+/**
+* Redirect the reports printed by the calling thread.
+* @param fp The stream to print to, or NULL for stdout.
+*/
+void fs_set_out(FILE *fp) {
+    thread_out = fp;
+}
+
+// Same loop compiled twice: with the popcnt instruction and without it.
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static uint64_t popcount_words_hw(const uint8_t *bm, uint64_t nwords) {
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < nwords; i++) {
+        uint64_t w;
+        memcpy(&w, bm + i * 8, 8);
+        n += __builtin_popcountll(w);
+    }
+    return n;
+}
+#endif
+
+static uint64_t popcount_words_sw(const uint8_t *bm, uint64_t nwords) {
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < nwords; i++) {
+        uint64_t w;
+        memcpy(&w, bm + i * 8, 8);
+        n += __builtin_popcountll(w);
+    }
+    return n;
+}
+
+/**
+* Count the set bits of a bitmap, one 64-bit word at a time.
+* Uses the hardware popcount instruction when the CPU has it.
+* @param bm The bitmap.
+* @param nbits Number of bits to count.
+* @return Number of bits set to 1.
+*/
+uint64_t bitmap_popcount(const uint8_t *bm, uint64_t nbits) {
+    uint64_t nwords = nbits / 64;
+    uint64_t n;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("popcnt")) n = popcount_words_hw(bm, nwords);
+    else n = popcount_words_sw(bm, nwords);
+#else
+    n = popcount_words_sw(bm, nwords);
+#endif
+    // Tail bits that do not fill a whole word
+    for (uint64_t i = nwords * 64; i < nbits; i++) {
+        if (bm[i / 8] & (1u << (i % 8))) n++;
+    }
+    return n;
+}
+
+/**
+* Feed a run of units with the same state into the statistics.
+* @param st The statistics to update.
+* @param start First unit of the run.
+* @param len Length of the run.
+* @param is_free TRUE if the run is free space.
+*/
+void usage_feed(usage_stats *st, uint64_t start, uint64_t len, int is_free) {
+    if (len == 0) return;
+    st->total += len;
+    if (is_free) {
+        if (st->run == 0) st->run_start = start;
+        st->run += len;
+        st->free += len;
+    } else {
+        usage_finish(st);
+    }
+}
+
+/**
+* Feed a bitmap (bit set = allocated) into the statistics, skipping
+* whole 64-bit words that are completely free or completely used.
+* @param st The statistics to update.
+* @param bm The bitmap.
+* @param nbits Number of valid bits.
+* @param base Unit number of bit 0.
+*/
+void usage_feed_bitmap(usage_stats *st, const uint8_t *bm, uint64_t nbits, uint64_t base) {
+    uint64_t nwords = nbits / 64;
+    for (uint64_t wi = 0; wi < nwords; wi++) {
+        uint64_t w;
+        memcpy(&w, bm + wi * 8, 8);
+        if (w == 0 || w == ~0ULL) {
+            usage_feed(st, base + wi * 64, 64, w == 0);
+            continue;
+        }
+        // Mixed word: jump from one bit change to the next with ctz
+        unsigned pos = 0;
+        while (pos < 64) {
+            int bit = (w >> pos) & 1;
+            uint64_t rest = (bit ? ~w : w) >> pos;
+            unsigned len = rest ? (unsigned)__builtin_ctzll(rest) : 64 - pos;
+            usage_feed(st, base + wi * 64 + pos, len, !bit);
+            pos += len;
+        }
+    }
+    for (uint64_t i = nwords * 64; i < nbits; i++) {
+        usage_feed(st, base + i, 1, !(bm[i / 8] & (1u << (i % 8))));
+    }
+}
+
+/**
+* Close the open free extent, if any. Call once after the last feed.
+* @param st The statistics to update.
+*/
+void usage_finish(usage_stats *st) {
+    if (st->run == 0) return;
+    int b = 63 - __builtin_clzll(st->run);
+    if (b >= USAGE_HIST_BUCKETS) b = USAGE_HIST_BUCKETS - 1;
+    st->hist[b]++;
+    st->extents++;
+    if (st->run > st->largest) {
+        st->largest = st->run;
+        st->largest_start = st->run_start;
+    }
+    st->run = 0;
+}
+
+/**
+* Print the free extent summary and histogram.
+* @param st The statistics to print.
+* @param unit_size Size in bytes of one unit.
+* @param unit_name Name of the unit ("block", "cluster").
+*/
+void usage_print(const usage_stats *st, uint32_t unit_size, const char *unit_name) {
+    fprintf(fs_out(), "\nFREE SPACE\n");
+    fprintf(fs_out(), "  Total............: %llu %ss\n", (unsigned long long)st->total, unit_name);
+    fprintf(fs_out(), "  Free.............: %llu %ss (%.1f%%)\n", (unsigned long long)st->free, unit_name,
+                      st->total ? 100.0 * st->free / st->total : 0.0);
+    fprintf(fs_out(), "  Free Extents.....: %llu\n", (unsigned long long)st->extents);
+    fprintf(fs_out(), "  Largest Extent...: %llu %ss (%llu bytes) at %llu\n",
+                      (unsigned long long)st->largest, unit_name,
+                      (unsigned long long)st->largest * unit_size, (unsigned long long)st->largest_start);
+    fprintf(fs_out(), "  Avg Extent.......: %.1f %ss\n", st->extents ? (double)st->free / st->extents : 0.0, unit_name);
+
+    fprintf(fs_out(), "\nFREE EXTENT HISTOGRAM (%ss)\n", unit_name);
+    for (int b = 0; b < USAGE_HIST_BUCKETS; b++) {
+        if (!st->hist[b]) continue;
+        uint64_t lo = 1ULL << b;
+        fprintf(fs_out(), "  %10llu - %-10llu: %llu\n", (unsigned long long)lo,
+                          (unsigned long long)(lo * 2 - 1), (unsigned long long)st->hist[b]);
+    }
+    fprintf(fs_out(), "\n");
+}
+
+/**
+* Append a file to a list. The path is copied.
+* @param list The list.
+* @param path Full path of the file.
+* @param size Size in bytes.
+* @param first_block First physical block or cluster.
+* @param id File identifier (inode or first cluster).
+* @return 0 on success, -1 if out of memory.
+*/
+int fs_file_list_add(fs_file_list *list, const char *path, uint64_t size, uint64_t first_block, uint32_t id) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        fs_file *files = realloc(list->files, cap * sizeof(fs_file));
+        if (!files) return -1;
+        list->files = files;
+        list->cap = cap;
+    }
+    fs_file *f = &list->files[list->count];
+    f->path = strdup(path);
+    if (!f->path) return -1;
+    f->size = size;
+    f->first_block = first_block;
+    f->id = id;
+    list->count++;
+    return 0;
+}
+
+/**
+* Free a list and all its paths.
+* @param list The list.
+*/
+void fs_file_list_free(fs_file_list *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->files[i].path);
+    free(list->files);
+    memset(list, 0, sizeof(*list));
+}
+
+/**
+* Join a directory path and a name with '/'. An empty directory is the root.
+* @param dir The directory path.
+* @param name The entry name.
+* @return A newly allocated string, or NULL if out of memory.
+*/
+char *path_join(const char *dir, const char *name) {
+    size_t dl = strlen(dir), nl = strlen(name);
+    char *p = malloc(dl + nl + 2);
+    if (!p) return NULL;
+    memcpy(p, dir, dl);
+    if (dl) p[dl++] = '/';
+    memcpy(p + dl, name, nl + 1);
+    return p;
+}
+
+/**
+* Prefix for the children of a --tree entry: the entry's prefix followed by
+* a vertical bar, or by blanks when it is the last of its directory.
+* @param prefix The prefix of the entry.
+* @param is_last Whether the entry is the last of its directory.
+* @return A newly allocated string, or NULL if out of memory.
+*/
+char *tree_child_prefix(const char *prefix, int is_last) {
+    // "│" son 3 bytes en UTF-8: el tamaño sale de la cadena, no de las columnas
+    const char *tail = is_last ? "    " : "│   ";
+    size_t pl = strlen(prefix), tl = strlen(tail);
+    char *p = malloc(pl + tl + 1);
+    if (!p) return NULL;
+    memcpy(p, prefix, pl);
+    memcpy(p + pl, tail, tl + 1);
+    return p;
+}
+
+fs_limits fs_limit = { FS_DEFAULT_MAX_DEPTH, FS_DEFAULT_MAX_DIR_BYTES, FS_DEFAULT_SORT_MEM };
+
+/**
+* Load the limits from the environment, keeping the defaults for the
+* variables that are unset or not a positive number.
+*/
+void fs_limits_from_env(void) {
+    const char *v = getenv("FSUTILS_MAX_DEPTH");
+    unsigned long long n;
+    if (v && (n = strtoull(v, NULL, 0)) > 0 && n <= UINT32_MAX) fs_limit.max_depth = n;
+    v = getenv("FSUTILS_MAX_DIR_BYTES");
+    if (v && (n = strtoull(v, NULL, 0)) > 0) fs_limit.max_dir_bytes = n;
+    v = getenv("FSUTILS_SORT_MEM");
+    if (v && (n = strtoull(v, NULL, 0)) > 0) fs_limit.sort_mem = n;
+}
+
+/**
+* Start a walk: fill in its top node, to be passed as the parent of the
+* start directory, with an empty visited set.
+* @param top Top node, on the caller's stack.
+*/
+void fs_walk_begin(fs_walk *top) {
+    memset(top, 0, sizeof(*top));
+    top->top = TRUE;
+    // Sin memoria para el conjunto quedan las comprobaciones de ancestros y profundidad
+    top->visited = calloc(1, sizeof(fs_visited));
+    if (top->visited) pthread_mutex_init(&top->visited->lock, NULL);
+}
+
+/**
+* Finish a walk started with fs_walk_begin and free its visited set.
+* @param top Top node of the walk.
+*/
+void fs_walk_end(fs_walk *top) {
+    if (!top->visited) return;
+    pthread_mutex_destroy(&top->visited->lock);
+    free(top->visited->slots);
+    free(top->visited);
+    top->visited = NULL;
+}
+
+/**
+* Add an id to a visited set, doubling the table at half load.
+* @return TRUE if it was not in the set yet (or the set cannot grow).
+*/
+static int visited_add(fs_visited *v, uint32_t id) {
+    pthread_mutex_lock(&v->lock);
+    if ((v->count + 1) * 2 > v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 64;
+        uint64_t *slots = calloc(cap, sizeof(uint64_t));
+        if (!slots) {
+            pthread_mutex_unlock(&v->lock);
+            return TRUE;
+        }
+        for (size_t i = 0; i < v->cap; i++) {
+            if (!v->slots[i]) continue;
+            size_t j = (v->slots[i] * 0x9E3779B97F4A7C15ULL >> 32) & (cap - 1);
+            while (slots[j]) j = (j + 1) & (cap - 1);
+            slots[j] = v->slots[i];
+        }
+        free(v->slots);
+        v->slots = slots;
+        v->cap = cap;
+    }
+
+    uint64_t key = (uint64_t)id + 1;
+    size_t j = (key * 0x9E3779B97F4A7C15ULL >> 32) & (v->cap - 1);
+    while (v->slots[j] && v->slots[j] != key) j = (j + 1) & (v->cap - 1);
+    int added = !v->slots[j];
+    if (added) {
+        v->slots[j] = key;
+        v->count++;
+    }
+    pthread_mutex_unlock(&v->lock);
+    return added;
+}
+
+/**
+* Enter a directory during a recursive walk.
+* @param node Node to fill in for the directory, on the caller's stack.
+* @param parent Node of the parent directory, or the top node of the walk
+* for the start directory.
+* @param id Inode or first cluster of the directory.
+* @return TRUE if it can be walked, FALSE if it is an ancestor (a cycle),
+* it was already walked through another path or it is deeper than
+* fs_limit.max_depth.
+*/
+int fs_walk_enter(fs_walk *node, const fs_walk *parent, uint32_t id) {
+    node->id = id;
+    node->depth = parent && !parent->top ? parent->depth + 1 : 0;
+    node->parent = parent;
+    node->visited = parent ? parent->visited : NULL;
+    node->top = FALSE;
+    if (node->depth > fs_limit.max_depth) {
+        fprintf(stderr, "Skipping directory %u: deeper than %u levels\n", id, fs_limit.max_depth);
+        return FALSE;
+    }
+    for (const fs_walk *p = parent; p && !p->top; p = p->parent) {
+        if (p->id == id) {
+            fprintf(stderr, "Skipping directory %u: it is one of its own ancestors\n", id);
+            return FALSE;
+        }
+    }
+    if (node->visited && !visited_add(node->visited, id)) {
+        fprintf(stderr, "Skipping directory %u: already walked through another path\n", id);
+        return FALSE;
+    }
+    return TRUE;
+}